@@ -0,0 +1,248 @@
+#include "multi-hop-lora-abstract-phy.h"
+#include "multi-hop-lora-channel.h"
+#include "ns3/log.h"
+#include "ns3/assert.h"
+#include "ns3/simulator.h"
+#include "ns3/double.h"
+#include "ns3/node.h"
+#include "ns3/lora-net-device.h"
+#include "ns3/end-device-lora-phy.h"
+#include <algorithm>
+#include <cmath>
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE("MultiHopLoraAbstractChannel");
+NS_OBJECT_ENSURE_REGISTERED(MultiHopLoraAbstractChannel);
+
+//minimum SIR in dB of a signal (row, SF7..SF12) against the interference of each SF (column),
+//the default isolation matrix of the ns-3 lorawan interference helper
+static const double SIR_THRESHOLD[6][6] = {
+    {6, -16, -18, -19, -19, -20},
+    {-24, 6, -20, -22, -22, -22},
+    {-27, -27, 6, -23, -25, -25},
+    {-30, -30, -30, 6, -26, -28},
+    {-33, -33, -33, -33, 6, -29},
+    {-36, -36, -36, -36, -36, 6}};
+
+TypeId
+MultiHopLoraAbstractChannel::GetTypeId(void)
+{
+    static TypeId tid = TypeId("ns3::MultiHopLoraAbstractChannel")
+    .SetParent<lorawan::LoraChannel>()
+    .SetGroupName("lorawan")
+    .AddAttribute("TransitionWidth",
+                  "dB over which the PER falls from 1 at the sensitivity, as a half-normal tail (0 = the hard threshold of the full PHY)",
+                  DoubleValue(0.0),
+                  MakeDoubleAccessor(&MultiHopLoraAbstractChannel::m_width),
+                  MakeDoubleChecker<double>(0.0))
+    .AddAttribute("FloorMargin",
+                  "dB below the lowest sensitivity down to which a link is kept, weaker ones neither decode nor interfere",
+                  DoubleValue(6.0),
+                  MakeDoubleAccessor(&MultiHopLoraAbstractChannel::m_floorMargin),
+                  MakeDoubleChecker<double>(0.0))
+    ;
+    return tid;
+}
+
+MultiHopLoraAbstractChannel::MultiHopLoraAbstractChannel()
+    :m_delay(CreateObject<ConstantSpeedPropagationDelayModel>()),m_width(0.0),m_floorMargin(6.0),m_nextId(0),m_longest(Seconds(0)),
+     m_delivered(0),m_collisions(0),m_halfDuplex(0),m_perLosses(0)
+{
+    m_rng = CreateObject<UniformRandomVariable>();
+}
+
+MultiHopLoraAbstractChannel::MultiHopLoraAbstractChannel(Ptr<PropagationLossModel> loss, Ptr<PropagationDelayModel> delay)
+    :lorawan::LoraChannel(loss, delay),m_delay(delay),m_width(0.0),m_floorMargin(6.0),m_nextId(0),m_longest(Seconds(0)),
+     m_delivered(0),m_collisions(0),m_halfDuplex(0),m_perLosses(0)
+{
+    m_rng = CreateObject<UniformRandomVariable>();
+}
+
+MultiHopLoraAbstractChannel::~MultiHopLoraAbstractChannel()
+{}
+
+int64_t
+MultiHopLoraAbstractChannel::AssignStreams(int64_t stream)
+{
+    m_rng->SetStream(stream);
+    return 1;
+}
+
+double
+MultiHopLoraAbstractChannel::GetPer(double marginDb) const
+{
+    if (marginDb < 0)
+    {
+        return 1.0;
+    }
+    return m_width > 0 ? std::erfc(marginDb / (std::sqrt(2.0) * m_width)) : 0.0;
+}
+
+void
+MultiHopLoraAbstractChannel::BuildIndex(void) const
+{
+    for (std::size_t i = m_phys.size(); i < GetNDevices(); ++i)
+    {
+        Ptr<lorawan::LoraNetDevice> device = DynamicCast<lorawan::LoraNetDevice>(GetDevice(i));
+        NS_ASSERT_MSG(device, "Only LoraNetDevices can share a MultiHopLoraAbstractChannel");
+        m_index[PeekPointer(device->GetPhy())] = m_phys.size();
+        m_phys.push_back(device->GetPhy());
+    }
+    //links to new PHYs are missing from the senders seen so far
+    m_senders.assign(m_phys.size(), Sender());
+    m_known.assign(m_phys.size(), false);
+}
+
+const MultiHopLoraAbstractChannel::Sender &
+MultiHopLoraAbstractChannel::GetSender(uint32_t index, double txPowerDbm) const
+{
+    Sender &sender = m_senders[index];
+    if (m_known[index] && sender.txPowerDbm == txPowerDbm)
+    {
+        return sender;
+    }
+
+    const double *sensitivity = lorawan::EndDeviceLoraPhy::sensitivity;
+    double floorDbm = *std::min_element(sensitivity, sensitivity + 6) - m_floorMargin;
+    Ptr<MobilityModel> senderMobility = m_phys[index]->GetMobility();
+    sender.txPowerDbm = txPowerDbm;
+    sender.links.clear();
+    for (uint32_t rx = 0; rx < m_phys.size(); ++rx)
+    {
+        if (rx == index)
+        {
+            continue;
+        }
+        double rxPowerDbm = GetRxPower(txPowerDbm, senderMobility, m_phys[rx]->GetMobility());
+        if (rxPowerDbm < floorDbm)
+        {
+            continue;
+        }
+        Link link;
+        link.rx = rx;
+        link.rxPowerDbm = rxPowerDbm;
+        for (uint32_t sf = 0; sf < 6; ++sf)
+        {
+            link.per[sf] = GetPer(rxPowerDbm - sensitivity[sf]);
+        }
+        sender.links.push_back(link);
+    }
+    m_known[index] = true;
+    NS_LOG_DEBUG("PHY " << index << " reaches " << sender.links.size() << " PHYs above " << floorDbm << " dBm");
+    return sender;
+}
+
+const MultiHopLoraAbstractChannel::Link *
+MultiHopLoraAbstractChannel::FindLink(uint32_t tx, uint32_t rx) const
+{
+    //every sender in the list has transmitted, so its links are known
+    const std::vector<Link> &links = m_senders[tx].links;
+    auto it = std::lower_bound(links.begin(), links.end(), rx, [](const Link &link, uint32_t index) { return link.rx < index; });
+    return it != links.end() && it->rx == rx ? &*it : nullptr;
+}
+
+void
+MultiHopLoraAbstractChannel::Send(Ptr<lorawan::LoraPhy> sender, Ptr<Packet> packet, double txPowerDbm, lorawan::LoraTxParameters txParams, Time duration, double frequencyMHz) const
+{
+    MultiHopLoraGridChannel::ApplyTxTag(packet, txParams, duration, frequencyMHz);
+    if (m_phys.size() != GetNDevices())
+    {
+        BuildIndex();
+    }
+    auto it = m_index.find(PeekPointer(sender));
+    NS_ASSERT_MSG(it != m_index.end(), "Sender is not on this channel");
+    GetSender(it->second, txPowerDbm);
+
+    uint64_t id = m_nextId++;
+    m_transmissions.push_back(Transmission{id, Simulator::Now(), Simulator::Now() + duration, it->second, txParams.sf, frequencyMHz, txPowerDbm, packet->Copy()});
+    m_longest = std::max(m_longest, duration);
+    //the verdict needs every frame that overlaps this one, so it waits for the end
+    MultiHopLoraAbstractChannel *self = const_cast<MultiHopLoraAbstractChannel *>(this);
+    Simulator::Schedule(duration, &MultiHopLoraAbstractChannel::Evaluate, self, id);
+}
+
+void
+MultiHopLoraAbstractChannel::Evaluate(uint64_t id)
+{
+    NS_ASSERT(!m_transmissions.empty() && id >= m_transmissions.front().id);
+    const Transmission tx = m_transmissions[id - m_transmissions.front().id];
+    const Sender &sender = m_senders[tx.sender];
+    double durationS = (tx.end - tx.start).GetSeconds();
+
+    //frames that overlap this one have all started by now
+    std::vector<const Transmission *> overlapping;
+    for (const Transmission &other : m_transmissions)
+    {
+        if (other.id != id && other.start < tx.end && other.end > tx.start)
+        {
+            overlapping.push_back(&other);
+        }
+    }
+
+    for (const Link &link : sender.links)
+    {
+        bool transmitting = false;
+        double interference[6] = {0, 0, 0, 0, 0, 0}; //mW * s per SF
+        for (const Transmission *other : overlapping)
+        {
+            if (other->sender == link.rx)
+            {
+                transmitting = true;
+                break;
+            }
+            const Link *cross = other->frequencyMHz == tx.frequencyMHz ? FindLink(other->sender, link.rx) : nullptr;
+            if (cross)
+            {
+                double overlapS = (std::min(tx.end, other->end) - std::max(tx.start, other->start)).GetSeconds();
+                double powerDbm = cross->rxPowerDbm + other->txPowerDbm - m_senders[other->sender].txPowerDbm;
+                interference[other->sf - 7] += std::pow(10.0, powerDbm / 10.0) * overlapS;
+            }
+        }
+        if (transmitting)
+        {
+            m_halfDuplex++;
+            continue;
+        }
+
+        double rxPowerDbm = link.rxPowerDbm + tx.txPowerDbm - sender.txPowerDbm;
+        double signal = std::pow(10.0, rxPowerDbm / 10.0) * durationS;
+        bool collided = false;
+        for (uint32_t sf = 0; sf < 6 && !collided; ++sf)
+        {
+            collided = interference[sf] > 0 && 10.0 * std::log10(signal / interference[sf]) < SIR_THRESHOLD[tx.sf - 7][sf];
+        }
+        if (collided)
+        {
+            m_collisions++;
+            continue;
+        }
+        double per = link.per[tx.sf - 7];
+        if (per >= 1.0 || (per > 0 && m_rng->GetValue() < per))
+        {
+            m_perLosses++;
+            continue;
+        }
+
+        //the PHY only forwards the frame up, its own checks (channel, state) still apply
+        Ptr<lorawan::LoraPhy> phy = m_phys[link.rx];
+        uint32_t dstNode = phy->GetDevice() ? phy->GetDevice()->GetNode()->GetId() : 0xffffffff;
+        Time delay = m_delay->GetDelay(m_phys[tx.sender]->GetMobility(), phy->GetMobility());
+        Simulator::ScheduleWithContext(dstNode, delay, &lorawan::LoraPhy::StartReceive, phy, tx.packet->Copy(), rxPowerDbm, tx.sf, NanoSeconds(1), tx.frequencyMHz);
+        m_delivered++;
+    }
+
+    //frames that ended before anything still pending could have started are of no further use
+    while (!m_transmissions.empty() && m_transmissions.front().end + m_longest < Simulator::Now())
+    {
+        m_transmissions.pop_front();
+    }
+}
+
+// Getters implementation
+uint64_t MultiHopLoraAbstractChannel::GetDelivered (void) const { return m_delivered; }
+uint64_t MultiHopLoraAbstractChannel::GetCollisions (void) const { return m_collisions; }
+uint64_t MultiHopLoraAbstractChannel::GetHalfDuplexLosses (void) const { return m_halfDuplex; }
+uint64_t MultiHopLoraAbstractChannel::GetPerLosses (void) const { return m_perLosses; }
+
+} //namespace ns3
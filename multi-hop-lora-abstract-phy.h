@@ -0,0 +1,95 @@
+#ifndef MULTI_HOP_LORA_ABSTRACT_PHY_H
+#define MULTI_HOP_LORA_ABSTRACT_PHY_H
+
+#include "ns3/lora-channel.h"
+#include "ns3/lora-phy.h"
+#include "ns3/propagation-delay-model.h"
+#include "ns3/propagation-loss-model.h"
+#include "ns3/random-variable-stream.h"
+#include <deque>
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
+
+namespace ns3 {
+
+//LoraChannel that decides receptions at link level instead of running every PHY's interference model
+//every frame goes on a time-sorted transmission list and is judged once, when it ends, for each
+//receiver that hears it above the floor: lost if the receiver was transmitting, if the energy of
+//the overlapping frames is too high for the SIR thresholds of the ns-3 SF isolation matrix, or by a
+//draw against the link's PER. survivors reach the receiving PHY as a 1 ns reception at the end
+//of the frame, so the layers above see the frame when a full PHY would deliver it.
+//receive powers and PERs are computed once per link, nodes must not move
+class MultiHopLoraAbstractChannel: public lorawan::LoraChannel
+{
+public:
+    static TypeId GetTypeId(void);
+    MultiHopLoraAbstractChannel();
+    MultiHopLoraAbstractChannel(Ptr<PropagationLossModel> loss, Ptr<PropagationDelayModel> delay);
+    virtual ~MultiHopLoraAbstractChannel();
+
+    void Send(Ptr<lorawan::LoraPhy> sender, Ptr<Packet> packet, double txPowerDbm, lorawan::LoraTxParameters txParams, Time duration, double frequencyMHz) const override;
+
+    //PER of a frame received marginDb above the sensitivity of its SF
+    double GetPer(double marginDb) const;
+
+    //returns the number of streams used
+    int64_t AssignStreams(int64_t stream);
+
+    //Getters
+    uint64_t GetDelivered(void) const;
+    uint64_t GetCollisions(void) const;
+    uint64_t GetHalfDuplexLosses(void) const;
+    uint64_t GetPerLosses(void) const;
+
+private:
+    struct Link
+    {
+        uint32_t rx;
+        double rxPowerDbm;
+        double per[6]; //SF7..SF12
+    };
+    struct Sender
+    {
+        double txPowerDbm;
+        std::vector<Link> links; //receivers above the floor, sorted by index
+    };
+    struct Transmission
+    {
+        uint64_t id;
+        Time start;
+        Time end;
+        uint32_t sender;
+        uint8_t sf;
+        double frequencyMHz;
+        double txPowerDbm;
+        Ptr<Packet> packet;
+    };
+
+    void BuildIndex(void) const;
+    const Sender &GetSender(uint32_t index, double txPowerDbm) const;
+    const Link *FindLink(uint32_t tx, uint32_t rx) const;
+    void Evaluate(uint64_t id);
+
+    Ptr<PropagationDelayModel> m_delay;
+    Ptr<UniformRandomVariable> m_rng;
+    double m_width;
+    double m_floorMargin;
+
+    mutable std::vector<Ptr<lorawan::LoraPhy>> m_phys;
+    mutable std::unordered_map<const lorawan::LoraPhy *, uint32_t> m_index;
+    mutable std::vector<Sender> m_senders; //filled on a node's first transmission
+    mutable std::vector<bool> m_known;
+    mutable std::deque<Transmission> m_transmissions; //by start time, which is id order
+    mutable uint64_t m_nextId;
+    mutable Time m_longest; //longest frame seen, how far back a frame can still overlap
+
+    uint64_t m_delivered;
+    uint64_t m_collisions;
+    uint64_t m_halfDuplex;
+    uint64_t m_perLosses;
+};
+
+} //namespace ns3
+
+#endif //MULTI_HOP_LORA_ABSTRACT_PHY_H
@@ -1,10 +1,25 @@
 #include "multi-hop-lora-app.h"
+#include "multi-hop-lora-trace.h"
+#include "multi-hop-lora-profile.h"
 #include "ns3/log.h"
 #include "ns3/inet-socket-address.h"
 #include "ns3/packet.h"
 #include "ns3/simulator.h"
 #include "ns3/lora-phy.h"
 #include "ns3/random-variable-stream.h"
+#include "ns3/uinteger.h"
+#include "ns3/nstime.h"
+#include "ns3/boolean.h"
+#include "ns3/double.h"
+#include "ns3/string.h"
+#include "ns3/lora-tag.h"
+#include "ns3/lora-net-device.h"
+#include "ns3/end-device-lora-phy.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <sstream>
 
 namespace ns3{
 
@@ -15,6 +30,80 @@ NS_OBJECT_ENSURE_REGISTERED(MultiHopLoraApp);
 const Time MultiHopLoraApp::MIN_WAIT = MilliSeconds(61); //based on ToA for SF7, 11 bytes
 const Time MultiHopLoraApp::MAX_WAIT = MilliSeconds(183); //3 * ToA
 
+namespace {
+
+//gateway sensitivity in dBm for SF7..12 at 125 kHz, as in the lorawan module
+const double GATEWAY_SENSITIVITY[6] = {-130.0, -132.5, -135.0, -137.5, -140.0, -142.5};
+
+//comma-separated frequencies in MHz, empty on a malformed list
+std::vector<double>
+ParseChannelPlan(const std::string &plan)
+{
+    std::vector<double> channels;
+    std::istringstream in(plan);
+    std::string item;
+    while (std::getline(in, item, ','))
+    {
+        char *end = nullptr;
+        double mhz = std::strtod(item.c_str(), &end);
+        if (end == item.c_str() || mhz <= 0)
+        {
+            return std::vector<double>();
+        }
+        channels.push_back(mhz);
+    }
+    return channels;
+}
+
+//ETSI EN 300 220 sub-band of an EU868 frequency, channels in one sub-band share a duty-cycle budget
+uint32_t
+SubBand(double mhz)
+{
+    if (mhz >= 868.0 && mhz <= 868.6)
+    {
+        return 1;
+    }
+    if (mhz >= 868.7 && mhz <= 869.2)
+    {
+        return 2;
+    }
+    if (mhz >= 869.4 && mhz <= 869.65)
+    {
+        return 3;
+    }
+    if (mhz >= 869.7 && mhz <= 870.0)
+    {
+        return 4;
+    }
+    return 0; //865-868 MHz, and anything outside EU868
+}
+
+//ToA in nanoseconds for SF7..12 and 0..255 byte frames, filled on first use
+struct ToaTable
+{
+    int64_t ns[6][256];
+
+    ToaTable()
+    {
+        const double bandwidth = 125000.0;
+        const int codingRate = 1; //4/5
+        const double preamble = 8;
+        for (int sf = 7; sf <= 12; ++sf)
+        {
+            double tSym = std::pow(2.0, sf) / bandwidth;
+            int lowDataRate = (sf >= 11) ? 1 : 0; //mandated when the symbol time exceeds 16 ms
+            for (int bytes = 0; bytes < 256; ++bytes)
+            {
+                double numerator = 8.0 * bytes - 4.0 * sf + 28 + 16; //CRC on, explicit header
+                double payloadSymbols = 8 + std::max(std::ceil(numerator / (4.0 * (sf - 2 * lowDataRate))) * (codingRate + 4), 0.0);
+                ns[sf - 7][bytes] = int64_t(((preamble + 4.25) + payloadSymbols) * tSym * 1e9);
+            }
+        }
+    }
+};
+
+} //namespace
+
 TypeId
 MultiHopLoraApp::GetTypeId(void)
 {
@@ -22,12 +111,202 @@ MultiHopLoraApp::GetTypeId(void)
     .SetParent<Application>()
     .SetGroupName("lorawan")
     .AddConstructor<MultiHopLoraApp>()
+    .AddAttribute("CacheSize",
+                  "Number of LFIDs the duplicate cache can hold (rounded up to a power of two)",
+                  UintegerValue(256),
+                  MakeUintegerAccessor(&MultiHopLoraApp::m_cacheSize),
+                  MakeUintegerChecker<uint32_t>(1))
+    .AddAttribute("CacheTtl",
+                  "How long an LFID is remembered after it was first received, raised to the longest contention or gateway window",
+                  TimeValue(Seconds(60)),
+                  MakeTimeAccessor(&MultiHopLoraApp::m_cacheTtl),
+                  MakeTimeChecker())
+    .AddAttribute("StreamingSelection",
+                  "Keep only the running best candidate per LFID instead of buffering every duplicate",
+                  BooleanValue(true),
+                  MakeBooleanAccessor(&MultiHopLoraApp::m_streamingSelection),
+                  MakeBooleanChecker())
+    .AddAttribute("ForwardSuppression",
+                  "Cancel a pending forward after overhearing SuppressionThreshold copies of the LFID from nodes with a lower LGw",
+                  BooleanValue(false),
+                  MakeBooleanAccessor(&MultiHopLoraApp::m_forwardSuppression),
+                  MakeBooleanChecker())
+    .AddAttribute("SuppressionThreshold",
+                  "Copies with better progress that must be overheard during the window to cancel the forward",
+                  UintegerValue(1),
+                  MakeUintegerAccessor(&MultiHopLoraApp::m_suppressionThreshold),
+                  MakeUintegerChecker<uint32_t>(1))
+    .AddAttribute("HeaderVersion",
+                  "Wire format of frames this node originates: 1 = fixed 32-bit fields, 2 = compact",
+                  UintegerValue(1),
+                  MakeUintegerAccessor(&MultiHopLoraApp::m_headerVersion),
+                  MakeUintegerChecker<uint8_t>(1, 2))
+    .AddAttribute("PathHashOnly",
+                  "With HeaderVersion 2, carry a 16-bit path hash instead of the node list",
+                  BooleanValue(false),
+                  MakeBooleanAccessor(&MultiHopLoraApp::m_pathHashOnly),
+                  MakeBooleanChecker())
+    .AddAttribute("AdaptiveWindow",
+                  "Derive the contention window from the time on air of the received frame instead of the fixed MIN_WAIT/MAX_WAIT",
+                  BooleanValue(false),
+                  MakeBooleanAccessor(&MultiHopLoraApp::m_adaptiveWindow),
+                  MakeBooleanChecker())
+    .AddAttribute("WindowTick",
+                  "Round contention window ends up to a multiple of this, so windows closing in the same tick share one event (0 = exact)",
+                  TimeValue(Seconds(0)),
+                  MakeTimeAccessor(&MultiHopLoraApp::m_windowTick),
+                  MakeTimeChecker())
+    .AddAttribute("SpreadingFactor",
+                  "Spreading factor every repeater receives at, and sends beacons and frames for repeaters at",
+                  UintegerValue(7),
+                  MakeUintegerAccessor(&MultiHopLoraApp::m_sf),
+                  MakeUintegerChecker<uint8_t>(7, 12))
+    .AddAttribute("AdaptiveSf",
+                  "Send at the lowest spreading factor whose link budget to the strongest gateway heard keeps LinkMargin, gateways decode every SF",
+                  BooleanValue(false),
+                  MakeBooleanAccessor(&MultiHopLoraApp::m_adaptiveSf),
+                  MakeBooleanChecker())
+    .AddAttribute("LinkMargin",
+                  "Margin in dB above the sensitivity of the chosen spreading factor",
+                  DoubleValue(10.0),
+                  MakeDoubleAccessor(&MultiHopLoraApp::m_linkMargin),
+                  MakeDoubleChecker<double>(0.0))
+    .AddAttribute("LinkTimeout",
+                  "Gateways whose beacons were not heard for this long no longer count for AdaptiveSf",
+                  TimeValue(Seconds(1800)),
+                  MakeTimeAccessor(&MultiHopLoraApp::m_linkTimeout),
+                  MakeTimeChecker())
+    .AddAttribute("DensityAdaptive",
+                  "Widen the contention window with the number of copies per LFID heard recently",
+                  BooleanValue(false),
+                  MakeBooleanAccessor(&MultiHopLoraApp::m_densityAdaptive),
+                  MakeBooleanChecker())
+    .AddAttribute("MaxWindowFactor",
+                  "Upper bound of the window, in multiples of the time on air, when DensityAdaptive is set",
+                  DoubleValue(8.0),
+                  MakeDoubleAccessor(&MultiHopLoraApp::m_maxWindowFactor),
+                  MakeDoubleChecker<double>(3.0))
+    .AddAttribute("GatewayWindow",
+                  "How long a gateway collects copies of a new LFID before sending its uplink",
+                  TimeValue(MilliSeconds(200)),
+                  MakeTimeAccessor(&MultiHopLoraApp::m_gatewayWindow),
+                  MakeTimeChecker())
+    .AddAttribute("Aggregation",
+                  "Bundle forwarded frames whose windows close within MaxAggregationDelay into one frame",
+                  BooleanValue(false),
+                  MakeBooleanAccessor(&MultiHopLoraApp::m_aggregation),
+                  MakeBooleanChecker())
+    .AddAttribute("MaxAggregateSize",
+                  "Largest aggregate frame in bytes, including its own header",
+                  UintegerValue(222),
+                  MakeUintegerAccessor(&MultiHopLoraApp::m_maxAggregateSize),
+                  MakeUintegerChecker<uint32_t>(16, 255))
+    .AddAttribute("MaxAggregationDelay",
+                  "Longest time a forwarded frame waits for others to share its transmission",
+                  TimeValue(MilliSeconds(100)),
+                  MakeTimeAccessor(&MultiHopLoraApp::m_maxAggregationDelay),
+                  MakeTimeChecker())
+    .AddAttribute("ChannelPlan",
+                  "Comma-separated channel frequencies in MHz, with more than one each LGw ring gets its own receive channel",
+                  StringValue("868.1"),
+                  MakeStringAccessor(&MultiHopLoraApp::m_channelPlan),
+                  MakeStringChecker())
+    .AddAttribute("DutyCycle",
+                  "Share of time this node may spend on air in each sub-band (0.01 for the EU868 1% bands), 0 disables the limit",
+                  DoubleValue(0.01),
+                  MakeDoubleAccessor(&MultiHopLoraApp::m_dutyCycle),
+                  MakeDoubleChecker<double>(0.0, 1.0))
+    .AddAttribute("DutyCycleWindow",
+                  "Averaging window of the duty cycle, the node may burst DutyCycle * DutyCycleWindow of airtime",
+                  TimeValue(Seconds(60)),
+                  MakeTimeAccessor(&MultiHopLoraApp::m_dutyCycleWindow),
+                  MakeTimeChecker())
+    .AddAttribute("MaxQueueSize",
+                  "Frames the transmit queue holds before it drops the oldest one",
+                  UintegerValue(32),
+                  MakeUintegerAccessor(&MultiHopLoraApp::m_maxQueueSize),
+                  MakeUintegerChecker<uint32_t>(1))
+    .AddAttribute("MaxQueueDelay",
+                  "Frames waiting longer than this in the transmit queue are dropped, 0 keeps them",
+                  TimeValue(Seconds(30)),
+                  MakeTimeAccessor(&MultiHopLoraApp::m_maxQueueDelay),
+                  MakeTimeChecker())
+    .AddAttribute("GradientDiscovery",
+                  "Learn the LGw from beacons flooded by the gateways instead of the value given to Setup",
+                  BooleanValue(false),
+                  MakeBooleanAccessor(&MultiHopLoraApp::m_gradient),
+                  MakeBooleanChecker())
+    .AddAttribute("BeaconInterval",
+                  "Period of the gateway beacon floods, every flood refreshes the gradient",
+                  TimeValue(Seconds(600)),
+                  MakeTimeAccessor(&MultiHopLoraApp::m_beaconInterval),
+                  MakeTimeChecker())
+    .AddAttribute("MinBeaconInterval",
+                  "Shortest time between two beacons of the same node, changes in between share one beacon",
+                  TimeValue(Seconds(30)),
+                  MakeTimeAccessor(&MultiHopLoraApp::m_minBeaconInterval),
+                  MakeTimeChecker())
+    .AddAttribute("BeaconJitter",
+                  "Upper bound of the random delay before a beacon, spreads the relays of one flood",
+                  TimeValue(Seconds(2)),
+                  MakeTimeAccessor(&MultiHopLoraApp::m_beaconJitter),
+                  MakeTimeChecker())
+    .AddAttribute("BeaconSlot",
+                  "With more than one channel, every BeaconInterval starts with a slot this long in which beacons go on the first channel of the plan, repeaters listen there and hold their data",
+                  TimeValue(Seconds(20)),
+                  MakeTimeAccessor(&MultiHopLoraApp::m_beaconSlot),
+                  MakeTimeChecker())
+    .AddAttribute("NeighbourTimeout",
+                  "Neighbours whose beacons were not heard for this long no longer count for the gradient",
+                  TimeValue(Seconds(1800)),
+                  MakeTimeAccessor(&MultiHopLoraApp::m_neighbourTimeout),
+                  MakeTimeChecker())
+    .AddAttribute("GradientHysteresis",
+                  "A lower LGw is only adopted when it improves the current one by more than this many hops",
+                  UintegerValue(0),
+                  MakeUintegerAccessor(&MultiHopLoraApp::m_gradientHysteresis),
+                  MakeUintegerChecker<uint32_t>())
+    .AddTraceSource("Send",
+                    "A source originated a packet",
+                    MakeTraceSourceAccessor(&MultiHopLoraApp::m_sendTrace),
+                    "ns3::MultiHopLoraApp::PacketTracedCallback")
+    .AddTraceSource("Receive",
+                    "A frame was received, before duplicate and hop filtering",
+                    MakeTraceSourceAccessor(&MultiHopLoraApp::m_receiveTrace),
+                    "ns3::MultiHopLoraApp::PacketTracedCallback")
+    .AddTraceSource("Forward",
+                    "A repeater rebroadcast the selected copy of an LFID",
+                    MakeTraceSourceAccessor(&MultiHopLoraApp::m_forwardTrace),
+                    "ns3::MultiHopLoraApp::PacketTracedCallback")
+    .AddTraceSource("Deliver",
+                    "A gateway received an LFID for the first time",
+                    MakeTraceSourceAccessor(&MultiHopLoraApp::m_deliverTrace),
+                    "ns3::MultiHopLoraApp::PacketTracedCallback")
+    .AddTraceSource("ForwardFrame",
+                    "A repeater put a frame with one or more forwarded LFIDs on air",
+                    MakeTraceSourceAccessor(&MultiHopLoraApp::m_forwardFrameTrace),
+                    "ns3::MultiHopLoraApp::FrameTracedCallback")
+    .AddTraceSource("Suppress",
+                    "A repeater cancelled its forward of an LFID after overhearing it closer to a gateway, the packet is its best copy",
+                    MakeTraceSourceAccessor(&MultiHopLoraApp::m_suppressTrace),
+                    "ns3::MultiHopLoraApp::PacketTracedCallback")
+    .AddTraceSource("Beacon",
+                    "A gradient beacon went on air",
+                    MakeTraceSourceAccessor(&MultiHopLoraApp::m_beaconTrace),
+                    "ns3::MultiHopLoraApp::BeaconTracedCallback")
+    .AddTraceSource("LgwChange",
+                    "A node adopted a new LGw from the beacons it heard",
+                    MakeTraceSourceAccessor(&MultiHopLoraApp::m_lgwChangeTrace),
+                    "ns3::MultiHopLoraApp::LgwTracedCallback")
     ;
     return tid;
 }
 
-MultiHopLoraApp::MultiHopLoraApp(): m_nodeId(0),m_lgw(255),m_isGateway(false),m_isSource(false),m_packetInterval(Seconds(20.0)),m_packetSize(32),m_packetsSent(0),m_lfidCounter(0)
-{}
+MultiHopLoraApp::MultiHopLoraApp(): m_nodeId(0),m_lgw(255),m_isGateway(false),m_isSource(false),m_packetInterval(Seconds(20.0)),m_packetSize(32),m_packetsSent(0),m_packetsForwarded(0),m_packetsDelivered(0),m_sequence(0),m_headerVersion(1),m_pathHashOnly(false),m_cacheSize(256),m_cacheTtl(Seconds(60)),m_windowTick(Seconds(0)),m_nextTimer(0),m_windowsOpened(0),m_windowEvents(0),m_streamingSelection(true),m_forwardSuppression(false),m_suppressionThreshold(1),m_forwardsSuppressed(0),m_airtimeSaved(Seconds(0)),m_adaptiveWindow(false),m_sf(7),m_densityAdaptive(false),m_maxWindowFactor(8.0),m_dupDensity(0),m_txSf(7),m_adaptiveSf(false),m_linkMargin(10.0),m_linkTimeout(Seconds(1800)),m_aggregation(false),m_maxAggregateSize(222),m_maxAggregationDelay(MilliSeconds(100)),m_aggregateSize(0),m_aggregateLh(0),m_gatewayWindow(MilliSeconds(200)),m_backhaulDelay(MilliSeconds(10)),m_uplinksSent(0),m_channelPlan("868.1"),m_rxChannel(0),m_txChannel(0),m_txSubBand(0),m_dutyCycle(0.01),m_dutyCycleWindow(Seconds(60)),m_maxQueueSize(32),m_maxQueueDelay(Seconds(30)),
+    m_gradient(false),m_beaconInterval(Seconds(600)),m_minBeaconInterval(Seconds(30)),m_beaconJitter(Seconds(2)),m_beaconSlot(Seconds(20)),m_neighbourTimeout(Seconds(1800)),m_gradientHysteresis(0),m_beaconSeq(0),m_lastBeacon(Seconds(0)),m_beaconsSent(0),m_beaconAirtime(Seconds(0)),m_lgwChanges(0),m_lastLgwChange(Seconds(0))
+{
+    m_rng = CreateObject<UniformRandomVariable>();
+}
 
 MultiHopLoraApp::~MultiHopLoraApp()
 {
@@ -43,9 +322,371 @@ MultiHopLoraApp::Setup(uint32_t nodeId, uint8_t lgw, bool isGateway, bool isSour
     m_isSource = isSource;
     m_packetInterval = Seconds(packetInterval); // PERBAIKAN: Mengonversi double ke Time
     m_packetSize = packetSize;
-    m_lfidCounter = m_nodeId << 16; //ensure unique LFIDs per node
+    m_sequence = 0; //LFIDs are (nodeId, sequence) so they stay unique per node
+}
+
+void
+MultiHopLoraApp::SetTrafficModel(Ptr<MultiHopLoraTrafficModel> traffic)
+{
+    m_traffic = traffic;
+}
+
+Ptr<MultiHopLoraTrafficModel>
+MultiHopLoraApp::GetTrafficModel(void) const
+{
+    return m_traffic;
+}
+
+const MultiHopLoraCache&
+MultiHopLoraApp::GetPacketCache(void) const
+{
+    return m_packetCache;
+}
+
+int64_t
+MultiHopLoraApp::AssignStreams(int64_t stream)
+{
+    m_rng->SetStream(stream);
+    return 1;
+}
+
+Time
+MultiHopLoraApp::GetTimeOnAir(uint8_t sf, uint32_t bytes)
+{
+    static const ToaTable table;
+    NS_ASSERT_MSG(sf >= 7 && sf <= 12, "Unsupported spreading factor " << (int)sf);
+    return NanoSeconds(table.ns[sf - 7][std::min<uint32_t>(bytes, 255)]);
+}
+
+Time
+MultiHopLoraApp::GetWaitTime(uint32_t frameBytes, uint8_t sf)
+{
+    if (!m_adaptiveWindow)
+    {
+        //MIN_WAIT/MAX_WAIT are SF7 figures, stretched by the time on air ratio at higher SFs
+        Time wait = MIN_WAIT + MilliSeconds(m_rng->GetValue() * (MAX_WAIT.GetMilliSeconds() - MIN_WAIT.GetMilliSeconds()));
+        double scale = double(GetTimeOnAir(sf, 11).GetNanoSeconds()) / GetTimeOnAir(7, 11).GetNanoSeconds();
+        return NanoSeconds(int64_t(wait.GetNanoSeconds() * scale));
+    }
+
+    //wait at least one frame time, then spread over 2 more (or more when many neighbours relay the same LFID)
+    Time toa = GetTimeOnAir(sf, frameBytes);
+    double factor = 3.0;
+    if (m_densityAdaptive)
+    {
+        factor = std::min(m_maxWindowFactor, std::max(3.0, 1.0 + m_dupDensity));
+    }
+    return toa + NanoSeconds(int64_t(m_rng->GetValue() * (factor - 1.0) * toa.GetNanoSeconds()));
+}
+
+Time
+MultiHopLoraApp::GetLongestWait(void) const
+{
+    uint8_t sf = m_adaptiveSf ? 12 : m_sf;
+    if (!m_adaptiveWindow)
+    {
+        double scale = double(GetTimeOnAir(sf, 11).GetNanoSeconds()) / GetTimeOnAir(7, 11).GetNanoSeconds();
+        return NanoSeconds(int64_t(MAX_WAIT.GetNanoSeconds() * scale));
+    }
+    return NanoSeconds(int64_t(GetTimeOnAir(sf, 255).GetNanoSeconds() * (m_densityAdaptive ? m_maxWindowFactor : 3.0)));
+}
+
+void
+MultiHopLoraApp::ObserveLink(Ptr<Packet> beacon, uint32_t gateway)
+{
+    lorawan::LoraTag tag;
+    if (beacon->PeekPacketTag(tag))
+    {
+        auto it = m_links.find(gateway);
+        if (it == m_links.end())
+        {
+            m_links[gateway] = Link{tag.GetReceivePower(), Simulator::Now()};
+        }
+        else
+        {
+            it->second.rssiDbm = 0.75 * it->second.rssiDbm + 0.25 * tag.GetReceivePower();
+            it->second.lastHeard = Simulator::Now();
+        }
+    }
+    UpdateSpreadingFactor();
+}
+
+void
+MultiHopLoraApp::UpdateSpreadingFactor(void)
+{
+    //links are assumed symmetric: every node sends at the same power, so the path loss seen
+    //from a gateway is the one our frames suffer on the way to it
+    double best = -std::numeric_limits<double>::infinity();
+    for (auto it = m_links.begin(); it != m_links.end();)
+    {
+        if (Simulator::Now() - it->second.lastHeard > m_linkTimeout)
+        {
+            it = m_links.erase(it);
+            continue;
+        }
+        best = std::max(best, it->second.rssiDbm);
+        ++it;
+    }
+
+    //repeaters only decode SpreadingFactor, so without a gateway in range the node stays on it
+    uint8_t sf = m_sf;
+    if (!m_links.empty())
+    {
+        sf = 12;
+        for (uint8_t s = 7; s < 12; ++s)
+        {
+            if (best - GATEWAY_SENSITIVITY[s - 7] >= m_linkMargin)
+            {
+                sf = s;
+                break;
+            }
+        }
+    }
+    if (sf == m_txSf)
+    {
+        return;
+    }
+
+    NS_LOG_INFO("Node " << m_nodeId << " switches from SF" << (int)m_txSf << " to SF" << (int)sf << " (gateway RSSI " << best << " dBm)");
+    //entries of a pending aggregate were built for the old SF
+    FlushAggregate();
+    m_txSf = sf;
+    m_scheduler.SetSpreadingFactor(sf);
 }
 
+void
+MultiHopLoraApp::ReceiveBeacon(Ptr<Packet> packet)
+{
+    MultiHopLoraBeaconHeader beacon;
+    packet->PeekHeader(beacon);
+    NS_LOG_DEBUG("Node " << m_nodeId << " heard a beacon: " << beacon.GetSender() << " has LGw " << (int)beacon.GetLgw() << ", epoch " << beacon.GetSeq());
+    if (!m_gradient || m_isGateway)
+    {
+        return;
+    }
+
+    m_neighbours[beacon.GetSender()] = Neighbour{beacon.GetLgw(), Simulator::Now()};
+    if (m_adaptiveSf)
+    {
+        //only gateways have LGw 1, every flood also ages out the gateways no longer heard
+        if (beacon.GetLgw() == 1)
+        {
+            ObserveLink(packet, beacon.GetSender());
+        }
+        else
+        {
+            UpdateSpreadingFactor();
+        }
+    }
+    //sequence numbers wrap, an epoch is newer if it is ahead by less than half the space
+    bool newEpoch = m_beaconSeq == 0 || int16_t(beacon.GetSeq() - m_beaconSeq) > 0;
+    if (newEpoch)
+    {
+        m_beaconSeq = beacon.GetSeq();
+    }
+
+    //every node relays each flood once, and announces a new LGw as soon as the rate limit allows
+    bool changed = UpdateGradient();
+    if ((newEpoch || changed) && m_lgw != 255)
+    {
+        ScheduleBeacon();
+    }
+}
+
+bool
+MultiHopLoraApp::UpdateGradient(void)
+{
+    uint8_t lowest = 255;
+    for (auto it = m_neighbours.begin(); it != m_neighbours.end();)
+    {
+        if (Simulator::Now() - it->second.lastHeard > m_neighbourTimeout)
+        {
+            it = m_neighbours.erase(it);
+            continue;
+        }
+        lowest = std::min(lowest, it->second.lgw);
+        ++it;
+    }
+    //frames from further away would exceed MAX_HOPS anyway
+    uint8_t lgw = lowest >= MAX_HOPS ? 255 : lowest + 1;
+    if (lgw == m_lgw)
+    {
+        return false;
+    }
+    //a worse LGw is taken at once, the neighbours that gave the better one are gone
+    if (lgw < m_lgw && m_lgw != 255 && uint32_t(lgw) + m_gradientHysteresis >= m_lgw)
+    {
+        return false;
+    }
+    SetLgw(lgw);
+    return true;
+}
+
+void
+MultiHopLoraApp::SetLgw(uint8_t lgw)
+{
+    NS_LOG_INFO("Node " << m_nodeId << " changes LGw from " << (int)m_lgw << " to " << (int)lgw);
+    uint8_t old = m_lgw;
+    m_lgw = lgw;
+    m_lgwChanges++;
+    m_lastLgwChange = Simulator::Now();
+    UpdateChannels();
+    m_lgwChangeTrace(m_nodeId, old, lgw);
+    MultiHopLoraTrace::Record(MultiHopLoraTrace::LGW_CHANGE, m_nodeId, 0, old, lgw, m_beaconSeq);
+}
+
+void
+MultiHopLoraApp::ScheduleBeacon(void)
+{
+    if (m_beaconEvent.IsPending())
+    {
+        return; //the pending beacon will carry the latest LGw
+    }
+    Time delay = Seconds(m_rng->GetValue(0, m_beaconJitter.GetSeconds()));
+    if (!m_lastBeacon.IsZero())
+    {
+        Time earliest = m_lastBeacon + m_minBeaconInterval;
+        if (earliest > Simulator::Now())
+        {
+            delay += earliest - Simulator::Now();
+        }
+    }
+    m_beaconEvent = Simulator::Schedule(delay, &MultiHopLoraApp::SendBeacon, this);
+}
+
+void
+MultiHopLoraApp::SendBeacon(void)
+{
+    if (UsesBeaconSlots() && !GetTimeToBeaconSlot().IsZero())
+    {
+        //repeaters only listen on the beacon channel during a slot
+        m_beaconEvent = Simulator::Schedule(GetTimeToBeaconSlot() + Seconds(m_rng->GetValue(0, m_beaconJitter.GetSeconds())), &MultiHopLoraApp::SendBeacon, this);
+        return;
+    }
+    if (m_isGateway)
+    {
+        //gateways start a new epoch every BeaconInterval, 0 is left for "no epoch yet"
+        m_beaconSeq = m_beaconSeq == 0xffff ? 1 : m_beaconSeq + 1;
+        m_beaconEvent = Simulator::Schedule(m_beaconInterval, &MultiHopLoraApp::SendBeacon, this);
+    }
+    if (m_lgw == 255)
+    {
+        return;
+    }
+
+    MultiHopLoraBeaconHeader beacon;
+    beacon.SetSender(m_nodeId);
+    beacon.SetLgw(m_lgw);
+    beacon.SetSeq(m_beaconSeq);
+    beacon.SetSf(m_sf);
+    Ptr<Packet> packet = Create<Packet>();
+    packet->AddHeader(beacon);
+
+    m_lastBeacon = Simulator::Now();
+    //ahead of any data, a stale gradient costs more than a delayed forward. beacons are for
+    //every neighbour, so they go at the SF repeaters receive at
+    m_scheduler.SetSpreadingFactor(m_sf);
+    m_scheduler.Enqueue(packet, 255, 0, 0); //the first channel is in the first sub-band
+    m_scheduler.SetSpreadingFactor(m_txSf);
+}
+
+void
+MultiHopLoraApp::UpdateChannels(void)
+{
+    //rings alternate over the plan, so neighbouring rings forward on different channels at the same time
+    uint32_t nChannels = m_channels.size();
+    m_rxChannel = m_lgw % nChannels;
+    m_txChannel = (m_lgw + nChannels - 1) % nChannels;
+    m_txSubBand = std::find(m_subBands.begin(), m_subBands.end(), SubBand(m_channels[m_txChannel])) - m_subBands.begin();
+    if (UsesBeaconSlots() && m_lgw == 255)
+    {
+        m_rxChannel = 0; //a node without a ring waits for beacons
+    }
+
+    Ptr<lorawan::EndDeviceLoraPhy> phy = GetEndDevicePhy();
+    if (phy)
+    {
+        bool inSlot = UsesBeaconSlots() && GetTimeToBeaconSlot().IsZero();
+        phy->SetFrequency(m_channels[inSlot ? 0 : m_rxChannel]);
+    }
+}
+
+bool
+MultiHopLoraApp::UsesBeaconSlots(void) const
+{
+    return m_gradient && m_channels.size() > 1;
+}
+
+Time
+MultiHopLoraApp::GetTimeToBeaconSlot(void) const
+{
+    //slots start at every multiple of BeaconInterval, so all nodes agree on them
+    int64_t phase = Simulator::Now().GetTimeStep() % m_beaconInterval.GetTimeStep();
+    return phase < m_beaconSlot.GetTimeStep() ? Seconds(0) : TimeStep(m_beaconInterval.GetTimeStep() - phase);
+}
+
+void
+MultiHopLoraApp::OpenBeaconSlot(void)
+{
+    //a frame already on air is lost to neighbours that retune under it
+    m_scheduler.SetMinPriority(255);
+    UpdateChannels();
+    int64_t phase = Simulator::Now().GetTimeStep() % m_beaconInterval.GetTimeStep();
+    m_beaconSlotEvent = Simulator::Schedule(TimeStep(m_beaconSlot.GetTimeStep() - phase), &MultiHopLoraApp::CloseBeaconSlot, this);
+}
+
+void
+MultiHopLoraApp::CloseBeaconSlot(void)
+{
+    UpdateChannels();
+    m_scheduler.SetMinPriority(0);
+    m_beaconSlotEvent = Simulator::Schedule(GetTimeToBeaconSlot(), &MultiHopLoraApp::OpenBeaconSlot, this);
+}
+
+Ptr<lorawan::EndDeviceLoraPhy>
+MultiHopLoraApp::GetEndDevicePhy(void) const
+{
+    //gateways listen on every channel and SF, like an 8-channel concentrator
+    if (m_isGateway)
+    {
+        return nullptr;
+    }
+    Ptr<lorawan::LoraNetDevice> device = DynamicCast<lorawan::LoraNetDevice>(GetNode()->GetDevice(0));
+    return device ? DynamicCast<lorawan::EndDeviceLoraPhy>(device->GetPhy()) : nullptr;
+}
+
+void
+MultiHopLoraApp::SetNetworkServer(Ptr<MultiHopLoraNetworkServer> server, Time backhaulDelay)
+{
+    m_server = server;
+    m_backhaulDelay = backhaulDelay;
+}
+
+void
+MultiHopLoraApp::SetPacketForwarder(Ptr<MultiHopLoraPacketForwarder> forwarder)
+{
+    m_forwarder = forwarder;
+}
+
+bool MultiHopLoraApp::IsGateway (void) const { return m_isGateway; }
+uint32_t MultiHopLoraApp::GetPacketsSent (void) const { return m_packetsSent; }
+uint32_t MultiHopLoraApp::GetPacketsForwarded (void) const { return m_packetsForwarded; }
+uint32_t MultiHopLoraApp::GetPacketsDelivered (void) const { return m_packetsDelivered; }
+uint32_t MultiHopLoraApp::GetUplinksSent (void) const { return m_uplinksSent; }
+uint64_t MultiHopLoraApp::GetWindowsOpened (void) const { return m_windowsOpened; }
+uint64_t MultiHopLoraApp::GetWindowEvents (void) const { return m_windowEvents; }
+uint32_t MultiHopLoraApp::GetForwardsSuppressed (void) const { return m_forwardsSuppressed; }
+Time MultiHopLoraApp::GetAirtimeSaved (void) const { return m_airtimeSaved; }
+uint8_t MultiHopLoraApp::GetTxSpreadingFactor (void) const { return m_txSf; }
+double MultiHopLoraApp::GetRxFrequency (void) const { return m_channels.empty() ? 0.0 : m_channels[m_rxChannel]; }
+double MultiHopLoraApp::GetTxFrequency (void) const { return m_channels.empty() ? 0.0 : m_channels[m_txChannel]; }
+uint8_t MultiHopLoraApp::GetLgw (void) const { return m_lgw; }
+uint32_t MultiHopLoraApp::GetBeaconsSent (void) const { return m_beaconsSent; }
+Time MultiHopLoraApp::GetBeaconAirtime (void) const { return m_beaconAirtime; }
+uint32_t MultiHopLoraApp::GetLgwChanges (void) const { return m_lgwChanges; }
+Time MultiHopLoraApp::GetLastLgwChange (void) const { return m_lastLgwChange; }
+const MultiHopLoraTxScheduler& MultiHopLoraApp::GetTxScheduler (void) const { return m_scheduler; }
+
 void
 MultiHopLoraApp::StartApplication(void)
 {
@@ -66,7 +707,84 @@ MultiHopLoraApp::StartApplication(void)
         m_socket->SetRecvCallback(MakeCallback(&MultiHopLoraApp::ReceivePacket, this));
     }
 
-    if (m_isSource)
+    //the retention TTL must cover the whole waiting window or duplicates would look new
+    Time minTtl = std::max(GetLongestWait(), m_isGateway ? m_gatewayWindow : Seconds(0));
+    if (m_cacheTtl < minTtl)
+    {
+        NS_LOG_WARN("Node " << m_nodeId << ": CacheTtl " << m_cacheTtl.GetSeconds() << "s is shorter than the longest window, using " << minTtl.GetSeconds() << "s");
+        m_cacheTtl = minTtl;
+    }
+    m_packetCache.Resize(m_cacheSize); //the cache stays empty until the attributes are known
+    m_packetCache.SetTtl(m_cacheTtl);
+    if (m_adaptiveSf && !m_gradient && !m_isGateway)
+    {
+        NS_LOG_WARN("Node " << m_nodeId << ": AdaptiveSf learns the gateway links from beacons and needs GradientDiscovery, staying on SF" << (int)m_sf);
+    }
+
+    //gateways are the root of the gradient, other nodes keep the LGw given to Setup until a beacon says otherwise
+    if (m_gradient && m_isGateway)
+    {
+        m_lgw = 1;
+    }
+    //the LFID of a v1 frame starts with the source ID, a set top bit would read back as a v2 frame
+    NS_ABORT_MSG_IF(m_isSource && m_headerVersion < 2 && m_nodeId >= 0x8000, "Source " << m_nodeId << " needs HeaderVersion 2, v1 frames only carry node IDs below 0x8000");
+    m_channels = ParseChannelPlan(m_channelPlan);
+    NS_ABORT_MSG_IF(m_channels.empty(), "Invalid ChannelPlan '" << m_channelPlan << "'");
+    NS_ABORT_MSG_IF(UsesBeaconSlots() && (m_beaconSlot <= m_beaconJitter || m_beaconSlot >= m_beaconInterval), "BeaconSlot must be longer than BeaconJitter and shorter than BeaconInterval");
+    m_subBands.clear();
+    for (double mhz : m_channels)
+    {
+        if (std::find(m_subBands.begin(), m_subBands.end(), SubBand(mhz)) == m_subBands.end())
+        {
+            m_subBands.push_back(SubBand(mhz));
+        }
+    }
+    UpdateChannels();
+    Ptr<lorawan::LoraNetDevice> device = DynamicCast<lorawan::LoraNetDevice>(GetNode()->GetDevice(0));
+    Ptr<lorawan::GatewayLoraPhy> gatewayPhy = device ? DynamicCast<lorawan::GatewayLoraPhy>(device->GetPhy()) : nullptr;
+    if (gatewayPhy)
+    {
+        for (double mhz : m_channels)
+        {
+            gatewayPhy->AddFrequency(mhz);
+        }
+    }
+
+    m_scheduler.SetSubBands(std::vector<double>(m_subBands.size(), m_dutyCycle), m_dutyCycleWindow);
+    m_scheduler.SetLimits(m_maxQueueSize, m_maxQueueDelay);
+    m_txSf = m_sf;
+    m_links.clear();
+    m_scheduler.SetSpreadingFactor(m_txSf);
+    //an end-device PHY decodes a single SF, every repeater listens on the same one
+    Ptr<lorawan::EndDeviceLoraPhy> phy = GetEndDevicePhy();
+    if (phy)
+    {
+        phy->SetSpreadingFactor(m_sf);
+    }
+    m_scheduler.SetSendCallback(MakeCallback(&MultiHopLoraApp::SendFrame, this));
+    m_scheduler.SetDropCallback(MakeCallback(&MultiHopLoraApp::DropFrame, this));
+
+    m_neighbours.clear();
+    m_beaconSeq = 0;
+    m_lastBeacon = Seconds(0);
+    m_scheduler.SetMinPriority(0);
+    //a gateway PHY hears the beacon channel anyway and has no data to hold
+    if (UsesBeaconSlots() && !m_isGateway)
+    {
+        m_beaconSlotEvent = Simulator::Schedule(GetTimeToBeaconSlot(), &MultiHopLoraApp::OpenBeaconSlot, this);
+    }
+    if (m_gradient && m_isGateway)
+    {
+        m_beaconEvent = Simulator::Schedule(Seconds(m_rng->GetValue(0, m_beaconJitter.GetSeconds())), &MultiHopLoraApp::SendBeacon, this);
+    }
+
+    if (m_isSource && m_traffic)
+    {
+        m_traffic->SetNodeId(m_nodeId);
+        m_traffic->SetSendCallback(MakeCallback(&MultiHopLoraApp::SendPayload, this));
+        m_traffic->Start();
+    }
+    else if (m_isSource)
     {
         ScheduleTx();
     }
@@ -77,12 +795,22 @@ MultiHopLoraApp::StopApplication(void)
 {
     // ... (kode tidak berubah)
     Simulator::Cancel(m_sendEvent);
+    if (m_traffic)
+    {
+        m_traffic->Stop();
+    }
+    Simulator::Cancel(m_beaconEvent);
+    Simulator::Cancel(m_beaconSlotEvent);
+    FlushAggregate();
+    m_scheduler.Clear();
     if (m_socket)
     {
         m_socket->Close();
         m_socket->SetRecvCallback(MakeNullCallback<void, Ptr<Socket>>);
         m_socket = 0;
     }
+
+    NS_LOG_INFO("Node " << m_nodeId << " LFID cache: hits=" << m_packetCache.GetHits() << ", evictions=" << m_packetCache.GetEvictions() << ", falseReforwards=" << m_packetCache.GetFalseReforwards());
 }
 
 void
@@ -94,99 +822,424 @@ MultiHopLoraApp::ScheduleTx(void)
 void
 MultiHopLoraApp::SendPacket(void)
 {
-    // ... (kode tidak berubah)
-    NS_LOG_FUNCTION(this);
+    SendPayload(m_packetSize);
+    ScheduleTx();
+}
+
+void
+MultiHopLoraApp::SendPayload(uint32_t size)
+{
+    MULTI_HOP_LORA_PROFILE(SEND_PACKET);
+    NS_LOG_FUNCTION(this << size);
     MultiHopLoraHeader header;
-    header.SetLfid(m_lfidCounter++);
+    header.SetLfid(MultiHopLoraHeader::MakeLfid(m_nodeId, m_sequence++));
     header.SetLnid(m_nodeId);
-    header.SetLpty(1); //type 1 for data
+    //the wire format is negotiated through LPTY, repeaters re-serialize in the format they received
+    uint8_t lpty = MultiHopLoraHeader::LPTY_DATA; //type 1 for data
+    if (m_headerVersion >= 2)
+    {
+        lpty |= MultiHopLoraHeader::LPTY_COMPACT;
+        if (m_pathHashOnly)
+        {
+            lpty |= MultiHopLoraHeader::LPTY_PATH_HASH;
+        }
+    }
+    header.SetLpty(lpty);
+    header.SetSf(m_txSf);
     header.SetLh(1); //first hop
     header.SetLgw(m_lgw);
     header.AddNodeToPath(m_nodeId);
 
-    Ptr<Packet> packet = Create<Packet> (m_packetSize);
+    Ptr<Packet> packet = Create<Packet> (size);
     packet->AddHeader(header);
 
-    m_socket->SendTo(packet, 0, m_broadcastAddress);
+    //own traffic has hop count 1 and so queues behind every relayed frame
+    m_scheduler.Enqueue(packet, header.GetLh(), 0, m_txSubBand);
     m_packetsSent++;
+    m_sendTrace(packet, m_nodeId, header.GetLfid(), header.GetLh());
 
-    NS_LOG_INFO("Node " << m_nodeId << "(Source) sent packet with LFID " << header.GetLfid() << " at " << Simulator::Now().GetSeconds() << "s");
-
-    ScheduleTx();
+    MultiHopLoraTrace::Record(MultiHopLoraTrace::TX, m_nodeId, header.GetLfid(), header.GetLh(), header.GetLgw(), packet->GetSize());
 }
 
 void
 MultiHopLoraApp::ReceivePacket(Ptr<Socket> socket)
 {
-    // ... (kode tidak berubah)
+    MULTI_HOP_LORA_PROFILE(RECEIVE_PACKET);
     NS_LOG_FUNCTION(this);
     Ptr<Packet> packet;
     Address from;
     while ((packet = socket->RecvFrom(from)))
     {
-        MultiHopLoraHeader header;
-        packet->PeekHeader(header);
+        //beacons are sent on the first channel, which the PHY only listens on during a beacon
+        //slot or before the node has an LGw, so they are not held to the ring's channel
+        if (MultiHopLoraBeaconHeader::IsBeacon(packet))
+        {
+            ReceiveBeacon(packet);
+            continue;
+        }
+
+        //a receiver tuned to another channel would not have heard the frame
+        MultiHopLoraTxTag tx;
+        if (!m_isGateway && packet->PeekPacketTag(tx) && tx.GetFrequency() != m_channels[m_rxChannel])
+        {
+            continue;
+        }
 
-        if (m_isGateway)
+        if (!MultiHopLoraAggregateHeader::IsAggregate(packet))
         {
-            NS_LOG_INFO("Gateway " << m_nodeId << " received final packet with LFID " << header.GetLfid() << " from path:");
-            header.Print(std::cout);
-            std::cout << std::endl;
-            continue; //gateway is a sink, does not forward
+            HandleFrame(packet);
+            continue;
         }
 
-        //check cache (pseudo step 1)
-        if (m_packetCache.find(header.GetLfid()) != m_packetCache.end())
+        //every entry of an aggregate is handled as if it had been received on its own
+        MultiHopLoraAggregateHeader aggregate;
+        packet->RemoveHeader(aggregate);
+        uint32_t offset = 0;
+        for (uint8_t i = 0; i < aggregate.GetNEntries(); ++i)
         {
-            //LFID is in cache. if it's a new arrival within the waiting window, buffer it.
-            //otherwise, it's an old packet,, sso ignore
-            if (Simulator::Now() <= m_packetCache[header.GetLfid()])
+            uint32_t size = aggregate.GetEntrySize(i);
+            if (offset + size > packet->GetSize())
             {
-                m_dupllicateBuffer[header.GetLfid()].push_back(packet->Copy());
+                NS_LOG_WARN("Node " << m_nodeId << " received a truncated aggregate frame");
+                break;
             }
-            continue;
+            HandleFrame(packet->CreateFragment(offset, size));
+            offset += size;
         }
-        
-        //check max hops (pseudocode step 1)
-        if (header.GetLh() >= MAX_HOPS)
+    }
+}
+
+void
+MultiHopLoraApp::HandleFrame(Ptr<Packet> packet)
+{
+    //repeaters only need LFID/LH/LGw, the path is parsed again only for the packet that gets forwarded
+    MultiHopLoraPrefixHeader header;
+    packet->PeekHeader(header);
+    MultiHopLoraTrace::Record(MultiHopLoraTrace::RX, m_nodeId, header.GetLfid(), header.GetLh(), header.GetLgw(), packet->GetSize());
+    m_receiveTrace(packet, m_nodeId, header.GetLfid(), header.GetLh());
+
+    if (m_isGateway)
+    {
+        ReceiveAtGateway(packet, header);
+        return; //gateway is a sink, does not forward
+    }
+    //check cache (pseudo step 1)
+    Time windowEnd;
+    if (m_packetCache.Lookup(header.GetLfid(), Simulator::Now(), windowEnd))
+    {
+        //LFID is in cache. if it's a new arrival within the waiting window, buffer it.
+        //otherwise, it's an old packet,, sso ignore
+        if (Simulator::Now() <= windowEnd)
         {
-            NS_LOG_INFO("Node " << m_nodeId << " dropped packet with LFID " << header.GetLfid() << " due to max hops.");
-            continue;
+            if (m_forwardSuppression && header.GetLgw() < m_lgw && Overhear(packet, header))
+            {
+                return;
+            }
+            BufferCandidate(packet, header);
         }
-        
-        Ptr<UniformRandomVariable> rand = CreateObject<UniformRandomVariable>();
-        Time waitTime = MIN_WAIT + MilliSeconds(rand->GetValue() * (MAX_WAIT.GetMilliSeconds() - MIN_WAIT.GetMilliSeconds()));
-        Time expiryTime = Simulator::Now() + waitTime;
-        
-        m_packetCache[header.GetLfid()] = expiryTime;
-        m_dupllicateBuffer[header.GetLfid()].push_back(packet->Copy());
+        return;
+    }
+
+    //check max hops (pseudocode step 1)
+    if (header.GetLh() >= MAX_HOPS)
+    {
+        MultiHopLoraTrace::Record(MultiHopLoraTrace::DROP_MAX_HOP, m_nodeId, header.GetLfid(), header.GetLh(), header.GetLgw(), packet->GetSize());
+        return;
+    }
+
+    Time waitTime = GetWaitTime(packet->GetSize(), header.GetSf());
+    Time expiryTime = Simulator::Now() + waitTime;
+
+    m_packetCache.Insert(header.GetLfid(), expiryTime, Simulator::Now());
+    Candidate &candidate = m_candidates[header.GetLfid()];
+    candidate = Candidate{nullptr, 0, 0, 0, 0, 0, 0};
+    BufferCandidate(packet, header);
 
-        Simulator::Schedule(waitTime, &MultiHopLoraApp::ProcessDuplicates, this, header.GetLfid());
-        NS_LOG_INFO("Node " << m_nodeId << " received new packet LFID " << header.GetLfid() << ". Waiting for " << waitTime.GetSeconds() << "s to process duplicates.");   
-    }    
+    StartWindow(header.GetLfid(), waitTime);
+    NS_LOG_LOGIC("Node " << m_nodeId << " received new packet LFID " << header.GetLfid() << ". Waiting for " << waitTime.GetSeconds() << "s to process duplicates.");
 }
 
 void
-MultiHopLoraApp::ProcessDuplicates(uint32_t lfid) // PERBAIKAN: Menambahkan parameter lfid
+MultiHopLoraApp::ReceiveAtGateway(Ptr<Packet> packet, const MultiHopLoraPrefixHeader &header)
 {
-    NS_LOG_FUNCTION(this << lfid);
+    //receive power is only known if the PHY tagged the frame
+    double rssi = std::numeric_limits<double>::quiet_NaN();
+    lorawan::LoraTag tag;
+    if (packet->PeekPacketTag(tag))
+    {
+        rssi = tag.GetReceivePower();
+    }
 
-    auto it = m_dupllicateBuffer.find(lfid);
-    if (it == m_dupllicateBuffer.end() || it->second.empty())
+    auto pending = m_uplinks.find(header.GetLfid());
+    if (pending != m_uplinks.end())
     {
-        return; //no packets to process
+        //copy within the window, keep the strongest one, then the one with the fewest hops
+        Uplink &uplink = pending->second;
+        uplink.copies++;
+        if (rssi > uplink.rssiDbm || (!(rssi < uplink.rssiDbm) && header.GetLh() < uplink.lh))
+        {
+            uplink.packet = packet;
+            uplink.rssiDbm = rssi;
+            uplink.lh = header.GetLh();
+        }
+        MultiHopLoraTrace::Record(MultiHopLoraTrace::GATEWAY_DELIVER, m_nodeId, header.GetLfid(), header.GetLh(), header.GetLgw(), 0);
+        return;
+    }
+
+    //the LFID cache keeps late copies from opening a second uplink
+    Time windowEnd;
+    if (m_packetCache.Lookup(header.GetLfid(), Simulator::Now(), windowEnd))
+    {
+        MultiHopLoraTrace::Record(MultiHopLoraTrace::GATEWAY_DELIVER, m_nodeId, header.GetLfid(), header.GetLh(), header.GetLgw(), 0);
+        return;
+    }
+    m_packetCache.Insert(header.GetLfid(), Simulator::Now() + m_gatewayWindow, Simulator::Now());
+    m_packetsDelivered++;
+    m_deliverTrace(packet, m_nodeId, header.GetLfid(), header.GetLh());
+    MultiHopLoraTrace::Record(MultiHopLoraTrace::GATEWAY_DELIVER, m_nodeId, header.GetLfid(), header.GetLh(), header.GetLgw(), 1);
+    NS_LOG_LOGIC("Gateway " << m_nodeId << " received LFID " << header.GetLfid() << " after " << (int)header.GetLh() << " hops");
+
+    m_uplinks[header.GetLfid()] = Uplink{packet, rssi, header.GetLh(), 1, Simulator::Now()};
+    Simulator::Schedule(m_gatewayWindow, &MultiHopLoraApp::SendUplink, this, header.GetLfid());
+}
+
+void
+MultiHopLoraApp::SendUplink(uint32_t lfid)
+{
+    auto it = m_uplinks.find(lfid);
+    if (it == m_uplinks.end())
+    {
+        return;
+    }
+    MultiHopLoraUplink uplink;
+    uplink.gateway = m_nodeId;
+    it->second.packet->PeekHeader(uplink.header); //the full path is parsed once, for the copy that is reported
+    uplink.rssiDbm = it->second.rssiDbm;
+    uplink.copies = it->second.copies;
+    uplink.firstRx = it->second.firstRx;
+    if (m_forwarder)
+    {
+        MultiHopLoraTxTag tx;
+        it->second.packet->PeekPacketTag(tx);
+        uint32_t chan = std::find(m_channels.begin(), m_channels.end(), tx.GetFrequency()) - m_channels.begin();
+        m_forwarder->PushData(m_nodeId, it->second.packet, uplink.rssiDbm, uplink.firstRx, chan < m_channels.size() ? chan : 0);
+    }
+    m_uplinks.erase(it);
+
+    if (!m_server)
+    {
+        return;
+    }
+    Simulator::ScheduleWithContext(m_server->GetNode()->GetId(), m_backhaulDelay, &MultiHopLoraNetworkServer::ReceiveUplink, m_server, uplink);
+    m_uplinksSent++;
+}
+
+void
+MultiHopLoraApp::Transmit(Ptr<Packet> packet, uint8_t lh)
+{
+    if (!m_socket)
+    {
+        return; //window closed after the application stopped
+    }
+    if (!m_aggregation || packet->GetSize() > MultiHopLoraAggregateHeader::MAX_ENTRY_SIZE || 2 + 1 + packet->GetSize() > m_maxAggregateSize)
+    {
+        m_scheduler.Enqueue(packet, lh, 1, m_txSubBand);
+        CountForward(packet);
+        return;
+    }
+
+    //one length byte per entry on top of the frame itself
+    if (!m_aggregate.empty() && (m_aggregateSize + 1 + packet->GetSize() > m_maxAggregateSize || m_aggregate.size() == MultiHopLoraAggregateHeader::MAX_ENTRIES))
+    {
+        FlushAggregate();
+    }
+    if (m_aggregate.empty())
+    {
+        m_aggregateSize = 2;
+        m_aggregateLh = 0;
+        m_aggregateEvent = Simulator::Schedule(m_maxAggregationDelay, &MultiHopLoraApp::FlushAggregate, this);
+    }
+    m_aggregate.push_back(packet);
+    m_aggregateSize += 1 + packet->GetSize();
+    m_aggregateLh = std::max(m_aggregateLh, lh);
+}
+
+void
+MultiHopLoraApp::FlushAggregate(void)
+{
+    Simulator::Cancel(m_aggregateEvent);
+    if (m_aggregate.empty() || !m_socket)
+    {
+        m_aggregate.clear();
+        return;
+    }
+
+    //a lone frame goes out as is, without the aggregate overhead
+    Ptr<Packet> frame = m_aggregate.front();
+    if (m_aggregate.size() > 1)
+    {
+        frame = Create<Packet>();
+        MultiHopLoraAggregateHeader aggregate;
+        for (const Ptr<Packet> &entry : m_aggregate)
+        {
+            aggregate.AddEntry(entry->GetSize());
+            frame->AddAtEnd(entry);
+        }
+        frame->AddHeader(aggregate);
+        MultiHopLoraTrace::Record(MultiHopLoraTrace::AGGREGATE, m_nodeId, 0, uint8_t(m_aggregate.size()), m_lgw, frame->GetSize());
+    }
+    m_scheduler.Enqueue(frame, m_aggregateLh, m_aggregate.size(), m_txSubBand);
+    for (const Ptr<Packet> &entry : m_aggregate)
+    {
+        CountForward(entry);
+    }
+    m_aggregate.clear();
+}
+
+void
+MultiHopLoraApp::CountForward(Ptr<const Packet> packet)
+{
+    MultiHopLoraPrefixHeader header;
+    packet->PeekHeader(header);
+    m_packetsForwarded++;
+    m_forwardTrace(packet, m_nodeId, header.GetLfid(), header.GetLh());
+    MultiHopLoraTrace::Record(MultiHopLoraTrace::FORWARD, m_nodeId, header.GetLfid(), header.GetLh(), header.GetLgw(), packet->GetSize());
+}
+
+void
+MultiHopLoraApp::SendFrame(Ptr<Packet> frame, uint32_t entries, uint8_t sf)
+{
+    if (!m_socket)
+    {
+        return;
+    }
+    MultiHopLoraTxTag tx;
+    frame->RemovePacketTag(tx); //forwarded copies still carry the previous hop's
+    //beacons go on the first channel, where every repeater listens during a beacon slot
+    bool beacon = MultiHopLoraBeaconHeader::IsBeacon(frame);
+    frame->AddPacketTag(MultiHopLoraTxTag(m_channels[beacon ? 0 : m_txChannel], sf));
+    m_socket->SendTo(frame, 0, m_broadcastAddress);
+    if (entries > 0)
+    {
+        m_forwardFrameTrace(frame, m_nodeId, entries, sf);
+    }
+    else if (beacon)
+    {
+        MultiHopLoraBeaconHeader header;
+        frame->PeekHeader(header);
+        m_beaconsSent++;
+        m_beaconAirtime += GetTimeOnAir(sf, frame->GetSize());
+        m_beaconTrace(frame, m_nodeId, header.GetLgw(), sf);
+        MultiHopLoraTrace::Record(MultiHopLoraTrace::BEACON, m_nodeId, header.GetSeq(), 0, header.GetLgw(), frame->GetSize());
+    }
+}
+
+void
+MultiHopLoraApp::DropFrame(Ptr<const Packet> frame, uint32_t entries, Time waited)
+{
+    NS_LOG_INFO("Node " << m_nodeId << " dropped a queued frame after " << waited.GetSeconds() << "s");
+    if (entries > 1 || MultiHopLoraBeaconHeader::IsBeacon(frame))
+    {
+        MultiHopLoraTrace::Record(MultiHopLoraTrace::DROP_QUEUE, m_nodeId, 0, uint8_t(entries), m_lgw, uint32_t(waited.GetMilliSeconds()));
+        return;
+    }
+    MultiHopLoraPrefixHeader header;
+    frame->PeekHeader(header);
+    MultiHopLoraTrace::Record(MultiHopLoraTrace::DROP_QUEUE, m_nodeId, header.GetLfid(), header.GetLh(), header.GetLgw(), uint32_t(waited.GetMilliSeconds()));
+}
+
+void
+MultiHopLoraApp::BufferCandidate(Ptr<Packet> packet, const MultiHopLoraPrefixHeader &header)
+{
+    //the received packet is owned by us and never modified, so the candidate keeps it without a copy
+    auto it = m_candidates.find(header.GetLfid());
+    if (it != m_candidates.end())
+    {
+        it->second.copies++;
+        UpdateCandidate(it->second, packet, header);
+        MultiHopLoraTrace::Record(MultiHopLoraTrace::DUP_BUFFERED, m_nodeId, header.GetLfid(), header.GetLh(), header.GetLgw(), it->second.copies);
+
+        if (!m_streamingSelection)
+        {
+            m_dupllicateBuffer[header.GetLfid()].push_back(packet->Copy());
+        }
     }
+}
+
+bool
+MultiHopLoraApp::Overhear(Ptr<Packet> packet, const MultiHopLoraPrefixHeader &header)
+{
+    auto it = m_candidates.find(header.GetLfid());
+    if (it == m_candidates.end() || ++it->second.overheard < m_suppressionThreshold)
+    {
+        return false;
+    }
+
+    //a node closer to a gateway already relayed this LFID, our copy would only add airtime
+    //erasing the candidate is enough, its expiry is skipped when it comes up
+    Ptr<Packet> forward = it->second.packet ? it->second.packet : packet;
+    m_airtimeSaved += GetTimeOnAir(m_txSf, forward->GetSize());
+    m_forwardsSuppressed++;
+    m_dupDensity = 0.875 * m_dupDensity + 0.125 * (it->second.copies + 1);
+    m_suppressTrace(forward, m_nodeId, header.GetLfid(), header.GetLh());
+    MultiHopLoraTrace::Record(MultiHopLoraTrace::SUPPRESSED, m_nodeId, header.GetLfid(), header.GetLh(), header.GetLgw(), it->second.overheard);
+    m_candidates.erase(it);
+    m_dupllicateBuffer.erase(header.GetLfid());
+    return true;
+}
 
-    std::vector<Ptr<Packet>> candidates = it->second;
-    m_dupllicateBuffer.erase(it);
+void
+MultiHopLoraApp::UpdateCandidate(Candidate &best, Ptr<Packet> packet, const MultiHopLoraPrefixHeader &header) const
+{
+    //F1 membership (pseudocode step 3)
+    if (header.GetLgw() + RETREAT_FACTOR <= m_lgw)
+    {
+        return;
+    }
 
+    //F2 is the set of F1 packets with the fewest hops (pseudocode step 4)
+    if (!best.packet || header.GetLh() < best.lh)
+    {
+        best.packet = packet;
+        best.lh = header.GetLh();
+        best.lgw = header.GetLgw();
+        best.ties = 1;
+        return;
+    }
+
+    if (header.GetLh() == best.lh)
+    {
+        best.ties++;
+        //strictly greater keeps the earliest arrival among equal LGw, like the buffered scan
+        if (header.GetLgw() > best.lgw)
+        {
+            best.packet = packet;
+            best.lgw = header.GetLgw();
+        }
+    }
+}
+
+Ptr<Packet>
+MultiHopLoraApp::SelectCandidate(const Candidate &best) const
+{
+    //the buffered scan starts from maxLgw = 0, so a tie where every LGw is 0 selects nothing
+    if (best.ties > 1 && best.lgw == 0)
+    {
+        return nullptr;
+    }
+    return best.packet;
+}
+
+Ptr<Packet>
+MultiHopLoraApp::SelectBuffered(const std::vector<Ptr<Packet>> &candidates) const
+{
     //---Start Forwarding Policy Logic from Paper---//
 
     //Create F1 (pseudocode step 3)
     std::vector<Ptr<Packet>> F1;
     for (const auto &pkt : candidates)
     {
-        MultiHopLoraHeader hdr;
+        MultiHopLoraPrefixHeader hdr;
         pkt->PeekHeader(hdr);
         if (hdr.GetLgw() + RETREAT_FACTOR > m_lgw)
         {
@@ -196,8 +1249,7 @@ MultiHopLoraApp::ProcessDuplicates(uint32_t lfid) // PERBAIKAN: Menambahkan para
 
     if (F1.empty())
     {
-        NS_LOG_INFO("Node " << m_nodeId  << " discarded LFID " << lfid << ": No packets satisfied spatial constraint.");
-        return;
+        return nullptr;
     }
     
     //create F2 (pseudocode step 4)
@@ -205,7 +1257,7 @@ MultiHopLoraApp::ProcessDuplicates(uint32_t lfid) // PERBAIKAN: Menambahkan para
     uint8_t minHops = 255;
     for (const auto& pkt:F1)
     {
-        MultiHopLoraHeader hdr;
+        MultiHopLoraPrefixHeader hdr;
         pkt->PeekHeader(hdr);
         if (hdr.GetLh() < minHops)
         {
@@ -214,7 +1266,7 @@ MultiHopLoraApp::ProcessDuplicates(uint32_t lfid) // PERBAIKAN: Menambahkan para
     }
     for (const auto& pkt:F1)
     {
-        MultiHopLoraHeader hdr;
+        MultiHopLoraPrefixHeader hdr;
         pkt->PeekHeader(hdr);
         if (hdr.GetLh() == minHops)
         {
@@ -235,7 +1287,7 @@ MultiHopLoraApp::ProcessDuplicates(uint32_t lfid) // PERBAIKAN: Menambahkan para
             uint8_t maxLgw = 0;
             for (const auto& pkt: F2)
             {
-                MultiHopLoraHeader hdr;
+                MultiHopLoraPrefixHeader hdr;
                 pkt->PeekHeader(hdr);
                 if (hdr.GetLgw() > maxLgw)
                 {
@@ -245,6 +1297,115 @@ MultiHopLoraApp::ProcessDuplicates(uint32_t lfid) // PERBAIKAN: Menambahkan para
             }
         }
     }
+    return bestPacket;
+}
+
+void
+MultiHopLoraApp::StartWindow(uint32_t lfid, Time waitTime)
+{
+    Time deadline = Simulator::Now() + waitTime;
+    if (m_windowTick.IsStrictlyPositive())
+    {
+        //rounded up, a window may close late but never early
+        int64_t ticks = (deadline.GetTimeStep() + m_windowTick.GetTimeStep() - 1) / m_windowTick.GetTimeStep();
+        deadline = TimeStep(ticks * m_windowTick.GetTimeStep());
+    }
+    m_candidates[lfid].timer = m_nextTimer;
+    m_windows.push(Expiry{deadline, m_nextTimer++, lfid});
+    m_windowsOpened++;
+
+    //one armed event per node, moved forward only when this window closes first
+    if (m_windowEvent.IsPending() && m_windowEventTime <= deadline)
+    {
+        return;
+    }
+    Simulator::Remove(m_windowEvent);
+    m_windowEvent = Simulator::Schedule(deadline - Simulator::Now(), &MultiHopLoraApp::ExpireWindows, this);
+    m_windowEventTime = deadline;
+    m_windowEvents++;
+}
+
+void
+MultiHopLoraApp::ExpireWindows(void)
+{
+    //every window due now closes in this event, in the order the windows were opened
+    std::vector<uint32_t> due;
+    while (!m_windows.empty() && m_windows.top().deadline <= Simulator::Now())
+    {
+        const Expiry &expiry = m_windows.top();
+        auto it = m_candidates.find(expiry.lfid);
+        if (it != m_candidates.end() && it->second.timer == expiry.timer)
+        {
+            due.push_back(expiry.lfid);
+        }
+        m_windows.pop();
+    }
+    for (uint32_t lfid : due)
+    {
+        ProcessDuplicates(lfid);
+    }
+
+    if (!m_windows.empty())
+    {
+        m_windowEventTime = m_windows.top().deadline;
+        m_windowEvent = Simulator::Schedule(m_windowEventTime - Simulator::Now(), &MultiHopLoraApp::ExpireWindows, this);
+        m_windowEvents++;
+    }
+}
+
+void
+MultiHopLoraApp::ProcessDuplicates(uint32_t lfid) // PERBAIKAN: Menambahkan parameter lfid
+{
+    MULTI_HOP_LORA_PROFILE(PROCESS_DUPLICATES);
+    NS_LOG_FUNCTION(this << lfid);
+
+    auto cit = m_candidates.find(lfid);
+    if (cit == m_candidates.end())
+    {
+        return; //no packets to process
+    }
+    Candidate best = cit->second;
+    m_candidates.erase(cit);
+    m_dupDensity = 0.875 * m_dupDensity + 0.125 * best.copies;
+
+    Ptr<Packet> bestPacket = nullptr;
+    if (m_streamingSelection)
+    {
+        bestPacket = SelectCandidate(best);
+    }
+    else
+    {
+        auto it = m_dupllicateBuffer.find(lfid);
+        if (it == m_dupllicateBuffer.end() || it->second.empty())
+        {
+            return; //no packets to process
+        }
+
+        std::vector<Ptr<Packet>> candidates = it->second;
+        m_dupllicateBuffer.erase(it);
+
+        bestPacket = SelectBuffered(candidates);
+#ifdef NS3_ASSERT_ENABLE
+        //the running candidate must reach the same decision as the buffered policy
+        //copies of one LFID share a packet UID, so the decision is compared on the headers
+        Ptr<Packet> streamed = SelectCandidate(best);
+        NS_ASSERT_MSG(!bestPacket == !streamed, "Streaming selection diverged from buffered policy for LFID " << lfid);
+        if (bestPacket && streamed)
+        {
+            MultiHopLoraHeader buffered, running;
+            bestPacket->PeekHeader(buffered);
+            streamed->PeekHeader(running);
+            NS_ASSERT_MSG(buffered.GetLh() == running.GetLh() && buffered.GetLgw() == running.GetLgw() && buffered.GetPath() == running.GetPath(),
+                          "Streaming selection diverged from buffered policy for LFID " << lfid);
+        }
+#endif
+    }
+
+    if (!best.packet)
+    {
+        MultiHopLoraTrace::Record(MultiHopLoraTrace::DROP_SPATIAL, m_nodeId, lfid, 0, m_lgw, best.copies);
+        return;
+    }
 
     //forward or discard
     if (bestPacket)
@@ -256,16 +1417,16 @@ MultiHopLoraApp::ProcessDuplicates(uint32_t lfid) // PERBAIKAN: Menambahkan para
         //update header for forwarding
         header.SetLh(header.GetLh() + 1);
         header.SetLgw(m_lgw); //update lgw to this node's value
+        header.SetSf(m_txSf);
         header.AddNodeToPath(m_nodeId);
 
         packetToForward->AddHeader(header);
 
-        m_socket->SendTo(packetToForward, 0, m_broadcastAddress);
-        NS_LOG_INFO("Node " << m_nodeId << " forwarded packet with LFID " << lfid << ". New hop count: " << (int)header.GetLh());
+        Transmit(packetToForward, header.GetLh()); //counted once it reaches the transmit queue
     }
     else
     {
-        NS_LOG_INFO("Node " << m_nodeId << " discarded LFID " << lfid << " after filtering");
+        MultiHopLoraTrace::Record(MultiHopLoraTrace::DROP_FILTER, m_nodeId, lfid, best.lh, best.lgw, best.copies);
     }
 }
 
@@ -4,8 +4,20 @@
 #include "ns3/application.h"
 #include "ns3/socket.h"
 #include "ns3/lora-net-device.h"
+#include "ns3/end-device-lora-phy.h"
+#include "ns3/gateway-lora-phy.h"
 #include "multi-hop-lora-header.h"
+#include "multi-hop-lora-cache.h"
+#include "multi-hop-lora-server.h"
+#include "multi-hop-lora-forwarder.h"
+#include "multi-hop-lora-scheduler.h"
+#include "multi-hop-lora-traffic.h"
+#include "ns3/random-variable-stream.h"
+#include "ns3/traced-callback.h"
+#include <functional>
 #include <map>
+#include <queue>
+#include <string>
 #include <vector>
 
 namespace ns3{
@@ -20,19 +32,161 @@ public:
     // PERBAIKAN: Mengubah tipe data packetInterval menjadi double agar konsisten
     void Setup(uint32_t nodeId, uint8_t lgw, bool isGateway, bool isSource, double packetInterval, uint32_t packetSize);
 
+    //a source with a traffic model sends when the model says so, with the payload size it draws,
+    //instead of a packetSize payload every packetInterval. set before the application starts
+    void SetTrafficModel(Ptr<MultiHopLoraTrafficModel> traffic);
+    Ptr<MultiHopLoraTrafficModel> GetTrafficModel(void) const;
+
+    //LFID duplicate cache, exposes hit/eviction/false re-forward counters
+    const MultiHopLoraCache& GetPacketCache(void) const;
+
+    //the app draws its contention windows from one stream, returns the number of streams used
+    int64_t AssignStreams(int64_t stream);
+
+    //time on air from a precomputed table (BW 125 kHz, CR 4/5, 8 preamble symbols, explicit header, CRC)
+    static Time GetTimeOnAir(uint8_t sf, uint32_t bytes);
+
+    //signature of the Send, Receive, Forward, Deliver and Suppress trace sources
+    //lh is the hop count carried by the packet (after the increment for Forward)
+    typedef void (*PacketTracedCallback)(Ptr<const Packet> packet, uint32_t nodeId, uint32_t lfid, uint8_t lh);
+    //signature of the ForwardFrame source, entries is the number of forwarded LFIDs in the frame
+    typedef void (*FrameTracedCallback)(Ptr<const Packet> frame, uint32_t nodeId, uint32_t entries, uint8_t sf);
+    //signature of the Beacon source, lgw is the one announced
+    typedef void (*BeaconTracedCallback)(Ptr<const Packet> beacon, uint32_t nodeId, uint8_t lgw, uint8_t sf);
+    //signature of the LgwChange source
+    typedef void (*LgwTracedCallback)(uint32_t nodeId, uint8_t oldLgw, uint8_t newLgw);
+
+    bool IsGateway(void) const;
+
+    //gateways hand one uplink per LFID to the server, backhaulDelay after their window closes
+    void SetNetworkServer(Ptr<MultiHopLoraNetworkServer> server, Time backhaulDelay);
+    //and push it to a real network server as a Semtech PUSH_DATA, with or without the simulated one
+    void SetPacketForwarder(Ptr<MultiHopLoraPacketForwarder> forwarder);
+
+    //packet counters
+    uint32_t GetPacketsSent(void) const; //originated by this source
+    uint32_t GetPacketsForwarded(void) const;
+    uint32_t GetPacketsDelivered(void) const; //distinct LFIDs received by this gateway
+    uint32_t GetUplinksSent(void) const;
+    uint32_t GetForwardsSuppressed(void) const;
+    uint64_t GetWindowsOpened(void) const; //contention windows, one per new LFID
+    uint64_t GetWindowEvents(void) const; //simulator events that closed them
+    Time GetAirtimeSaved(void) const; //time on air of the suppressed forwards
+    uint8_t GetTxSpreadingFactor(void) const; //current one, changes over time with AdaptiveSf
+    double GetRxFrequency(void) const; //MHz, from the channel plan once the application started
+    double GetTxFrequency(void) const;
+
+    //gradient discovery
+    uint8_t GetLgw(void) const; //current one, learnt from beacons with GradientDiscovery
+    uint32_t GetBeaconsSent(void) const;
+    Time GetBeaconAirtime(void) const;
+    uint32_t GetLgwChanges(void) const;
+    Time GetLastLgwChange(void) const; //zero if the LGw never changed
+
+    //transmit queue with duty-cycle accounting, exposes occupancy, wait and drop statistics
+    const MultiHopLoraTxScheduler& GetTxScheduler(void) const;
+
 protected:
     virtual void StartApplication(void);
     virtual void StopApplication(void);
 
 private:
+    friend class MultiHopLoraAppBenchmark; //times the selection policy in tools/multi-hop-lora-bench.cc
+    friend class MultiHopLoraSelectionTestCase; //checks streaming against buffered selection in multi-hop-lora-test-suite.cc
+
     //packet generation and sending
     void ScheduleTx(void);
     void SendPacket(void);
+    void SendPayload(uint32_t size);
 
     //packet reception and processing
     void ReceivePacket(Ptr<Socket> socket);
+    void HandleFrame(Ptr<Packet> packet);
     void ProcessDuplicates (uint32_t lfid);
 
+    //running best candidate of one LFID under the F1/F2/max-LGw policy
+    struct Candidate
+    {
+        Ptr<Packet> packet; //best packet so far, null while F1 is empty
+        uint8_t lh;
+        uint8_t lgw;
+        uint32_t ties; //F1 packets sharing the minimum hop count
+        uint32_t copies; //every copy heard during the window, F1 or not
+        uint64_t timer; //its entry in m_windows, stale entries of erased candidates are skipped
+        uint32_t overheard; //copies heard from nodes with a lower LGw
+    };
+
+    //best copy of one LFID at a gateway, while its dedup window is open
+    struct Uplink
+    {
+        Ptr<Packet> packet;
+        double rssiDbm;
+        uint8_t lh;
+        uint32_t copies;
+        Time firstRx;
+    };
+
+    void ReceiveAtGateway(Ptr<Packet> packet, const MultiHopLoraPrefixHeader &header);
+    void SendUplink(uint32_t lfid);
+
+    //forwarded frames go through here, with Aggregation they are bundled before going on air
+    void Transmit(Ptr<Packet> packet, uint8_t lh);
+    void FlushAggregate(void);
+    //counts a forward once its frame is handed to the transmit queue
+    void CountForward(Ptr<const Packet> packet);
+
+    //called by the transmit queue, entries is 0 for frames this node originated
+    void SendFrame(Ptr<Packet> frame, uint32_t entries, uint8_t sf);
+    void DropFrame(Ptr<const Packet> frame, uint32_t entries, Time waited);
+
+    //contention window for a frame of the given size, received at the given spreading factor
+    Time GetWaitTime(uint32_t frameBytes, uint8_t sf);
+    //upper bound of GetWaitTime over every frame this node can receive, the shortest usable CacheTtl
+    Time GetLongestWait(void) const;
+
+    //link quality to the gateways in range, drives the spreading factor with AdaptiveSf
+    struct Link
+    {
+        double rssiDbm; //moving average
+        Time lastHeard;
+    };
+    void ObserveLink(Ptr<Packet> beacon, uint32_t gateway);
+    void UpdateSpreadingFactor(void);
+
+    //beacon-driven gradient, the LGw is one more than the lowest one announced by a live neighbour
+    struct Neighbour
+    {
+        uint8_t lgw;
+        Time lastHeard;
+    };
+    void ReceiveBeacon(Ptr<Packet> packet);
+    bool UpdateGradient(void);
+    void SetLgw(uint8_t lgw);
+    void ScheduleBeacon(void);
+    void SendBeacon(void);
+
+    //with more than one channel, beacons only go in a slot at the start of every BeaconInterval,
+    //in which repeaters listen on the first channel of the plan and hold their data
+    bool UsesBeaconSlots(void) const;
+    Time GetTimeToBeaconSlot(void) const; //0 while a slot is open
+    void OpenBeaconSlot(void);
+    void CloseBeaconSlot(void);
+
+    //picks the receive and transmit channels of the current LGw, and tunes the PHY to the receive
+    //channel or, in a beacon slot, to the beacon channel
+    void UpdateChannels(void);
+
+    //PHY of a non-gateway node to tune, null on gateways, whose PHYs hear every channel and SF
+    Ptr<lorawan::EndDeviceLoraPhy> GetEndDevicePhy(void) const;
+
+    //counts a copy with better progress, cancels the window once SuppressionThreshold is reached
+    bool Overhear(Ptr<Packet> packet, const MultiHopLoraPrefixHeader &header);
+
+    void BufferCandidate(Ptr<Packet> packet, const MultiHopLoraPrefixHeader &header);
+    void UpdateCandidate(Candidate &best, Ptr<Packet> packet, const MultiHopLoraPrefixHeader &header) const;
+    Ptr<Packet> SelectCandidate(const Candidate &best) const;
+    Ptr<Packet> SelectBuffered(const std::vector<Ptr<Packet>> &candidates) const;
+
     //node configuration
     uint32_t m_nodeId;
     uint8_t m_lgw;
@@ -43,21 +197,133 @@ private:
     Time m_packetInterval;
     uint32_t m_packetSize;
     uint32_t m_packetsSent;
-    uint32_t m_lfidCounter;
+    uint32_t m_packetsForwarded;
+    uint32_t m_packetsDelivered;
+    uint16_t m_sequence; //per-source LFID sequence number
+    uint8_t m_headerVersion;
+    bool m_pathHashOnly;
 
     //socket and network
     Ptr<Socket> m_socket;
     Address m_broadcastAddress;
 
     //forwarding logic state
-    std::map<uint32_t, Time> m_packetCache;
-    std::map<uint32_t, std::vector<Ptr<Packet>>> m_dupllicateBuffer;
+    MultiHopLoraCache m_packetCache;
+    uint32_t m_cacheSize;
+    Time m_cacheTtl;
+    std::map<uint32_t, Candidate> m_candidates;
+
+    //contention window expiries, earliest first. only the earliest one has a simulator event
+    struct Expiry
+    {
+        Time deadline;
+        uint64_t timer; //creation order, breaks ties
+        uint32_t lfid;
+        bool operator>(const Expiry &other) const
+        {
+            return deadline > other.deadline || (deadline == other.deadline && timer > other.timer);
+        }
+    };
+    void StartWindow(uint32_t lfid, Time waitTime);
+    void ExpireWindows(void);
+    std::priority_queue<Expiry, std::vector<Expiry>, std::greater<Expiry>> m_windows;
+    EventId m_windowEvent;
+    Time m_windowEventTime; //deadline m_windowEvent was armed for
+    Time m_windowTick;
+    uint64_t m_nextTimer;
+    uint64_t m_windowsOpened;
+    uint64_t m_windowEvents;
+    std::map<uint32_t, std::vector<Ptr<Packet>>> m_dupllicateBuffer; //only used without StreamingSelection
+    bool m_streamingSelection;
+
+    //forward suppression
+    bool m_forwardSuppression;
+    uint32_t m_suppressionThreshold;
+    uint32_t m_forwardsSuppressed;
+    Time m_airtimeSaved;
+
+    //contention window
+    Ptr<UniformRandomVariable> m_rng;
+    bool m_adaptiveWindow;
+    uint8_t m_sf;
+    bool m_densityAdaptive;
+    double m_maxWindowFactor;
+    double m_dupDensity; //moving average of copies heard per LFID
+
+    //spreading factor
+    uint8_t m_txSf;
+    bool m_adaptiveSf;
+    double m_linkMargin;
+    Time m_linkTimeout;
+    std::map<uint32_t, Link> m_links; //keyed on the gateway's node ID
+
+    //forward aggregation
+    bool m_aggregation;
+    uint32_t m_maxAggregateSize;
+    Time m_maxAggregationDelay;
+    std::vector<Ptr<Packet>> m_aggregate;
+    uint32_t m_aggregateSize; //serialized size of the pending aggregate
+    uint8_t m_aggregateLh; //highest hop count in the pending aggregate, its queue priority
+    EventId m_aggregateEvent;
+
+    //gateway uplink
+    std::map<uint32_t, Uplink> m_uplinks;
+    Time m_gatewayWindow;
+    Ptr<MultiHopLoraNetworkServer> m_server;
+    Time m_backhaulDelay;
+    Ptr<MultiHopLoraPacketForwarder> m_forwarder;
+    uint32_t m_uplinksSent;
+
+    //channel plan, ring r listens on channel r mod N and sends towards ring r - 1
+    std::string m_channelPlan;
+    std::vector<double> m_channels; //MHz
+    uint32_t m_rxChannel;
+    uint32_t m_txChannel;
+    uint32_t m_txSubBand; //duty-cycle bucket of the transmit channel
+    std::vector<uint32_t> m_subBands; //distinct sub-bands of the plan, in bucket order
+
+    //transmit queue
+    MultiHopLoraTxScheduler m_scheduler;
+    double m_dutyCycle;
+    Time m_dutyCycleWindow;
+    uint32_t m_maxQueueSize;
+    Time m_maxQueueDelay;
+
+    //gradient discovery
+    bool m_gradient;
+    Time m_beaconInterval;
+    Time m_minBeaconInterval;
+    Time m_beaconJitter;
+    Time m_beaconSlot;
+    EventId m_beaconSlotEvent;
+    Time m_neighbourTimeout;
+    uint32_t m_gradientHysteresis;
+    std::map<uint32_t, Neighbour> m_neighbours; //keyed on the neighbour's node ID
+    uint16_t m_beaconSeq; //latest epoch seen, 0 before the first beacon
+    Time m_lastBeacon;
+    EventId m_beaconEvent;
+    uint32_t m_beaconsSent;
+    Time m_beaconAirtime;
+    uint32_t m_lgwChanges;
+    Time m_lastLgwChange;
 
     //simulation control
     EventId m_sendEvent;
+    Ptr<MultiHopLoraTrafficModel> m_traffic; //null for the fixed packetInterval
+
+    //trace sources
+    TracedCallback<Ptr<const Packet>, uint32_t, uint32_t, uint8_t> m_sendTrace;
+    TracedCallback<Ptr<const Packet>, uint32_t, uint32_t, uint8_t> m_receiveTrace;
+    TracedCallback<Ptr<const Packet>, uint32_t, uint32_t, uint8_t> m_forwardTrace;
+    TracedCallback<Ptr<const Packet>, uint32_t, uint32_t, uint8_t> m_deliverTrace; //first copy of an LFID at this gateway
+    TracedCallback<Ptr<const Packet>, uint32_t, uint32_t, uint8_t> m_forwardFrameTrace;
+    TracedCallback<Ptr<const Packet>, uint32_t, uint32_t, uint8_t> m_suppressTrace;
+    TracedCallback<Ptr<const Packet>, uint32_t, uint8_t, uint8_t> m_beaconTrace;
+    TracedCallback<uint32_t, uint8_t, uint8_t> m_lgwChangeTrace;
 
     //constants from paper
     static const uint8_t MAX_HOPS = 10;
+    static_assert(MAX_HOPS <= MultiHopLoraHeader::Path::CAPACITY, "MULTI_HOP_LORA_PATH_CAPACITY is smaller than MAX_HOPS");
     static const uint8_t RETREAT_FACTOR = 1;
     static const Time MIN_WAIT;
     static const Time MAX_WAIT;
@@ -0,0 +1,175 @@
+#include "multi-hop-lora-cache.h"
+#include "ns3/log.h"
+#include "ns3/assert.h"
+#include <algorithm>
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE("MultiHopLoraCache");
+
+const uint32_t MultiHopLoraCache::MAX_PROBES; //bound to a reference by std::min
+
+MultiHopLoraCache::MultiHopLoraCache():m_mask(0),m_shift(32),m_ttl(Seconds(60)),m_hits(0),m_evictions(0),m_falseReforwards(0)
+{}
+
+void
+MultiHopLoraCache::Resize(uint32_t capacity)
+{
+    NS_ASSERT_MSG(capacity > 0 && capacity <= (1u << 31), "Invalid LFID cache capacity " << capacity);
+
+    uint32_t size = 1;
+    uint32_t bits = 0;
+    while (size < capacity)
+    {
+        size <<= 1;
+        ++bits;
+    }
+
+    m_entries.assign(size, Entry{0, false, false, Time(), Time()});
+    m_evicted.assign(size, Entry{0, false, false, Time(), Time()});
+    m_mask = size - 1;
+    m_shift = 32 - bits;
+}
+
+void
+MultiHopLoraCache::SetTtl(Time ttl)
+{
+    m_ttl = ttl;
+}
+
+void
+MultiHopLoraCache::Clear(void)
+{
+    for (Entry &e : m_entries)
+    {
+        e.used = false;
+    }
+    for (Entry &e : m_evicted)
+    {
+        e.used = false;
+    }
+    m_hits = 0;
+    m_evictions = 0;
+    m_falseReforwards = 0;
+}
+
+uint32_t
+MultiHopLoraCache::Slot(uint32_t lfid) const
+{
+    //fibonacci hashing, LFIDs are nodeId << 16 | counter so the low bits alone cluster badly
+    if (m_shift == 32)
+    {
+        return 0;
+    }
+    return (lfid * 2654435769u) >> m_shift;
+}
+
+bool
+MultiHopLoraCache::Lookup(uint32_t lfid, Time now, Time &expiry)
+{
+    uint32_t slot = Slot(lfid);
+    uint32_t probes = std::min<uint32_t>(MAX_PROBES, m_entries.size());
+    for (uint32_t i = 0; i < probes; ++i)
+    {
+        Entry &e = m_entries[(slot + i) & m_mask];
+        if (!e.used)
+        {
+            break; //slots are never freed, so the lfid cannot be further along
+        }
+        if (e.lfid == lfid)
+        {
+            if (now <= e.deadline)
+            {
+                m_hits++;
+                expiry = e.expiry;
+                return true;
+            }
+            //the unbounded map would still have suppressed this one, counted once per LFID
+            if (!e.reforwarded)
+            {
+                e.reforwarded = true;
+                m_falseReforwards++;
+            }
+            return false;
+        }
+    }
+
+    //so would it if the entry had been evicted while live, the ghost is dropped once counted
+    for (uint32_t i = 0; i < probes; ++i)
+    {
+        Entry &e = m_evicted[(slot + i) & m_mask];
+        if (e.used && e.lfid == lfid)
+        {
+            e.used = false;
+            if (now <= e.deadline)
+            {
+                m_falseReforwards++;
+            }
+            break;
+        }
+    }
+    return false;
+}
+
+void
+MultiHopLoraCache::Insert(uint32_t lfid, Time expiry, Time now)
+{
+    NS_ASSERT_MSG(!m_entries.empty(), "Resize the LFID cache before use");
+    uint32_t slot = Slot(lfid);
+    uint32_t probes = std::min<uint32_t>(MAX_PROBES, m_entries.size());
+    Entry *target = nullptr;
+    Entry *oldest = nullptr;
+    for (uint32_t i = 0; i < probes; ++i)
+    {
+        Entry &e = m_entries[(slot + i) & m_mask];
+        if (!e.used || e.lfid == lfid || e.deadline < now)
+        {
+            target = &e;
+            break;
+        }
+        if (!oldest || e.deadline < oldest->deadline)
+        {
+            oldest = &e;
+        }
+    }
+
+    if (!target)
+    {
+        NS_LOG_DEBUG("LFID cache full around slot " << slot << ", evicting LFID " << oldest->lfid);
+        target = oldest;
+        m_evictions++;
+
+        //remembered in the slot of the evicted LFID, over the oldest entry of its probe window
+        uint32_t evictedSlot = Slot(oldest->lfid);
+        Entry *ghost = nullptr;
+        for (uint32_t i = 0; i < probes; ++i)
+        {
+            Entry &e = m_evicted[(evictedSlot + i) & m_mask];
+            if (!e.used || e.deadline < now)
+            {
+                ghost = &e;
+                break;
+            }
+            if (!ghost || e.deadline < ghost->deadline)
+            {
+                ghost = &e;
+            }
+        }
+        *ghost = *oldest;
+    }
+
+    target->lfid = lfid;
+    target->used = true;
+    target->reforwarded = false;
+    target->expiry = expiry;
+    target->deadline = std::max(expiry, now + m_ttl);
+}
+
+// Getters implementation
+uint32_t MultiHopLoraCache::GetCapacity (void) const { return m_mask + 1; }
+Time MultiHopLoraCache::GetTtl (void) const { return m_ttl; }
+uint64_t MultiHopLoraCache::GetHits (void) const { return m_hits; }
+uint64_t MultiHopLoraCache::GetEvictions (void) const { return m_evictions; }
+uint64_t MultiHopLoraCache::GetFalseReforwards (void) const { return m_falseReforwards; }
+
+} // namespace ns3
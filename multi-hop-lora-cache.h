@@ -0,0 +1,62 @@
+#ifndef MULTI_HOP_LORA_CACHE_H
+#define MULTI_HOP_LORA_CACHE_H
+
+#include "ns3/nstime.h"
+#include <vector>
+#include <cstdint>
+
+namespace ns3 {
+
+//fixed-capacity LFID duplicate table (open addressing, linear probing)
+//entries are remembered for a retention TTL and then become reusable,
+//so memory stays bounded no matter how long the repeater runs
+//live entries evicted by a full probe window are kept in a second table of the same size,
+//so an LFID coming back before its TTL is counted as a false re-forward
+class MultiHopLoraCache
+{
+public:
+    MultiHopLoraCache();
+
+    void Resize(uint32_t capacity); //rounded up to a power of two, the table is empty until then
+    void SetTtl(Time ttl);
+    void Clear(void);
+
+    //returns true if lfid is known and still retained, expiry is the end of its duplicate window
+    bool Lookup(uint32_t lfid, Time now, Time &expiry);
+    void Insert(uint32_t lfid, Time expiry, Time now);
+
+    //Getters
+    uint32_t GetCapacity(void) const;
+    Time GetTtl(void) const;
+    uint64_t GetHits(void) const;
+    uint64_t GetEvictions(void) const;
+    uint64_t GetFalseReforwards(void) const;
+
+private:
+    struct Entry
+    {
+        uint32_t lfid;
+        bool used;
+        bool reforwarded; //already counted as a false re-forward since it expired
+        Time expiry; //end of the duplicate waiting window
+        Time deadline; //entry may be reused after this time
+    };
+
+    uint32_t Slot(uint32_t lfid) const;
+
+    std::vector<Entry> m_entries;
+    uint32_t m_mask;
+    uint32_t m_shift;
+    Time m_ttl;
+
+    uint64_t m_hits; //lookups answered from the table
+    uint64_t m_evictions; //live entries overwritten because the probe window was full
+    uint64_t m_falseReforwards; //LFIDs seen again after their entry expired or was evicted while live
+    std::vector<Entry> m_evicted; //deadline of evicted live LFIDs, lower bound once it overflows too
+
+    static const uint32_t MAX_PROBES = 8;
+};
+
+} //namespace ns3
+
+#endif //MULTI_HOP_LORA_CACHE_H
@@ -0,0 +1,251 @@
+#include "multi-hop-lora-channel.h"
+#include "multi-hop-lora-header.h"
+#include "ns3/log.h"
+#include "ns3/assert.h"
+#include "ns3/abort.h"
+#include "ns3/simulator.h"
+#include "ns3/double.h"
+#include "ns3/boolean.h"
+#include "ns3/node.h"
+#include "ns3/callback.h"
+#include "ns3/lora-net-device.h"
+#include "ns3/end-device-lora-phy.h"
+#include "ns3/constant-position-mobility-model.h"
+#include <algorithm>
+#include <cmath>
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE("MultiHopLoraGridChannel");
+NS_OBJECT_ENSURE_REGISTERED(MultiHopLoraGridChannel);
+
+TypeId
+MultiHopLoraGridChannel::GetTypeId(void)
+{
+    static TypeId tid = TypeId("ns3::MultiHopLoraGridChannel")
+    .SetParent<lorawan::LoraChannel>()
+    .SetGroupName("lorawan")
+    .AddAttribute("InterferenceMargin",
+                  "dB below the lowest end device sensitivity down to which receptions are delivered",
+                  DoubleValue(6.0),
+                  MakeDoubleAccessor(&MultiHopLoraGridChannel::m_margin),
+                  MakeDoubleChecker<double>(0.0))
+    .AddAttribute("Verify",
+                  "Also evaluate every culled receiver and abort if one would have heard the frame above the link floor",
+                  BooleanValue(false),
+                  MakeBooleanAccessor(&MultiHopLoraGridChannel::m_verify),
+                  MakeBooleanChecker())
+    ;
+    return tid;
+}
+
+MultiHopLoraGridChannel::MultiHopLoraGridChannel()
+    :m_delay(CreateObject<ConstantSpeedPropagationDelayModel>()),m_maxRange(0),m_margin(6.0),m_verify(false),m_dirty(true),m_watched(0),
+     m_delivered(0),m_culled(0),m_rebuilds(0)
+{}
+
+MultiHopLoraGridChannel::MultiHopLoraGridChannel(Ptr<PropagationLossModel> loss, Ptr<PropagationDelayModel> delay)
+    :lorawan::LoraChannel(loss, delay),m_delay(delay),m_maxRange(0),m_margin(6.0),m_verify(false),m_dirty(true),m_watched(0),
+     m_delivered(0),m_culled(0),m_rebuilds(0)
+{}
+
+MultiHopLoraGridChannel::~MultiHopLoraGridChannel()
+{}
+
+void
+MultiHopLoraGridChannel::ApplyTxTag(Ptr<Packet> packet, lorawan::LoraTxParameters &txParams, Time &duration, double &frequencyMHz)
+{
+    //the app sends through the device, which does not let it pick the SF or channel of a frame
+    MultiHopLoraTxTag tx;
+    if (!packet->PeekPacketTag(tx))
+    {
+        return;
+    }
+    frequencyMHz = tx.GetFrequency();
+    if (tx.GetSf() == txParams.sf)
+    {
+        return;
+    }
+    txParams.sf = tx.GetSf();
+    txParams.lowDataRateOptimizationEnabled = lorawan::LoraPhy::GetTSym(txParams) > MilliSeconds(16);
+    duration = lorawan::LoraPhy::GetOnAirTime(packet, txParams);
+}
+
+double
+MultiHopLoraGridChannel::ComputeRange(Ptr<PropagationLossModel> loss, double txPowerDbm, double floorDbm, double limit)
+{
+    Ptr<ConstantPositionMobilityModel> a = CreateObject<ConstantPositionMobilityModel>();
+    Ptr<ConstantPositionMobilityModel> b = CreateObject<ConstantPositionMobilityModel>();
+    a->SetPosition(Vector(0, 0, 0));
+    auto reaches = [&](double distance) {
+        b->SetPosition(Vector(distance, 0, 0));
+        return loss->CalcRxPower(txPowerDbm, a, b) >= floorDbm;
+    };
+
+    double near = 1.0;
+    double far = 2.0;
+    while (reaches(far))
+    {
+        if (far >= limit)
+        {
+            return limit;
+        }
+        near = far;
+        far = std::min(far * 2, limit);
+    }
+    //to a centimetre, the range is rounded up
+    while (far - near > 0.01)
+    {
+        double middle = (near + far) / 2;
+        (reaches(middle) ? near : far) = middle;
+    }
+    return far;
+}
+
+double
+MultiHopLoraGridChannel::GetRxPowerFloor(void) const
+{
+    const double *sensitivity = lorawan::EndDeviceLoraPhy::sensitivity;
+    return *std::min_element(sensitivity, sensitivity + 6) - m_margin;
+}
+
+double
+MultiHopLoraGridChannel::GetLinkFloor(uint32_t senders) const
+{
+    return GetRxPowerFloor() - 10.0 * std::log10(std::max<uint32_t>(senders, 1));
+}
+
+void
+MultiHopLoraGridChannel::SetMaxRange(double range)
+{
+    m_maxRange = range;
+    m_dirty = true;
+}
+
+double
+MultiHopLoraGridChannel::GetMaxRange(void) const
+{
+    return m_maxRange;
+}
+
+uint64_t
+MultiHopLoraGridChannel::CellKey(const Vector &position, int dx, int dy) const
+{
+    int64_t cx = int64_t(std::floor(position.x / m_maxRange)) + dx;
+    int64_t cy = int64_t(std::floor(position.y / m_maxRange)) + dy;
+    return (uint64_t(cx) << 32) ^ uint64_t(uint32_t(cy));
+}
+
+void
+MultiHopLoraGridChannel::BuildIndex(void) const
+{
+    m_phys.clear();
+    m_positions.clear();
+    m_cells.clear();
+    for (std::size_t i = 0; i < GetNDevices(); ++i)
+    {
+        Ptr<lorawan::LoraNetDevice> device = DynamicCast<lorawan::LoraNetDevice>(GetDevice(i));
+        NS_ASSERT_MSG(device, "Only LoraNetDevices can share a MultiHopLoraGridChannel");
+        Ptr<lorawan::LoraPhy> phy = device->GetPhy();
+        Ptr<MobilityModel> mobility = phy->GetMobility();
+        m_phys.push_back(phy);
+        m_positions.push_back(mobility->GetPosition());
+        if (m_maxRange > 0)
+        {
+            m_cells[CellKey(m_positions.back(), 0, 0)].push_back(i);
+        }
+        if (i >= m_watched)
+        {
+            //the callback only marks the index stale
+            MultiHopLoraGridChannel *self = const_cast<MultiHopLoraGridChannel *>(this);
+            mobility->TraceConnectWithoutContext("CourseChange", MakeCallback(&MultiHopLoraGridChannel::PositionChanged, self));
+            m_watched = i + 1;
+        }
+    }
+    m_dirty = false;
+    m_rebuilds++;
+    NS_LOG_DEBUG("Indexed " << m_phys.size() << " PHYs in " << m_cells.size() << " cells of " << m_maxRange << " m");
+}
+
+void
+MultiHopLoraGridChannel::PositionChanged(Ptr<const MobilityModel>)
+{
+    m_dirty = true;
+}
+
+void
+MultiHopLoraGridChannel::Send(Ptr<lorawan::LoraPhy> sender, Ptr<Packet> packet, double txPowerDbm, lorawan::LoraTxParameters txParams, Time duration, double frequencyMHz) const
+{
+    ApplyTxTag(packet, txParams, duration, frequencyMHz);
+    if (m_dirty || m_phys.size() != GetNDevices())
+    {
+        BuildIndex();
+    }
+
+    Ptr<MobilityModel> senderMobility = sender->GetMobility();
+    Vector position = senderMobility->GetPosition();
+    m_candidates.clear();
+    if (m_maxRange > 0)
+    {
+        for (int dx = -1; dx <= 1; ++dx)
+        {
+            for (int dy = -1; dy <= 1; ++dy)
+            {
+                auto cell = m_cells.find(CellKey(position, dx, dy));
+                if (cell != m_cells.end())
+                {
+                    m_candidates.insert(m_candidates.end(), cell->second.begin(), cell->second.end());
+                }
+            }
+        }
+        //same-time receptions keep the order of the full broadcast
+        std::sort(m_candidates.begin(), m_candidates.end());
+    }
+    else
+    {
+        for (uint32_t i = 0; i < m_phys.size(); ++i)
+        {
+            m_candidates.push_back(i);
+        }
+    }
+
+    uint64_t scheduled = 0;
+    for (uint32_t i : m_candidates)
+    {
+        const Ptr<lorawan::LoraPhy> &phy = m_phys[i];
+        if (phy == sender || (m_maxRange > 0 && CalculateDistance(position, m_positions[i]) > m_maxRange))
+        {
+            continue;
+        }
+        Ptr<MobilityModel> receiverMobility = phy->GetMobility();
+        Time delay = m_delay->GetDelay(senderMobility, receiverMobility);
+        double rxPowerDbm = GetRxPower(txPowerDbm, senderMobility, receiverMobility);
+        uint32_t dstNode = phy->GetDevice() ? phy->GetDevice()->GetNode()->GetId() : 0xffffffff;
+        Simulator::ScheduleWithContext(dstNode, delay, &lorawan::LoraPhy::StartReceive, phy, packet->Copy(), rxPowerDbm, txParams.sf, duration, frequencyMHz);
+        scheduled++;
+    }
+    m_delivered += scheduled;
+    m_culled += m_phys.size() - 1 - scheduled;
+
+    if (m_verify && m_maxRange > 0)
+    {
+        double floorDbm = GetLinkFloor(m_phys.size() - 1);
+        for (uint32_t i = 0; i < m_phys.size(); ++i)
+        {
+            if (m_phys[i] == sender || CalculateDistance(position, m_positions[i]) <= m_maxRange)
+            {
+                continue;
+            }
+            double rxPowerDbm = GetRxPower(txPowerDbm, senderMobility, m_phys[i]->GetMobility());
+            NS_ABORT_MSG_IF(rxPowerDbm >= floorDbm, "PHY " << i << " culled at " << CalculateDistance(position, m_positions[i]) << " m would receive "
+                            << rxPowerDbm << " dBm, above the " << floorDbm << " dBm link floor; MaxRange is too small");
+        }
+    }
+}
+
+// Getters implementation
+uint64_t MultiHopLoraGridChannel::GetDelivered (void) const { return m_delivered; }
+uint64_t MultiHopLoraGridChannel::GetCulled (void) const { return m_culled; }
+uint64_t MultiHopLoraGridChannel::GetRebuilds (void) const { return m_rebuilds; }
+
+} //namespace ns3
@@ -0,0 +1,80 @@
+#ifndef MULTI_HOP_LORA_CHANNEL_H
+#define MULTI_HOP_LORA_CHANNEL_H
+
+#include "ns3/lora-channel.h"
+#include "ns3/lora-phy.h"
+#include "ns3/mobility-model.h"
+#include "ns3/propagation-delay-model.h"
+#include "ns3/propagation-loss-model.h"
+#include "ns3/vector.h"
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
+
+namespace ns3 {
+
+//LoraChannel that only delivers a frame to the PHYs within MaxRange of the sender
+//PHY positions are kept in a uniform grid of MaxRange cells, so a transmission visits the 3x3
+//cells around the sender instead of every PHY. receptions are scheduled in the order of the
+//full broadcast. a range found with GetLinkFloor keeps the frames of every culled sender together
+//below the floor, where they can neither be decoded nor destroy a decodable frame (co-SF capture
+//needs 6 dB). without a range it is a plain full broadcast.
+//a position change rebuilds the grid before the next transmission
+class MultiHopLoraGridChannel: public lorawan::LoraChannel
+{
+public:
+    static TypeId GetTypeId(void);
+    MultiHopLoraGridChannel();
+    MultiHopLoraGridChannel(Ptr<PropagationLossModel> loss, Ptr<PropagationDelayModel> delay);
+    virtual ~MultiHopLoraGridChannel();
+
+    //replaces the SF and frequency the PHY sent a frame with by those in its MultiHopLoraTxTag,
+    //and the time on air with the SF
+    static void ApplyTxTag(Ptr<Packet> packet, lorawan::LoraTxParameters &txParams, Time &duration, double &frequencyMHz);
+
+    //farthest distance, up to limit meters, at which a txPowerDbm frame still arrives at floorDbm
+    //found by bisection between two probe positions, so the loss must grow with distance
+    static double ComputeRange(Ptr<PropagationLossModel> loss, double txPowerDbm, double floorDbm, double limit);
+
+    //lowest end device sensitivity minus InterferenceMargin
+    double GetRxPowerFloor(void) const;
+    //per-link floor at which the frames of senders PHYs, all arriving at once, add up to no more than the floor
+    double GetLinkFloor(uint32_t senders) const;
+
+    //0 delivers every frame to every PHY
+    void SetMaxRange(double range);
+    double GetMaxRange(void) const;
+
+    void Send(Ptr<lorawan::LoraPhy> sender, Ptr<Packet> packet, double txPowerDbm, lorawan::LoraTxParameters txParams, Time duration, double frequencyMHz) const override;
+
+    //Getters
+    uint64_t GetDelivered(void) const; //receptions scheduled
+    uint64_t GetCulled(void) const; //receptions a full broadcast would have added
+    uint64_t GetRebuilds(void) const;
+
+private:
+    void BuildIndex(void) const;
+    void PositionChanged(Ptr<const MobilityModel> mobility);
+    uint64_t CellKey(const Vector &position, int dx, int dy) const;
+
+    Ptr<PropagationDelayModel> m_delay;
+    double m_maxRange;
+    double m_margin;
+    bool m_verify;
+
+    //index over the PHYs of the channel, in the order the full broadcast visits them
+    mutable std::vector<Ptr<lorawan::LoraPhy>> m_phys;
+    mutable std::vector<Vector> m_positions;
+    mutable std::unordered_map<uint64_t, std::vector<uint32_t>> m_cells;
+    mutable std::vector<uint32_t> m_candidates; //scratch for Send
+    mutable bool m_dirty;
+    mutable uint32_t m_watched; //PHYs whose mobility reports position changes
+
+    mutable uint64_t m_delivered;
+    mutable uint64_t m_culled;
+    mutable uint64_t m_rebuilds;
+};
+
+} //namespace ns3
+
+#endif //MULTI_HOP_LORA_CHANNEL_H
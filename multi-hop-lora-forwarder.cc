@@ -0,0 +1,192 @@
+#include "multi-hop-lora-forwarder.h"
+#include "multi-hop-lora-header.h"
+#include "ns3/log.h"
+#include "ns3/abort.h"
+#include "ns3/uinteger.h"
+#include "ns3/string.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <vector>
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE("MultiHopLoraPacketForwarder");
+NS_OBJECT_ENSURE_REGISTERED(MultiHopLoraPacketForwarder);
+
+//Semtech packet-forwarder protocol, version 2
+static const uint8_t PROTOCOL_VERSION = 2;
+static const uint8_t PUSH_DATA = 0x00;
+static const uint8_t PUSH_ACK = 0x01;
+
+TypeId
+MultiHopLoraPacketForwarder::GetTypeId(void)
+{
+    static TypeId tid = TypeId("ns3::MultiHopLoraPacketForwarder")
+    .SetParent<Object>()
+    .SetGroupName("lorawan")
+    .AddConstructor<MultiHopLoraPacketForwarder>()
+    .AddAttribute("RemoteAddress",
+                  "IPv4 address of the network server's packet-forwarder endpoint",
+                  StringValue("127.0.0.1"),
+                  MakeStringAccessor(&MultiHopLoraPacketForwarder::m_address),
+                  MakeStringChecker())
+    .AddAttribute("RemotePort",
+                  "UDP port of the network server's packet-forwarder endpoint",
+                  UintegerValue(1700),
+                  MakeUintegerAccessor(&MultiHopLoraPacketForwarder::m_port),
+                  MakeUintegerChecker<uint16_t>())
+    .AddAttribute("GatewayEui",
+                  "EUI of the gateways, the node ID of each is added to the low 32 bits",
+                  UintegerValue(0xAA555A0000000000ull),
+                  MakeUintegerAccessor(&MultiHopLoraPacketForwarder::m_gatewayEui),
+                  MakeUintegerChecker<uint64_t>())
+    ;
+    return tid;
+}
+
+MultiHopLoraPacketForwarder::MultiHopLoraPacketForwarder()
+    :m_address("127.0.0.1"),m_port(1700),m_gatewayEui(0xAA555A0000000000ull),m_fd(-1),m_token(0),m_sent(0),m_sendErrors(0),m_acks(0),m_ackRttSum(0)
+{}
+
+MultiHopLoraPacketForwarder::~MultiHopLoraPacketForwarder()
+{}
+
+void
+MultiHopLoraPacketForwarder::DoDispose(void)
+{
+    if (m_fd >= 0)
+    {
+        ReadAcks();
+        close(m_fd);
+        m_fd = -1;
+    }
+    NS_LOG_INFO("Pushed " << m_sent << " uplinks to " << m_address << ":" << m_port << ", " << m_acks << " acknowledged");
+    Object::DoDispose();
+}
+
+void
+MultiHopLoraPacketForwarder::Open(void)
+{
+    sockaddr_in remote;
+    std::memset(&remote, 0, sizeof(remote));
+    remote.sin_family = AF_INET;
+    remote.sin_port = htons(m_port);
+    NS_ABORT_MSG_IF(inet_pton(AF_INET, m_address.c_str(), &remote.sin_addr) != 1, "Invalid RemoteAddress '" << m_address << "'");
+
+    //a connected socket only receives from the network server, and a stalled one must not stall the simulation
+    m_fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    NS_ABORT_MSG_IF(m_fd < 0, "Cannot create UDP socket: " << std::strerror(errno));
+    NS_ABORT_MSG_IF(connect(m_fd, reinterpret_cast<sockaddr *>(&remote), sizeof(remote)) != 0,
+                    "Cannot connect to " << m_address << ":" << m_port << ": " << std::strerror(errno));
+}
+
+void
+MultiHopLoraPacketForwarder::ReadAcks(void)
+{
+    uint8_t ack[64];
+    ssize_t size;
+    while ((size = recv(m_fd, ack, sizeof(ack), 0)) >= 0)
+    {
+        if (size < 4 || ack[0] != PROTOCOL_VERSION || ack[3] != PUSH_ACK)
+        {
+            continue;
+        }
+        auto pending = m_pending.find(uint16_t(ack[1] << 8 | ack[2]));
+        if (pending != m_pending.end())
+        {
+            m_acks++;
+            m_ackRttSum += std::chrono::duration<double>(std::chrono::steady_clock::now() - pending->second).count();
+            m_pending.erase(pending);
+        }
+    }
+}
+
+void
+MultiHopLoraPacketForwarder::PushData(uint32_t gateway, Ptr<const Packet> frame, double rssiDbm, Time firstRx, uint32_t chan)
+{
+    if (m_fd < 0)
+    {
+        Open();
+    }
+    ReadAcks();
+
+    MultiHopLoraTxTag tx;
+    frame->PeekPacketTag(tx);
+    std::vector<uint8_t> payload(frame->GetSize());
+    frame->CopyData(payload.data(), payload.size());
+
+    //wall-clock reception time, on the real-time simulator it follows the simulation clock
+    auto now = std::chrono::system_clock::now();
+    std::time_t seconds = std::chrono::system_clock::to_time_t(now);
+    long micros = long(std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch()).count() % 1000000);
+    std::tm utc;
+    gmtime_r(&seconds, &utc);
+    char time[40];
+    std::strftime(time, sizeof(time), "%Y-%m-%dT%H:%M:%S", &utc);
+
+    //thermal noise over 125 kHz plus a 6 dB noise figure
+    const double noiseDbm = -174.0 + 10.0 * std::log10(125e3) + 6.0;
+    char rxpk[512];
+    int length = std::snprintf(rxpk, sizeof(rxpk),
+                               "{\"rxpk\":[{\"time\":\"%s.%06ldZ\",\"tmst\":%u,\"chan\":%u,\"rfch\":0,\"freq\":%.6f,\"stat\":1,\"modu\":\"LORA\","
+                               "\"datr\":\"SF%uBW125\",\"codr\":\"4/5\",\"rssi\":%d,\"lsnr\":%.1f,\"size\":%u,\"data\":\"",
+                               time, micros, uint32_t(firstRx.GetMicroSeconds()), chan, tx.GetFrequency(), unsigned(tx.GetSf()),
+                               std::isnan(rssiDbm) ? 0 : int(std::lround(rssiDbm)), std::isnan(rssiDbm) ? 0.0 : rssiDbm - noiseDbm, uint32_t(payload.size()));
+
+    uint16_t token = m_token++;
+    uint64_t eui = m_gatewayEui | gateway;
+    std::string datagram;
+    datagram.reserve(12 + length + payload.size() * 4 / 3 + 8);
+    datagram.push_back(char(PROTOCOL_VERSION));
+    datagram.push_back(char(token >> 8));
+    datagram.push_back(char(token & 0xff));
+    datagram.push_back(char(PUSH_DATA));
+    for (int shift = 56; shift >= 0; shift -= 8)
+    {
+        datagram.push_back(char((eui >> shift) & 0xff));
+    }
+    datagram.append(rxpk, length);
+    datagram.append(Base64(payload.data(), payload.size()));
+    datagram.append("\"}]}");
+
+    if (send(m_fd, datagram.data(), datagram.size(), 0) < 0)
+    {
+        m_sendErrors++;
+        NS_LOG_WARN("PUSH_DATA of gateway " << gateway << " not sent: " << std::strerror(errno));
+        return;
+    }
+    m_sent++;
+    m_pending[token] = std::chrono::steady_clock::now(); //a token reused before its ack is counted as lost
+}
+
+std::string
+MultiHopLoraPacketForwarder::Base64(const uint8_t *data, uint32_t size)
+{
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string out;
+    out.reserve((size + 2) / 3 * 4);
+    for (uint32_t i = 0; i < size; i += 3)
+    {
+        uint32_t group = uint32_t(data[i]) << 16 | (i + 1 < size ? uint32_t(data[i + 1]) << 8 : 0) | (i + 2 < size ? data[i + 2] : 0);
+        out.push_back(alphabet[group >> 18 & 0x3f]);
+        out.push_back(alphabet[group >> 12 & 0x3f]);
+        out.push_back(i + 1 < size ? alphabet[group >> 6 & 0x3f] : '=');
+        out.push_back(i + 2 < size ? alphabet[group & 0x3f] : '=');
+    }
+    return out;
+}
+
+// Getters implementation
+uint64_t MultiHopLoraPacketForwarder::GetSent (void) const { return m_sent; }
+uint64_t MultiHopLoraPacketForwarder::GetSendErrors (void) const { return m_sendErrors; }
+uint64_t MultiHopLoraPacketForwarder::GetAcks (void) const { return m_acks; }
+double MultiHopLoraPacketForwarder::GetMeanAckRtt (void) const { return m_acks > 0 ? m_ackRttSum / m_acks : 0.0; }
+
+} //namespace ns3
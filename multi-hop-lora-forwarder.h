@@ -0,0 +1,60 @@
+#ifndef MULTI_HOP_LORA_FORWARDER_H
+#define MULTI_HOP_LORA_FORWARDER_H
+
+#include "ns3/object.h"
+#include "ns3/nstime.h"
+#include "ns3/packet.h"
+#include <chrono>
+#include <string>
+#include <unordered_map>
+#include <cstdint>
+
+namespace ns3 {
+
+//Semtech UDP packet-forwarder emitter, drives a real network server with the simulated uplinks
+//every uplink a gateway reports goes out as a PUSH_DATA datagram with one rxpk object, over a
+//plain UDP socket of the host. the EUI of a gateway is GatewayEui with the node ID in the low
+//32 bits. PUSH_ACKs are matched to their token to measure the network server round trip in
+//wall-clock time. run it on the real-time simulator to offer load at the simulated rate
+class MultiHopLoraPacketForwarder: public Object
+{
+public:
+    static TypeId GetTypeId(void);
+    MultiHopLoraPacketForwarder();
+    virtual ~MultiHopLoraPacketForwarder();
+
+    //frame is the best copy of the LFID at the gateway, its MultiHopLoraTxTag gives frequency and SF
+    //rssiDbm is NaN if the PHY did not tag the frame, chan is the index in the gateway's channel plan
+    void PushData(uint32_t gateway, Ptr<const Packet> frame, double rssiDbm, Time firstRx, uint32_t chan);
+
+    //Getters
+    uint64_t GetSent(void) const;
+    uint64_t GetSendErrors(void) const; //datagrams the socket refused, e.g. a full buffer
+    uint64_t GetAcks(void) const;
+    double GetMeanAckRtt(void) const; //seconds of wall-clock time
+
+protected:
+    virtual void DoDispose(void);
+
+private:
+    void Open(void);
+    void ReadAcks(void);
+    static std::string Base64(const uint8_t *data, uint32_t size);
+
+    std::string m_address;
+    uint16_t m_port;
+    uint64_t m_gatewayEui;
+
+    int m_fd; //-1 until the first datagram
+    uint16_t m_token;
+    std::unordered_map<uint16_t, std::chrono::steady_clock::time_point> m_pending; //token -> send time
+
+    uint64_t m_sent;
+    uint64_t m_sendErrors;
+    uint64_t m_acks;
+    double m_ackRttSum;
+};
+
+} //namespace ns3
+
+#endif //MULTI_HOP_LORA_FORWARDER_H
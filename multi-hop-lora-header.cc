@@ -1,12 +1,100 @@
 #include "multi-hop-lora-header.h"
+#include "multi-hop-lora-profile.h"
 #include "ns3/log.h"
 #include "ns3/assert.h"
+#include "ns3/abort.h"
 
 namespace ns3 {
 
 NS_LOG_COMPONENT_DEFINE("MultiHopLoraHeader");
 NS_OBJECT_ENSURE_REGISTERED(MultiHopLoraHeader);
 
+namespace {
+
+uint32_t
+VarintSize(uint64_t value)
+{
+    uint32_t size = 1;
+    while (value >= 0x80)
+    {
+        value >>= 7;
+        ++size;
+    }
+    return size;
+}
+
+void
+WriteVarint(Buffer::Iterator &it, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        it.WriteU8((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    it.WriteU8(value);
+}
+
+uint64_t
+ReadVarint(Buffer::Iterator &it)
+{
+    uint64_t value = 0;
+    for (uint32_t shift = 0; shift < 64; shift += 7)
+    {
+        uint8_t byte = it.ReadU8();
+        value |= uint64_t(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+        {
+            break;
+        }
+    }
+    return value;
+}
+
+uint64_t
+ZigZag(uint32_t nodeId, uint32_t previous)
+{
+    int64_t delta = int64_t(nodeId) - int64_t(previous);
+    return (uint64_t(delta) << 1) ^ uint64_t(delta >> 63);
+}
+
+uint32_t
+UnZigZag(uint64_t value, uint32_t previous)
+{
+    int64_t delta = int64_t(value >> 1) ^ -int64_t(value & 1);
+    return uint32_t(int64_t(previous) + delta);
+}
+
+uint16_t
+HashStep(uint16_t hash, uint32_t nodeId)
+{
+    uint32_t h = (hash ^ nodeId) * 2654435769u;
+    return (h >> 16) ^ (h & 0xffff);
+}
+
+//reads the prefix of either wire format, leaves the iterator at the path section
+uint32_t
+ReadPrefix(Buffer::Iterator &it, uint32_t &lfid, uint32_t &lnid, uint8_t &lpty, uint8_t &lh, uint8_t &lgw)
+{
+    Buffer::Iterator begin = it;
+    if (it.PeekU8() & MultiHopLoraHeader::LPTY_COMPACT)
+    {
+        lpty = it.ReadU8();
+        lnid = ReadVarint(it);
+        lfid = MultiHopLoraHeader::MakeLfid(lnid, it.ReadNtohU16());
+    }
+    else
+    {
+        lfid = it.ReadNtohU32();
+        lnid = it.ReadNtohU32();
+        lpty = it.ReadU8();
+    }
+    lh = it.ReadU8();
+    lgw = it.ReadU8();
+    return it.GetDistanceFrom(begin);
+}
+
+} //namespace
+
 TypeId
 MultiHopLoraHeader::GetTypeId(void)
 {
@@ -19,28 +107,80 @@ MultiHopLoraHeader::GetTypeId(void)
 }
 
 TypeId
-MultiHopLoraHeader::GetInstanceTypeId(void)
+MultiHopLoraHeader::GetInstanceTypeId(void) const
 {
     return GetTypeId();
 }
 
-// PERBAIKAN: Menginisialisasi m_path sebagai vector kosong
-MultiHopLoraHeader::MultiHopLoraHeader():m_lfid(0),m_lnid(0),m_lpty(0),m_lh(0),m_lgw(0),m_path()
+MultiHopLoraHeader::MultiHopLoraHeader():m_lfid(0),m_lnid(0),m_lpty(0),m_lh(0),m_lgw(0),m_path(),m_pathHash(0)
 {}
 
 MultiHopLoraHeader::~MultiHopLoraHeader()
 {}
 
+uint32_t
+MultiHopLoraHeader::MakeLfid(uint32_t lnid, uint16_t sequence)
+{
+    //a wider ID would share its LFIDs with the node 65536 below it
+    NS_ABORT_MSG_IF(lnid > MAX_LNID, "Node ID " << lnid << " does not fit in the 16 LNID bits of an LFID");
+    return (lnid << 16) | sequence;
+}
+
 uint32_t MultiHopLoraHeader::GetSerializedSize(void) const
 {
-    //Fixed part: lfid(4)+lnid(4)+lpty(1)+lh(1)+lgw(1)= 11 bytes
-    //Variable part: path size (1 byte for count)+ path elements(4 bytes each)
-    return 11 + 1 + m_path.size() * sizeof(uint32_t);
+    if (!IsCompact())
+    {
+        //Fixed part: lfid(4)+lnid(4)+lpty(1)+lh(1)+lgw(1)= 11 bytes
+        //Variable part: path size (1 byte for count)+ path elements(4 bytes each)
+        return PREFIX_SIZE + 1 + m_path.size() * sizeof(uint32_t);
+    }
+
+    //v2: lpty(1)+lnid(varint)+sequence(2)+lh(1)+lgw(1)
+    uint32_t size = 1 + VarintSize(m_lnid) + 2 + 1 + 1;
+    if (IsPathHashOnly())
+    {
+        return size + 2;
+    }
+    size += 1;
+    uint32_t previous = m_lnid;
+    for (uint32_t nodeId : m_path)
+    {
+        size += VarintSize(ZigZag(nodeId, previous));
+        previous = nodeId;
+    }
+    return size;
 }
 
 void
 MultiHopLoraHeader::Serialize(Buffer::Iterator start) const
 {
+    MULTI_HOP_LORA_PROFILE(HEADER_SERIALIZE);
+    if (IsCompact())
+    {
+        NS_ASSERT_MSG(m_lfid == MakeLfid(m_lnid, m_lfid & 0xffff), "v2 header needs an LFID built with MakeLfid");
+        start.WriteU8(m_lpty);
+        WriteVarint(start, m_lnid);
+        start.WriteHtonU16(m_lfid & 0xffff);
+        start.WriteU8(m_lh);
+        start.WriteU8(m_lgw);
+        if (IsPathHashOnly())
+        {
+            start.WriteHtonU16(m_pathHash);
+            return;
+        }
+        //path IDs are zigzag deltas from the previous hop, neighbours usually have close IDs
+        start.WriteU8(m_path.size());
+        uint32_t previous = m_lnid;
+        for (uint32_t nodeId : m_path)
+        {
+            WriteVarint(start, ZigZag(nodeId, previous));
+            previous = nodeId;
+        }
+        return;
+    }
+
+    //a set top bit would read back as a v2 frame
+    NS_ABORT_MSG_IF(m_lfid & 0x80000000, "v1 header needs a node ID below 0x8000, LFID " << m_lfid);
     start.WriteHtonU32(m_lfid);
     start.WriteHtonU32(m_lnid);
     start.WriteU8(m_lpty);
@@ -59,31 +199,51 @@ MultiHopLoraHeader::Serialize(Buffer::Iterator start) const
 uint32_t
 MultiHopLoraHeader::Deserialize(Buffer::Iterator start)
 {
+    MULTI_HOP_LORA_PROFILE(HEADER_DESERIALIZE);
+    Buffer::Iterator begin = start;
+    m_path.clear();
+    m_pathHash = 0;
+
     // Must read the fixed part first to determine the variable part's size
-    m_lfid = start.ReadNtohU32();
-    m_lnid = start.ReadNtohU32();
-    m_lpty = start.ReadU8();
-    m_lh = start.ReadU8();
-    m_lgw = start.ReadU8();
+    uint32_t bytesConsumed = ReadPrefix(start, m_lfid, m_lnid, m_lpty, m_lh, m_lgw);
+
+    if (IsPathHashOnly())
+    {
+        m_pathHash = start.ReadNtohU16();
+        return bytesConsumed + 2;
+    }
 
     //deserialize the path vector
-    m_path.clear();
     uint8_t pathSize = start.ReadU8();
+    uint32_t previous = m_lnid;
     for(uint8_t i = 0; i < pathSize; ++i)
     {
-        m_path.push_back(start.ReadNtohU32());
+        uint32_t nodeId = IsCompact() ? UnZigZag(ReadVarint(start), previous) : start.ReadNtohU32();
+        previous = nodeId;
+        if (m_path.full())
+        {
+            //longer than this build can hold, skip the rest but still consume it
+            NS_LOG_WARN("Path of LFID " << m_lfid << " truncated to " << (int)Path::CAPACITY << " entries");
+            continue;
+        }
+        m_path.push_back(nodeId);
+        m_pathHash = HashStep(m_pathHash, nodeId);
     }
 
-    uint32_t bytesConsumed = 11 + 1 + pathSize * sizeof(uint32_t);
-    return bytesConsumed;
+    return start.GetDistanceFrom(begin);
 }
 
 void
 MultiHopLoraHeader::Print (std::ostream &os) const
 {
-    os << "LFId=" << m_lfid << ", LNId=" << m_lnid << ", LH=" << (int)m_lh << ", LGw=" << (int)m_lgw;
+    os << "LFId=" << m_lfid << ", LNId=" << m_lnid << ", LH=" << (int)m_lh << ", LGw=" << (int)m_lgw << ", SF=" << (int)GetSf();
+    if (IsPathHashOnly())
+    {
+        os << ", PathHash=0x" << std::hex << m_pathHash << std::dec;
+        return;
+    }
     os << ", Path=[";
-    for (size_t i = 0; i < m_path.size(); ++i)
+    for (uint8_t i = 0; i < m_path.size(); ++i)
     {
         os << m_path[i] << (i == m_path.size() - 1? "" : ",");
     }
@@ -96,7 +256,17 @@ void MultiHopLoraHeader::SetLnid (uint32_t lnid) { m_lnid = lnid; }
 void MultiHopLoraHeader::SetLpty (uint8_t lpty) { m_lpty = lpty; }
 void MultiHopLoraHeader::SetLh (uint8_t lh) { m_lh = lh; }
 void MultiHopLoraHeader::SetLgw (uint8_t lgw) { m_lgw = lgw; }
-void MultiHopLoraHeader::AddNodeToPath (uint32_t nodeId) { m_path.push_back(nodeId); }
+void MultiHopLoraHeader::SetSf (uint8_t sf)
+{
+    NS_ASSERT_MSG(sf >= 7 && sf <= 12, "Unsupported spreading factor " << (int)sf);
+    m_lpty = (m_lpty & ~LPTY_SF_MASK) | ((sf - 7) << LPTY_SF_SHIFT);
+}
+void MultiHopLoraHeader::AddNodeToPath (uint32_t nodeId)
+{
+    NS_ASSERT_MSG(!m_path.full(), "Path capacity " << (int)Path::CAPACITY << " exceeded");
+    m_path.push_back(nodeId);
+    m_pathHash = HashStep(m_pathHash, nodeId);
+}
 
 // Getters implementation
 uint32_t MultiHopLoraHeader::GetLfid (void) const { return m_lfid; }
@@ -104,7 +274,281 @@ uint32_t MultiHopLoraHeader::GetLnid (void) const { return m_lnid; }
 uint8_t MultiHopLoraHeader::GetLpty (void) const { return m_lpty; }
 uint8_t MultiHopLoraHeader::GetLh (void) const { return m_lh; }
 uint8_t MultiHopLoraHeader::GetLgw (void) const { return m_lgw; }
-const std::vector<uint32_t>& MultiHopLoraHeader::GetPath (void) const { return m_path; }
+const MultiHopLoraHeader::Path& MultiHopLoraHeader::GetPath (void) const { return m_path; }
+uint16_t MultiHopLoraHeader::GetPathHash (void) const { return m_pathHash; }
+uint8_t MultiHopLoraHeader::GetPacketType (void) const { return m_lpty & LPTY_TYPE_MASK; }
+uint8_t MultiHopLoraHeader::GetSf (void) const { return 7 + ((m_lpty & LPTY_SF_MASK) >> LPTY_SF_SHIFT); }
+bool MultiHopLoraHeader::IsCompact (void) const { return m_lpty & LPTY_COMPACT; }
+bool MultiHopLoraHeader::IsPathHashOnly (void) const { return (m_lpty & LPTY_COMPACT) && (m_lpty & LPTY_PATH_HASH); }
+
+NS_OBJECT_ENSURE_REGISTERED(MultiHopLoraPrefixHeader);
+
+TypeId
+MultiHopLoraPrefixHeader::GetTypeId(void)
+{
+    static TypeId tid = TypeId("ns3::MultiHopLoraPrefixHeader")
+    .SetParent<Header>()
+    .SetGroupName("lorawan")
+    .AddConstructor<MultiHopLoraPrefixHeader>()
+    ;
+    return tid;
+}
+
+TypeId
+MultiHopLoraPrefixHeader::GetInstanceTypeId(void) const
+{
+    return GetTypeId();
+}
+
+MultiHopLoraPrefixHeader::MultiHopLoraPrefixHeader():m_lfid(0),m_lnid(0),m_lpty(0),m_lh(0),m_lgw(0),m_size(MultiHopLoraHeader::PREFIX_SIZE)
+{}
+
+MultiHopLoraPrefixHeader::~MultiHopLoraPrefixHeader()
+{}
+
+uint32_t MultiHopLoraPrefixHeader::GetSerializedSize(void) const
+{
+    return m_size;
+}
+
+void
+MultiHopLoraPrefixHeader::Serialize(Buffer::Iterator) const
+{
+    //a prefix alone is not a valid frame, build a MultiHopLoraHeader to send
+    NS_FATAL_ERROR("MultiHopLoraPrefixHeader is peek-only and cannot be serialized");
+}
+
+uint32_t
+MultiHopLoraPrefixHeader::Deserialize(Buffer::Iterator start)
+{
+    MULTI_HOP_LORA_PROFILE(PREFIX_DESERIALIZE);
+    m_size = ReadPrefix(start, m_lfid, m_lnid, m_lpty, m_lh, m_lgw);
+    return m_size;
+}
+
+void
+MultiHopLoraPrefixHeader::Print (std::ostream &os) const
+{
+    os << "LFId=" << m_lfid << ", LNId=" << m_lnid << ", LH=" << (int)m_lh << ", LGw=" << (int)m_lgw << ", SF=" << (int)GetSf();
+}
+
+uint32_t MultiHopLoraPrefixHeader::GetLfid (void) const { return m_lfid; }
+uint32_t MultiHopLoraPrefixHeader::GetLnid (void) const { return m_lnid; }
+uint8_t MultiHopLoraPrefixHeader::GetLpty (void) const { return m_lpty; }
+uint8_t MultiHopLoraPrefixHeader::GetLh (void) const { return m_lh; }
+uint8_t MultiHopLoraPrefixHeader::GetLgw (void) const { return m_lgw; }
+uint8_t MultiHopLoraPrefixHeader::GetSf (void) const { return 7 + ((m_lpty & MultiHopLoraHeader::LPTY_SF_MASK) >> MultiHopLoraHeader::LPTY_SF_SHIFT); }
+
+NS_OBJECT_ENSURE_REGISTERED(MultiHopLoraAggregateHeader);
+
+TypeId
+MultiHopLoraAggregateHeader::GetTypeId(void)
+{
+    static TypeId tid = TypeId("ns3::MultiHopLoraAggregateHeader")
+    .SetParent<Header>()
+    .SetGroupName("lorawan")
+    .AddConstructor<MultiHopLoraAggregateHeader>()
+    ;
+    return tid;
+}
+
+TypeId
+MultiHopLoraAggregateHeader::GetInstanceTypeId(void) const
+{
+    return GetTypeId();
+}
+
+MultiHopLoraAggregateHeader::MultiHopLoraAggregateHeader():m_count(0)
+{}
+
+MultiHopLoraAggregateHeader::~MultiHopLoraAggregateHeader()
+{}
+
+bool
+MultiHopLoraAggregateHeader::IsAggregate(Ptr<const Packet> packet)
+{
+    uint8_t first = 0;
+    return packet->CopyData(&first, 1) == 1 && first == MARKER;
+}
+
+uint32_t MultiHopLoraAggregateHeader::GetSerializedSize(void) const
+{
+    return 2 + m_count;
+}
+
+void
+MultiHopLoraAggregateHeader::Serialize(Buffer::Iterator start) const
+{
+    start.WriteU8(MARKER);
+    start.WriteU8(m_count);
+    for (uint8_t i = 0; i < m_count; ++i)
+    {
+        start.WriteU8(m_sizes[i]);
+    }
+}
+
+uint32_t
+MultiHopLoraAggregateHeader::Deserialize(Buffer::Iterator start)
+{
+    if (start.ReadU8() != MARKER)
+    {
+        m_count = 0; //callers check IsAggregate first
+        return 1;
+    }
+    m_count = start.ReadU8();
+    for (uint8_t i = 0; i < m_count; ++i)
+    {
+        m_sizes[i] = start.ReadU8();
+    }
+    return GetSerializedSize();
+}
+
+void
+MultiHopLoraAggregateHeader::Print (std::ostream &os) const
+{
+    os << "Entries=" << (int)m_count << ", Sizes=";
+    for (uint8_t i = 0; i < m_count; ++i)
+    {
+        os << (i ? "," : "") << (int)m_sizes[i];
+    }
+}
+
+void
+MultiHopLoraAggregateHeader::AddEntry(uint32_t size)
+{
+    NS_ASSERT_MSG(m_count < MAX_ENTRIES && size > 0 && size <= MAX_ENTRY_SIZE, "Cannot add an entry of " << size << " bytes");
+    m_sizes[m_count++] = uint8_t(size);
+}
+
+uint8_t MultiHopLoraAggregateHeader::GetNEntries (void) const { return m_count; }
+uint32_t MultiHopLoraAggregateHeader::GetEntrySize (uint8_t i) const { return m_sizes[i]; }
+
+NS_OBJECT_ENSURE_REGISTERED(MultiHopLoraBeaconHeader);
+
+TypeId
+MultiHopLoraBeaconHeader::GetTypeId(void)
+{
+    static TypeId tid = TypeId("ns3::MultiHopLoraBeaconHeader")
+    .SetParent<Header>()
+    .SetGroupName("lorawan")
+    .AddConstructor<MultiHopLoraBeaconHeader>()
+    ;
+    return tid;
+}
+
+TypeId
+MultiHopLoraBeaconHeader::GetInstanceTypeId(void) const
+{
+    return GetTypeId();
+}
+
+MultiHopLoraBeaconHeader::MultiHopLoraBeaconHeader():m_sender(0),m_lgw(255),m_seq(0),m_sf(7)
+{}
+
+MultiHopLoraBeaconHeader::~MultiHopLoraBeaconHeader()
+{}
+
+bool
+MultiHopLoraBeaconHeader::IsBeacon(Ptr<const Packet> packet)
+{
+    const uint8_t mask = MultiHopLoraHeader::LPTY_COMPACT | MultiHopLoraHeader::LPTY_TYPE_MASK;
+    uint8_t first = 0;
+    return packet->CopyData(&first, 1) == 1 && (first & mask) == (MultiHopLoraHeader::LPTY_COMPACT | MultiHopLoraHeader::LPTY_BEACON);
+}
+
+uint32_t MultiHopLoraBeaconHeader::GetSerializedSize(void) const
+{
+    return 4 + VarintSize(m_sender);
+}
+
+void
+MultiHopLoraBeaconHeader::Serialize(Buffer::Iterator start) const
+{
+    start.WriteU8(MultiHopLoraHeader::LPTY_COMPACT | MultiHopLoraHeader::LPTY_BEACON | ((m_sf - 7) << MultiHopLoraHeader::LPTY_SF_SHIFT));
+    start.WriteU8(m_lgw);
+    start.WriteHtonU16(m_seq);
+    WriteVarint(start, m_sender);
+}
+
+uint32_t
+MultiHopLoraBeaconHeader::Deserialize(Buffer::Iterator start)
+{
+    uint8_t lpty = start.ReadU8();
+    m_sf = 7 + ((lpty & MultiHopLoraHeader::LPTY_SF_MASK) >> MultiHopLoraHeader::LPTY_SF_SHIFT);
+    m_lgw = start.ReadU8();
+    m_seq = start.ReadNtohU16();
+    m_sender = ReadVarint(start);
+    return GetSerializedSize();
+}
+
+void
+MultiHopLoraBeaconHeader::Print (std::ostream &os) const
+{
+    os << "Sender=" << m_sender << ", LGw=" << (int)m_lgw << ", Seq=" << m_seq << ", SF=" << (int)m_sf;
+}
+
+void MultiHopLoraBeaconHeader::SetSender (uint32_t sender) { m_sender = sender; }
+void MultiHopLoraBeaconHeader::SetLgw (uint8_t lgw) { m_lgw = lgw; }
+void MultiHopLoraBeaconHeader::SetSeq (uint16_t seq) { m_seq = seq; }
+void MultiHopLoraBeaconHeader::SetSf (uint8_t sf) { m_sf = sf; }
+
+uint32_t MultiHopLoraBeaconHeader::GetSender (void) const { return m_sender; }
+uint8_t MultiHopLoraBeaconHeader::GetLgw (void) const { return m_lgw; }
+uint16_t MultiHopLoraBeaconHeader::GetSeq (void) const { return m_seq; }
+uint8_t MultiHopLoraBeaconHeader::GetSf (void) const { return m_sf; }
+
+NS_OBJECT_ENSURE_REGISTERED(MultiHopLoraTxTag);
+
+TypeId
+MultiHopLoraTxTag::GetTypeId(void)
+{
+    static TypeId tid = TypeId("ns3::MultiHopLoraTxTag")
+    .SetParent<Tag>()
+    .SetGroupName("lorawan")
+    .AddConstructor<MultiHopLoraTxTag>()
+    ;
+    return tid;
+}
+
+TypeId
+MultiHopLoraTxTag::GetInstanceTypeId(void) const
+{
+    return GetTypeId();
+}
+
+MultiHopLoraTxTag::MultiHopLoraTxTag(double frequencyMHz, uint8_t sf):m_frequencyMHz(frequencyMHz),m_sf(sf)
+{}
+
+MultiHopLoraTxTag::~MultiHopLoraTxTag()
+{}
+
+uint32_t MultiHopLoraTxTag::GetSerializedSize(void) const
+{
+    return 9;
+}
+
+void
+MultiHopLoraTxTag::Serialize(TagBuffer i) const
+{
+    i.WriteDouble(m_frequencyMHz);
+    i.WriteU8(m_sf);
+}
+
+void
+MultiHopLoraTxTag::Deserialize(TagBuffer i)
+{
+    m_frequencyMHz = i.ReadDouble();
+    m_sf = i.ReadU8();
+}
+
+void
+MultiHopLoraTxTag::Print (std::ostream &os) const
+{
+    os << "Frequency=" << m_frequencyMHz << "MHz, SF=" << (int)m_sf;
+}
+
+double MultiHopLoraTxTag::GetFrequency (void) const { return m_frequencyMHz; }
+uint8_t MultiHopLoraTxTag::GetSf (void) const { return m_sf; }
 
 } // namespace ns3
 // PERBAIKAN: Menghapus kurung kurawal berlebih
\ No newline at end of file
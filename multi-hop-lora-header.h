@@ -2,14 +2,84 @@
 #define MULTI_HOP_LORA_HEADER_H
 
 #include "ns3/header.h"
-#include <vector>
+#include "ns3/tag.h"
+#include "ns3/packet.h"
 #include <cstdint>
 
+//maximum number of node IDs a header can carry, override with -DMULTI_HOP_LORA_PATH_CAPACITY=N
+#ifndef MULTI_HOP_LORA_PATH_CAPACITY
+#define MULTI_HOP_LORA_PATH_CAPACITY 10
+#endif
+
 namespace ns3 {
 
+//fixed-capacity inline path storage, keeps header (de)serialization free of heap allocation
+template <uint8_t N>
+class MultiHopLoraPath
+{
+public:
+    static const uint8_t CAPACITY = N;
+
+    MultiHopLoraPath():m_size(0) {}
+
+    void push_back(uint32_t nodeId) { m_nodes[m_size++] = nodeId; }
+    void clear(void) { m_size = 0; }
+
+    uint8_t size(void) const { return m_size; }
+    bool empty(void) const { return m_size == 0; }
+    bool full(void) const { return m_size == N; }
+    uint32_t operator[](uint8_t i) const { return m_nodes[i]; }
+    const uint32_t* begin(void) const { return m_nodes; }
+    const uint32_t* end(void) const { return m_nodes + m_size; }
+
+    bool operator==(const MultiHopLoraPath &other) const
+    {
+        if (m_size != other.m_size)
+        {
+            return false;
+        }
+        for (uint8_t i = 0; i < m_size; ++i)
+        {
+            if (m_nodes[i] != other.m_nodes[i])
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+    bool operator!=(const MultiHopLoraPath &other) const { return !(*this == other); }
+
+private:
+    uint32_t m_nodes[N];
+    uint8_t m_size;
+};
+
 class MultiHopLoraHeader: public Header
 {
 public:
+    typedef MultiHopLoraPath<MULTI_HOP_LORA_PATH_CAPACITY> Path;
+
+    //v1 prefix: lfid(4)+lnid(4)+lpty(1)+lh(1)+lgw(1)
+    static const uint32_t PREFIX_SIZE = 11;
+
+    //LPTY layout: low 3 bits are the packet type, bits 3-5 the spreading factor of the hop
+    //that sent the frame (SF - 7, so frames without it read as SF7), the high bits select the wire format.
+    //v1 frames start with the LFID whose top byte is nodeId >> 8, so v1 sources must have
+    //node IDs below 0x8000 for the v2 marker in the first byte to be unambiguous.
+    static const uint8_t LPTY_DATA = 0x01;
+    static const uint8_t LPTY_AGGREGATE = 0x02; //always sent with LPTY_COMPACT, see MultiHopLoraAggregateHeader
+    static const uint8_t LPTY_BEACON = 0x03; //always sent with LPTY_COMPACT, see MultiHopLoraBeaconHeader
+    static const uint8_t LPTY_TYPE_MASK = 0x07;
+    static const uint8_t LPTY_SF_MASK = 0x38;
+    static const uint8_t LPTY_SF_SHIFT = 3;
+    static const uint8_t LPTY_COMPACT = 0x80; //v2: lpty first, varint LNID, 16-bit sequence, delta-coded path
+    static const uint8_t LPTY_PATH_HASH = 0x40; //v2 only: 16-bit path hash instead of the node list
+
+    //v2 carries a per-source sequence number, the LFID is rebuilt from (LNID, sequence)
+    //the LNID takes the upper 16 bits, so it must not exceed MAX_LNID
+    static uint32_t MakeLfid(uint32_t lnid, uint16_t sequence);
+    static const uint32_t MAX_LNID = 0xffff;
+
     MultiHopLoraHeader();
     virtual ~MultiHopLoraHeader();
 
@@ -26,6 +96,7 @@ public:
     void SetLpty(uint8_t lpty); // PERBAIKAN: Mengganti nama dari SetLpth menjadi SetLpty
     void SetLh(uint8_t lh);
     void SetLgw(uint8_t lgw);
+    void SetSf(uint8_t sf); //rewritten by every hop, like LH and LGw
     void AddNodeToPath(uint32_t nodeId);
 
     //Getters
@@ -34,7 +105,12 @@ public:
     uint8_t GetLpty(void) const;
     uint8_t GetLh(void) const;
     uint8_t GetLgw(void) const;
-    const std::vector<uint32_t>& GetPath(void) const;
+    const Path& GetPath(void) const; //empty on received path-hash frames
+    uint16_t GetPathHash(void) const;
+    uint8_t GetPacketType(void) const;
+    uint8_t GetSf(void) const;
+    bool IsCompact(void) const;
+    bool IsPathHashOnly(void) const;
 
 private:
     uint32_t m_lfid; //packet ID
@@ -42,7 +118,137 @@ private:
     uint8_t m_lpty; //packet type
     uint8_t m_lh; //hop count
     uint8_t m_lgw; //Distance to Gateway of the last hop
-    std::vector<uint32_t> m_path; // PERBAIKAN: Mengganti tipe data dari uint32_t menjadi vector
+    Path m_path;
+    uint16_t m_pathHash; //rolling hash over every node added to the path
+};
+
+//peek-only view of the header prefix (LFID/LNID/LPTY/LH/LGW) in either wire format
+//for callers that do not need the path, it never touches the variable part
+class MultiHopLoraPrefixHeader: public Header
+{
+public:
+    MultiHopLoraPrefixHeader();
+    virtual ~MultiHopLoraPrefixHeader();
+
+    static TypeId GetTypeId(void);
+    virtual TypeId GetInstanceTypeId(void) const;
+    virtual uint32_t GetSerializedSize(void) const;
+    virtual void Serialize(Buffer::Iterator start) const;
+    virtual uint32_t Deserialize(Buffer::Iterator start);
+    virtual void Print(std::ostream &os) const;
+
+    //Getters
+    uint32_t GetLfid(void) const;
+    uint32_t GetLnid(void) const;
+    uint8_t GetLpty(void) const;
+    uint8_t GetLh(void) const;
+    uint8_t GetLgw(void) const;
+    uint8_t GetSf(void) const;
+
+private:
+    uint32_t m_lfid;
+    uint32_t m_lnid;
+    uint8_t m_lpty;
+    uint8_t m_lh;
+    uint8_t m_lgw;
+    uint32_t m_size; //prefix bytes consumed by the last Deserialize
+};
+
+//outer header of a frame that bundles several forwarded frames
+//layout: lpty(1) = LPTY_COMPACT | LPTY_AGGREGATE, count(1), length(1) per entry, then the
+//entries back to back. every entry is a complete frame (multi-hop header and payload)
+class MultiHopLoraAggregateHeader: public Header
+{
+public:
+    static const uint8_t MARKER = MultiHopLoraHeader::LPTY_COMPACT | MultiHopLoraHeader::LPTY_AGGREGATE;
+    static const uint8_t MAX_ENTRIES = 255;
+    static const uint32_t MAX_ENTRY_SIZE = 255;
+
+    MultiHopLoraAggregateHeader();
+    virtual ~MultiHopLoraAggregateHeader();
+
+    static TypeId GetTypeId(void);
+    virtual TypeId GetInstanceTypeId(void) const;
+    virtual uint32_t GetSerializedSize(void) const;
+    virtual void Serialize(Buffer::Iterator start) const;
+    virtual uint32_t Deserialize(Buffer::Iterator start);
+    virtual void Print(std::ostream &os) const;
+
+    //true if the frame starts with the aggregate marker
+    static bool IsAggregate(Ptr<const Packet> packet);
+
+    void AddEntry(uint32_t size);
+
+    //Getters
+    uint8_t GetNEntries(void) const;
+    uint32_t GetEntrySize(uint8_t i) const;
+
+private:
+    uint8_t m_count;
+    uint8_t m_sizes[MAX_ENTRIES];
+};
+
+//gradient beacon, announces the sender's LGw to its neighbours
+//layout: lpty(1) = LPTY_COMPACT | LPTY_BEACON | SF bits, lgw(1), seq(2), sender(varint)
+//seq is the epoch of the gateway flood the beacon belongs to
+class MultiHopLoraBeaconHeader: public Header
+{
+public:
+    MultiHopLoraBeaconHeader();
+    virtual ~MultiHopLoraBeaconHeader();
+
+    static TypeId GetTypeId(void);
+    virtual TypeId GetInstanceTypeId(void) const;
+    virtual uint32_t GetSerializedSize(void) const;
+    virtual void Serialize(Buffer::Iterator start) const;
+    virtual uint32_t Deserialize(Buffer::Iterator start);
+    virtual void Print(std::ostream &os) const;
+
+    //true if the frame starts with a beacon LPTY, whatever its SF bits
+    static bool IsBeacon(Ptr<const Packet> packet);
+
+    //Setters
+    void SetSender(uint32_t sender);
+    void SetLgw(uint8_t lgw);
+    void SetSeq(uint16_t seq);
+    void SetSf(uint8_t sf);
+
+    //Getters
+    uint32_t GetSender(void) const;
+    uint8_t GetLgw(void) const;
+    uint16_t GetSeq(void) const;
+    uint8_t GetSf(void) const;
+
+private:
+    uint32_t m_sender;
+    uint8_t m_lgw;
+    uint16_t m_seq;
+    uint8_t m_sf;
+};
+
+//radio parameters the app chose for a frame, attached when it is queued for transmission
+//a PHY or channel that supports several channels and spreading factors reads it, receivers
+//use it to ignore frames sent on a channel they are not tuned to
+class MultiHopLoraTxTag: public Tag
+{
+public:
+    MultiHopLoraTxTag(double frequencyMHz = 868.1, uint8_t sf = 7);
+    virtual ~MultiHopLoraTxTag();
+
+    static TypeId GetTypeId(void);
+    virtual TypeId GetInstanceTypeId(void) const;
+    virtual uint32_t GetSerializedSize(void) const;
+    virtual void Serialize(TagBuffer i) const;
+    virtual void Deserialize(TagBuffer i);
+    virtual void Print(std::ostream &os) const;
+
+    //Getters
+    double GetFrequency(void) const;
+    uint8_t GetSf(void) const;
+
+private:
+    double m_frequencyMHz;
+    uint8_t m_sf;
 };
 
 } //namespace ns3
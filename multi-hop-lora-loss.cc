@@ -0,0 +1,264 @@
+#include "multi-hop-lora-loss.h"
+#include "ns3/log.h"
+#include "ns3/assert.h"
+#include "ns3/uinteger.h"
+#include "ns3/node.h"
+#include "ns3/callback.h"
+#include "ns3/double.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <thread>
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE("MultiHopLoraCachedLossModel");
+NS_OBJECT_ENSURE_REGISTERED(MultiHopLoraCachedLossModel);
+
+TypeId
+MultiHopLoraCachedLossModel::GetTypeId(void)
+{
+    static TypeId tid = TypeId("ns3::MultiHopLoraCachedLossModel")
+    .SetParent<PropagationLossModel>()
+    .SetGroupName("lorawan")
+    .AddConstructor<MultiHopLoraCachedLossModel>()
+    .AddAttribute("DenseLimit",
+                  "Largest node count Prefill lays out as a dense matrix (8 bytes per pair), above it pairs go to a hash map",
+                  UintegerValue(2048),
+                  MakeUintegerAccessor(&MultiHopLoraCachedLossModel::m_denseLimit),
+                  MakeUintegerChecker<uint32_t>())
+    ;
+    return tid;
+}
+
+MultiHopLoraCachedLossModel::MultiHopLoraCachedLossModel():m_denseLimit(2048),m_denseSize(0),m_hits(0),m_misses(0),m_invalidations(0)
+{}
+
+MultiHopLoraCachedLossModel::MultiHopLoraCachedLossModel(Ptr<PropagationLossModel> loss)
+    :m_loss(loss),m_denseLimit(2048),m_denseSize(0),m_hits(0),m_misses(0),m_invalidations(0)
+{}
+
+MultiHopLoraCachedLossModel::~MultiHopLoraCachedLossModel()
+{}
+
+void
+MultiHopLoraCachedLossModel::SetLossModel(Ptr<PropagationLossModel> loss)
+{
+    m_loss = loss;
+    //nothing cached so far belongs to the new model
+    std::fill(m_matrix.begin(), m_matrix.end(), std::numeric_limits<double>::quiet_NaN());
+    m_sparse.clear();
+}
+
+Ptr<PropagationLossModel>
+MultiHopLoraCachedLossModel::GetLossModel(void) const
+{
+    return m_loss;
+}
+
+void
+MultiHopLoraCachedLossModel::Prefill(const NodeContainer &nodes, uint32_t threads)
+{
+    NS_ASSERT_MSG(m_loss, "No propagation loss model to cache");
+    for (uint32_t i = 0; i < nodes.GetN(); ++i)
+    {
+        Ptr<MobilityModel> mobility = nodes.Get(i)->GetObject<MobilityModel>();
+        NS_ASSERT_MSG(mobility, "Node " << nodes.Get(i)->GetId() << " has no mobility model");
+        GetIndex(mobility);
+    }
+
+    uint32_t n = m_mobility.size();
+    if (n > m_denseLimit)
+    {
+        NS_LOG_INFO("Caching path loss of " << n << " nodes in a hash map");
+        return;
+    }
+
+    //pairs cached before the layout is chosen are moved into the matrix
+    m_denseSize = n;
+    m_matrix.assign(uint64_t(n) * n, std::numeric_limits<double>::quiet_NaN());
+    for (const auto &entry : m_sparse)
+    {
+        uint32_t tx = entry.first >> 32;
+        uint32_t rx = entry.first & 0xffffffff;
+        m_matrix[uint64_t(tx) * n + rx] = entry.second;
+    }
+    m_sparse.clear();
+    NS_LOG_INFO("Caching path loss of " << n << " nodes in a " << m_matrix.size() * sizeof(double) / 1024 << " KiB matrix");
+    if (threads == 0)
+    {
+        return;
+    }
+
+    //ns-3 objects are not thread-safe, not even the reference counts of a Ptr, so worker threads
+    //only see copied positions and evaluate the LogDistance formula themselves
+    bool logDistance = m_loss->GetInstanceTypeId() == LogDistancePropagationLossModel::GetTypeId() && !m_loss->GetNext();
+    if (threads > 1 && !logDistance)
+    {
+        NS_LOG_WARN("Only a lone LogDistance model is prefilled in parallel, filling on one thread");
+        threads = 1;
+    }
+    if (threads == 1)
+    {
+        for (uint32_t tx = 0; tx < n; ++tx)
+        {
+            for (uint32_t rx = 0; rx < n; ++rx)
+            {
+                double &slot = m_matrix[uint64_t(tx) * n + rx];
+                if (tx != rx && std::isnan(slot))
+                {
+                    slot = -m_loss->CalcRxPower(0.0, m_mobility[tx], m_mobility[rx]);
+                }
+            }
+        }
+        m_misses += uint64_t(n) * (n - 1);
+        return;
+    }
+
+    std::vector<Vector> positions;
+    for (const Ptr<MobilityModel> &mobility : m_mobility)
+    {
+        positions.push_back(mobility->GetPosition());
+    }
+    DoubleValue referenceDistance;
+    DoubleValue referenceLoss;
+    m_loss->GetAttribute("ReferenceDistance", referenceDistance);
+    m_loss->GetAttribute("ReferenceLoss", referenceLoss);
+    double exponent = DynamicCast<LogDistancePropagationLossModel>(m_loss)->GetPathLossExponent();
+    double d0 = referenceDistance.Get();
+    double l0 = referenceLoss.Get();
+
+    //rows are dealt round-robin, every thread writes its own rows only
+    auto fillRows = [this, n, threads, &positions, exponent, d0, l0](uint32_t first) {
+        for (uint32_t tx = first; tx < n; tx += threads)
+        {
+            for (uint32_t rx = 0; rx < n; ++rx)
+            {
+                double &slot = m_matrix[uint64_t(tx) * n + rx];
+                if (tx != rx && std::isnan(slot))
+                {
+                    double distance = CalculateDistance(positions[tx], positions[rx]);
+                    slot = distance <= d0 ? l0 : l0 + 10 * exponent * std::log10(distance / d0);
+                }
+            }
+        }
+    };
+    std::vector<std::thread> workers;
+    for (uint32_t t = 1; t < threads; ++t)
+    {
+        workers.push_back(std::thread(fillRows, t));
+    }
+    fillRows(0);
+    for (std::thread &worker : workers)
+    {
+        worker.join();
+    }
+    m_misses += uint64_t(n) * (n - 1);
+}
+
+double
+MultiHopLoraCachedLossModel::DoCalcRxPower(double txPowerDbm, Ptr<MobilityModel> a, Ptr<MobilityModel> b) const
+{
+    double *loss = Lookup(GetIndex(a), GetIndex(b));
+    if (std::isnan(*loss))
+    {
+        m_misses++;
+        *loss = txPowerDbm - m_loss->CalcRxPower(txPowerDbm, a, b);
+    }
+    else
+    {
+        m_hits++;
+    }
+    return txPowerDbm - *loss;
+}
+
+int64_t
+MultiHopLoraCachedLossModel::DoAssignStreams(int64_t stream)
+{
+    return m_loss ? m_loss->AssignStreams(stream) : 0;
+}
+
+uint32_t
+MultiHopLoraCachedLossModel::GetIndex(Ptr<MobilityModel> mobility) const
+{
+    auto it = m_index.find(PeekPointer(mobility));
+    if (it != m_index.end())
+    {
+        return it->second;
+    }
+    uint32_t index = m_mobility.size();
+    m_index[PeekPointer(mobility)] = index;
+    m_mobility.push_back(mobility);
+    //the callback only touches the cache, which is logically mutable
+    MultiHopLoraCachedLossModel *self = const_cast<MultiHopLoraCachedLossModel *>(this);
+    mobility->TraceConnectWithoutContext("CourseChange", MakeCallback(&MultiHopLoraCachedLossModel::CourseChanged, self));
+    return index;
+}
+
+double *
+MultiHopLoraCachedLossModel::Lookup(uint32_t tx, uint32_t rx) const
+{
+    if (tx < m_denseSize && rx < m_denseSize)
+    {
+        return &m_matrix[uint64_t(tx) * m_denseSize + rx];
+    }
+    //unordered_map never moves its elements, the pointer stays valid
+    return &m_sparse.emplace(uint64_t(tx) << 32 | rx, std::numeric_limits<double>::quiet_NaN()).first->second;
+}
+
+void
+MultiHopLoraCachedLossModel::CourseChanged(Ptr<const MobilityModel> mobility)
+{
+    auto it = m_index.find(PeekPointer(mobility));
+    if (it == m_index.end())
+    {
+        return;
+    }
+    uint32_t index = it->second;
+    m_invalidations++;
+
+    const double unknown = std::numeric_limits<double>::quiet_NaN();
+    if (index < m_denseSize)
+    {
+        for (uint32_t other = 0; other < m_denseSize; ++other)
+        {
+            m_matrix[uint64_t(index) * m_denseSize + other] = unknown;
+            m_matrix[uint64_t(other) * m_denseSize + index] = unknown;
+        }
+    }
+    //moves are rare in the deployments this is for, a scan is good enough
+    for (auto entry = m_sparse.begin(); entry != m_sparse.end();)
+    {
+        if ((entry->first >> 32) == index || (entry->first & 0xffffffff) == index)
+        {
+            entry = m_sparse.erase(entry);
+        }
+        else
+        {
+            ++entry;
+        }
+    }
+}
+
+// Getters implementation
+uint64_t MultiHopLoraCachedLossModel::GetHits (void) const { return m_hits; }
+uint64_t MultiHopLoraCachedLossModel::GetMisses (void) const { return m_misses; }
+uint64_t MultiHopLoraCachedLossModel::GetInvalidations (void) const { return m_invalidations; }
+bool MultiHopLoraCachedLossModel::IsDense (void) const { return m_denseSize > 0; }
+
+uint64_t
+MultiHopLoraCachedLossModel::GetEntries(void) const
+{
+    uint64_t entries = 0;
+    for (double loss : m_matrix)
+    {
+        entries += !std::isnan(loss);
+    }
+    for (const auto &entry : m_sparse)
+    {
+        entries += !std::isnan(entry.second);
+    }
+    return entries;
+}
+
+} //namespace ns3
@@ -0,0 +1,66 @@
+#ifndef MULTI_HOP_LORA_LOSS_H
+#define MULTI_HOP_LORA_LOSS_H
+
+#include "ns3/propagation-loss-model.h"
+#include "ns3/mobility-model.h"
+#include "ns3/node-container.h"
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
+
+namespace ns3 {
+
+//memoizes the loss of another propagation loss model per (tx, rx) mobility pair
+//meant for static deployments, where the wrapped model would otherwise be evaluated again
+//for every frame and receiver. a CourseChange of a mobility model drops its row and column.
+//the loss is cached in dB, so models whose loss depends on the transmit power or that draw
+//fresh randomness on every call (e.g. Nakagami fading) must not be wrapped
+class MultiHopLoraCachedLossModel: public PropagationLossModel
+{
+public:
+    static TypeId GetTypeId(void);
+    MultiHopLoraCachedLossModel();
+    explicit MultiHopLoraCachedLossModel(Ptr<PropagationLossModel> loss);
+    virtual ~MultiHopLoraCachedLossModel();
+
+    void SetLossModel(Ptr<PropagationLossModel> loss);
+    Ptr<PropagationLossModel> GetLossModel(void) const;
+
+    //numbers the mobility models of the nodes in container order, with at most DenseLimit nodes
+    //the cache becomes an N x N matrix, otherwise pairs are kept in a hash map as they are used.
+    //threads > 0 computes every pair of the matrix up front. threads > 1 works in parallel on copied
+    //positions if the wrapped model is a LogDistance model without a next model, others fill on one thread
+    void Prefill(const NodeContainer &nodes, uint32_t threads);
+
+    //Getters
+    uint64_t GetHits(void) const;
+    uint64_t GetMisses(void) const; //evaluations of the wrapped model, prefill included
+    uint64_t GetInvalidations(void) const;
+    uint64_t GetEntries(void) const; //cached pairs
+    bool IsDense(void) const;
+
+private:
+    virtual double DoCalcRxPower(double txPowerDbm, Ptr<MobilityModel> a, Ptr<MobilityModel> b) const;
+    virtual int64_t DoAssignStreams(int64_t stream);
+
+    uint32_t GetIndex(Ptr<MobilityModel> mobility) const;
+    double *Lookup(uint32_t tx, uint32_t rx) const; //slot of the pair, NaN until it is computed
+    void CourseChanged(Ptr<const MobilityModel> mobility);
+
+    Ptr<PropagationLossModel> m_loss;
+    uint32_t m_denseLimit;
+
+    mutable std::unordered_map<const MobilityModel*, uint32_t> m_index;
+    mutable std::vector<Ptr<MobilityModel>> m_mobility; //by index, keeps the keys alive
+    uint32_t m_denseSize; //nodes covered by the matrix, 0 without one
+    mutable std::vector<double> m_matrix; //loss in dB, row = tx index
+    mutable std::unordered_map<uint64_t, double> m_sparse; //(tx << 32 | rx) -> loss in dB
+
+    mutable uint64_t m_hits;
+    mutable uint64_t m_misses;
+    uint64_t m_invalidations;
+};
+
+} //namespace ns3
+
+#endif //MULTI_HOP_LORA_LOSS_H
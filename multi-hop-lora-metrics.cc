@@ -0,0 +1,401 @@
+#include "multi-hop-lora-metrics.h"
+#include "ns3/log.h"
+#include "ns3/assert.h"
+#include "ns3/callback.h"
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE("MultiHopLoraMetrics");
+
+MultiHopLoraMetrics::MultiHopLoraMetrics(uint8_t sf, uint32_t window)
+    :m_sf(sf),m_window(window),m_latency(NUM_BUCKETS, 0),m_hops(1, 0),m_latencySamples(0),m_latencySumUs(0),m_latencyMaxUs(0),
+     m_beacons(0),m_beaconAirtime(Seconds(0)),m_lgwChanges(0),m_lastLgwChange(Seconds(0)),m_recording(false)
+{
+    NS_ASSERT_MSG(window > 0 && window <= 65536 && (window & (window - 1)) == 0, "Metrics window must be a power of two up to 65536");
+}
+
+void
+MultiHopLoraMetrics::Attach(Ptr<MultiHopLoraApp> app)
+{
+    GetNode(app->GetNode()->GetId()).gateway = app->IsGateway();
+    app->TraceConnectWithoutContext("Send", MakeCallback(&MultiHopLoraMetrics::NotifySend, this));
+    app->TraceConnectWithoutContext("Receive", MakeCallback(&MultiHopLoraMetrics::NotifyReceive, this));
+    app->TraceConnectWithoutContext("Forward", MakeCallback(&MultiHopLoraMetrics::NotifyForward, this));
+    app->TraceConnectWithoutContext("ForwardFrame", MakeCallback(&MultiHopLoraMetrics::NotifyForwardFrame, this));
+    app->TraceConnectWithoutContext("Deliver", MakeCallback(&MultiHopLoraMetrics::NotifyDeliver, this));
+    app->TraceConnectWithoutContext("Suppress", MakeCallback(&MultiHopLoraMetrics::NotifySuppress, this));
+    app->TraceConnectWithoutContext("Beacon", MakeCallback(&MultiHopLoraMetrics::NotifyBeacon, this));
+    app->TraceConnectWithoutContext("LgwChange", MakeCallback(&MultiHopLoraMetrics::NotifyLgwChange, this));
+}
+
+MultiHopLoraMetrics::Source &
+MultiHopLoraMetrics::GetSource(uint32_t nodeId)
+{
+    if (nodeId >= m_sources.size())
+    {
+        m_sources.resize(nodeId + 1, Source{0, 0, 0, {}});
+    }
+    Source &source = m_sources[nodeId];
+    if (source.window.empty())
+    {
+        source.window.assign(m_window, Slot{0, false, false, Time()});
+    }
+    return source;
+}
+
+MultiHopLoraMetrics::Node &
+MultiHopLoraMetrics::GetNode(uint32_t nodeId)
+{
+    if (nodeId >= m_nodes.size())
+    {
+        m_nodes.resize(nodeId + 1, Node{false, 0, 0, 0, Time(), m_sf, 0, Time()});
+    }
+    return m_nodes[nodeId];
+}
+
+void
+MultiHopLoraMetrics::NotifySend(Ptr<const Packet>, uint32_t, uint32_t lfid, uint8_t)
+{
+    if (m_recording)
+    {
+        m_records.push_back(Record{Simulator::Now().GetNanoSeconds(), lfid, 0, 0});
+    }
+    CountSend(lfid, Simulator::Now());
+}
+
+void
+MultiHopLoraMetrics::CountSend(uint32_t lfid, Time now)
+{
+    Source &source = GetSource(lfid >> 16);
+    uint16_t seq = lfid & 0xffff;
+    source.sent++;
+    source.window[seq & (m_window - 1)] = Slot{seq, true, false, now};
+}
+
+void
+MultiHopLoraMetrics::NotifyReceive(Ptr<const Packet>, uint32_t nodeId, uint32_t, uint8_t)
+{
+    GetNode(nodeId).received++;
+}
+
+void
+MultiHopLoraMetrics::NotifyForward(Ptr<const Packet>, uint32_t nodeId, uint32_t, uint8_t)
+{
+    GetNode(nodeId).forwarded++;
+}
+
+void
+MultiHopLoraMetrics::NotifyForwardFrame(Ptr<const Packet> frame, uint32_t nodeId, uint32_t, uint8_t sf)
+{
+    Node &node = GetNode(nodeId);
+    node.frames++;
+    node.sf = sf;
+    node.airtime += MultiHopLoraApp::GetTimeOnAir(sf, frame->GetSize());
+}
+
+void
+MultiHopLoraMetrics::NotifySuppress(Ptr<const Packet> packet, uint32_t nodeId, uint32_t, uint8_t)
+{
+    Node &node = GetNode(nodeId);
+    node.suppressed++;
+    node.airtimeSaved += MultiHopLoraApp::GetTimeOnAir(node.sf, packet->GetSize());
+}
+
+void
+MultiHopLoraMetrics::NotifyBeacon(Ptr<const Packet> beacon, uint32_t, uint8_t, uint8_t sf)
+{
+    m_beacons++;
+    m_beaconAirtime += MultiHopLoraApp::GetTimeOnAir(sf, beacon->GetSize());
+}
+
+void
+MultiHopLoraMetrics::NotifyLgwChange(uint32_t, uint8_t, uint8_t)
+{
+    m_lgwChanges++;
+    m_lastLgwChange = Simulator::Now();
+}
+
+void
+MultiHopLoraMetrics::NotifyDeliver(Ptr<const Packet>, uint32_t, uint32_t lfid, uint8_t lh)
+{
+    if (m_recording)
+    {
+        m_records.push_back(Record{Simulator::Now().GetNanoSeconds(), lfid, 1, lh});
+    }
+    CountDelivery(lfid, lh, Simulator::Now());
+}
+
+void
+MultiHopLoraMetrics::CountDelivery(uint32_t lfid, uint8_t lh, Time now)
+{
+    //the app reports the first copy per gateway, the window removes copies seen by other gateways
+    Source &source = GetSource(lfid >> 16);
+    uint16_t seq = lfid & 0xffff;
+    Slot &slot = source.window[seq & (m_window - 1)];
+    if (!slot.valid || slot.seq != seq)
+    {
+        source.late++;
+        return;
+    }
+    if (slot.delivered)
+    {
+        return;
+    }
+    slot.delivered = true;
+    source.delivered++;
+
+    int64_t us = std::max<int64_t>(0, (now - slot.sent).GetMicroSeconds());
+    m_latency[Bucket(us)]++;
+    m_latencySamples++;
+    m_latencySumUs += us;
+    m_latencyMaxUs = std::max(m_latencyMaxUs, us);
+
+    if (lh >= m_hops.size())
+    {
+        m_hops.resize(lh + 1, 0);
+    }
+    m_hops[lh]++;
+}
+
+uint32_t
+MultiHopLoraMetrics::Bucket(int64_t us)
+{
+    //values below 2^SUB_BITS are exact, above that every octave is split into 2^SUB_BITS buckets
+    uint64_t v = uint64_t(us);
+    if (v < (1u << SUB_BITS))
+    {
+        return uint32_t(v);
+    }
+    uint32_t exponent = 63 - __builtin_clzll(v);
+    uint32_t mantissa = uint32_t(v >> (exponent - SUB_BITS)) & ((1u << SUB_BITS) - 1);
+    return ((exponent - SUB_BITS + 1) << SUB_BITS) + mantissa;
+}
+
+int64_t
+MultiHopLoraMetrics::BucketUpperEdge(uint32_t bucket)
+{
+    if (bucket < (1u << SUB_BITS))
+    {
+        return bucket;
+    }
+    uint32_t exponent = (bucket >> SUB_BITS) + SUB_BITS - 1;
+    uint64_t mantissa = bucket & ((1u << SUB_BITS) - 1);
+    uint64_t width = uint64_t(1) << (exponent - SUB_BITS);
+    return int64_t(((uint64_t(1) << SUB_BITS) + mantissa) * width + width - 1);
+}
+
+uint64_t
+MultiHopLoraMetrics::GetSent(void) const
+{
+    uint64_t sent = 0;
+    for (const Source &source : m_sources)
+    {
+        sent += source.sent;
+    }
+    return sent;
+}
+
+uint64_t
+MultiHopLoraMetrics::GetDelivered(void) const
+{
+    uint64_t delivered = 0;
+    for (const Source &source : m_sources)
+    {
+        delivered += source.delivered;
+    }
+    return delivered;
+}
+
+double
+MultiHopLoraMetrics::GetPdr(void) const
+{
+    uint64_t sent = GetSent();
+    return sent > 0 ? double(GetDelivered()) / sent : 0.0;
+}
+
+Time
+MultiHopLoraMetrics::GetLatencyPercentile(double p) const
+{
+    if (m_latencySamples == 0)
+    {
+        return Seconds(0);
+    }
+    uint64_t rank = std::max<uint64_t>(1, uint64_t(std::ceil(p / 100.0 * m_latencySamples)));
+    uint64_t seen = 0;
+    for (uint32_t b = 0; b < NUM_BUCKETS; ++b)
+    {
+        seen += m_latency[b];
+        if (seen >= rank)
+        {
+            return MicroSeconds(std::min(BucketUpperEdge(b), m_latencyMaxUs));
+        }
+    }
+    return MicroSeconds(m_latencyMaxUs);
+}
+
+double
+MultiHopLoraMetrics::GetDuplicateSuppression(void) const
+{
+    uint64_t received = 0, forwarded = 0;
+    for (const Node &node : m_nodes)
+    {
+        if (!node.gateway)
+        {
+            received += node.received;
+            forwarded += node.forwarded;
+        }
+    }
+    return received > 0 ? 1.0 - double(forwarded) / received : 0.0;
+}
+
+void
+MultiHopLoraMetrics::SetRecording(bool recording)
+{
+    m_recording = recording;
+}
+
+const std::vector<MultiHopLoraMetrics::Record> &
+MultiHopLoraMetrics::GetRecords(void) const
+{
+    return m_records;
+}
+
+void
+MultiHopLoraMetrics::Replay(std::vector<Record> records)
+{
+    //at equal times sends go first, a packet cannot be delivered before it is sent
+    std::stable_sort(records.begin(), records.end(), [](const Record &a, const Record &b) {
+        return a.ns != b.ns ? a.ns < b.ns : a.delivery < b.delivery;
+    });
+    for (const Record &record : records)
+    {
+        if (record.delivery)
+        {
+            CountDelivery(record.lfid, record.lh, NanoSeconds(record.ns));
+        }
+        else
+        {
+            CountSend(record.lfid, NanoSeconds(record.ns));
+        }
+    }
+}
+
+uint64_t MultiHopLoraMetrics::GetBeacons (void) const { return m_beacons; }
+Time MultiHopLoraMetrics::GetBeaconAirtime (void) const { return m_beaconAirtime; }
+Time MultiHopLoraMetrics::GetLastLgwChange (void) const { return m_lastLgwChange; }
+
+void
+MultiHopLoraMetrics::Print(std::ostream &os) const
+{
+    std::ios::fmtflags flags = os.flags();
+    os << std::fixed << std::setprecision(3);
+
+    uint64_t late = 0;
+    std::vector<std::pair<double, uint32_t>> pdr; //per source
+    for (uint32_t id = 0; id < m_sources.size(); ++id)
+    {
+        const Source &source = m_sources[id];
+        late += source.late;
+        if (source.sent > 0)
+        {
+            pdr.push_back(std::make_pair(double(source.delivered) / source.sent, id));
+        }
+    }
+    os << "Sent " << GetSent() << ", delivered " << GetDelivered() << ", PDR " << GetPdr();
+    if (late > 0)
+    {
+        os << " (" << late << " deliveries outside the tracking window)";
+    }
+    os << std::endl;
+
+    //all sources for small runs, the spread otherwise
+    std::sort(pdr.begin(), pdr.end());
+    if (!pdr.empty())
+    {
+        os << "PDR per source:";
+        if (pdr.size() <= 16)
+        {
+            for (const auto &entry : pdr)
+            {
+                os << " " << entry.second << "=" << entry.first;
+            }
+        }
+        else
+        {
+            os << " min " << pdr.front().first << " (node " << pdr.front().second << "), median " << pdr[pdr.size() / 2].first
+               << ", max " << pdr.back().first << " over " << pdr.size() << " sources";
+        }
+        os << std::endl;
+    }
+
+    if (m_latencySamples > 0)
+    {
+        os << "Latency ms: mean " << m_latencySumUs / m_latencySamples / 1000.0 << ", p50 " << GetLatencyPercentile(50).GetSeconds() * 1000.0
+           << ", p90 " << GetLatencyPercentile(90).GetSeconds() * 1000.0 << ", p99 " << GetLatencyPercentile(99).GetSeconds() * 1000.0
+           << ", max " << m_latencyMaxUs / 1000.0 << std::endl;
+
+        os << "Hops:";
+        for (uint32_t h = 0; h < m_hops.size(); ++h)
+        {
+            if (m_hops[h] > 0)
+            {
+                os << " " << h << "=" << m_hops[h];
+            }
+        }
+        os << std::endl;
+    }
+
+    uint64_t received = 0, forwarded = 0, frames = 0, suppressed = 0;
+    Time airtime, airtimeSaved;
+    std::vector<std::pair<Time, uint32_t>> busiest;
+    for (uint32_t id = 0; id < m_nodes.size(); ++id)
+    {
+        const Node &node = m_nodes[id];
+        if (!node.gateway)
+        {
+            received += node.received;
+            forwarded += node.forwarded;
+        }
+        frames += node.frames;
+        suppressed += node.suppressed;
+        airtimeSaved += node.airtimeSaved;
+        if (node.frames > 0)
+        {
+            airtime += node.airtime;
+            busiest.push_back(std::make_pair(node.airtime, id));
+        }
+    }
+    if (!m_nodes.empty())
+    {
+        os << "Duplicate suppression " << GetDuplicateSuppression() << " (" << received << " repeater receptions, " << forwarded << " forwards)" << std::endl;
+    }
+    if (suppressed > 0)
+    {
+        os << "Overheard forwards cancelled " << suppressed << ", airtime saved s " << airtimeSaved.GetSeconds() << std::endl;
+    }
+    if (m_beacons > 0)
+    {
+        os << "Gradient: " << m_beacons << " beacons, airtime s " << m_beaconAirtime.GetSeconds() << ", " << m_lgwChanges
+           << " LGw changes, last at s " << m_lastLgwChange.GetSeconds() << std::endl;
+    }
+
+    if (!busiest.empty())
+    {
+        uint32_t top = std::min<uint32_t>(5, busiest.size());
+        std::partial_sort(busiest.begin(), busiest.begin() + top, busiest.end(), [](const std::pair<Time, uint32_t> &a, const std::pair<Time, uint32_t> &b) {
+            return b.first < a.first;
+        });
+        os << "Forwarded airtime s: total " << airtime.GetSeconds() << " in " << frames << " frames, busiest";
+        for (uint32_t i = 0; i < top; ++i)
+        {
+            os << " " << busiest[i].second << "=" << busiest[i].first.GetSeconds();
+        }
+        os << std::endl;
+    }
+    os.flags(flags);
+}
+
+} //namespace ns3
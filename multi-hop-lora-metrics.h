@@ -0,0 +1,121 @@
+#ifndef MULTI_HOP_LORA_METRICS_H
+#define MULTI_HOP_LORA_METRICS_H
+
+#include "ns3/nstime.h"
+#include "ns3/packet.h"
+#include "multi-hop-lora-app.h"
+#include <ostream>
+#include <vector>
+#include <cstdint>
+
+namespace ns3 {
+
+//protocol metrics collected from the MultiHopLoraApp trace sources
+//everything is kept in fixed-size state: per-source windows of recent sequence numbers,
+//a log-bucketed latency histogram and per-node counters, so memory does not grow with run time
+class MultiHopLoraMetrics
+{
+public:
+    //window is the number of outstanding sequence numbers tracked per source (power of two)
+    //sf is assumed for suppressed forwards until a node has sent a frame
+    explicit MultiHopLoraMetrics(uint8_t sf = 7, uint32_t window = 1024);
+
+    //connects to the Send, Receive, Forward, ForwardFrame, Deliver, Suppress, Beacon and LgwChange sources of the app
+    void Attach(Ptr<MultiHopLoraApp> app);
+
+    //trace sinks
+    void NotifySend(Ptr<const Packet> packet, uint32_t nodeId, uint32_t lfid, uint8_t lh);
+    void NotifyReceive(Ptr<const Packet> packet, uint32_t nodeId, uint32_t lfid, uint8_t lh);
+    void NotifyForward(Ptr<const Packet> packet, uint32_t nodeId, uint32_t lfid, uint8_t lh);
+    void NotifyForwardFrame(Ptr<const Packet> frame, uint32_t nodeId, uint32_t entries, uint8_t sf);
+    void NotifyDeliver(Ptr<const Packet> packet, uint32_t nodeId, uint32_t lfid, uint8_t lh);
+    void NotifySuppress(Ptr<const Packet> packet, uint32_t nodeId, uint32_t lfid, uint8_t lh);
+    void NotifyBeacon(Ptr<const Packet> beacon, uint32_t nodeId, uint8_t lgw, uint8_t sf);
+    void NotifyLgwChange(uint32_t nodeId, uint8_t oldLgw, uint8_t newLgw);
+
+    //compact end-of-run report
+    void Print(std::ostream &os) const;
+
+    //a send or a per-gateway delivery, plain data so ranks can exchange them as bytes
+    struct Record
+    {
+        int64_t ns; //simulation time
+        uint32_t lfid;
+        uint8_t delivery; //0 for a send
+        uint8_t lh;
+    };
+
+    //a distributed run sends a packet on one rank and delivers it on another: with recording on, every send
+    //and delivery is also kept as a Record, so memory grows with the run
+    void SetRecording(bool recording);
+    const std::vector<Record> &GetRecords(void) const;
+    //feeds the records of every rank, in time order, into metrics that have seen nothing yet
+    void Replay(std::vector<Record> records);
+
+    //Getters
+    uint64_t GetSent(void) const;
+    uint64_t GetDelivered(void) const; //distinct LFIDs that reached any gateway
+    double GetPdr(void) const;
+    Time GetLatencyPercentile(double p) const; //upper edge of the bucket holding the p-th percentile
+    double GetDuplicateSuppression(void) const; //share of repeater receptions that did not cause a forward
+    uint64_t GetBeacons(void) const;
+    Time GetBeaconAirtime(void) const;
+    Time GetLastLgwChange(void) const; //when the gradient last moved, its convergence time
+
+private:
+    struct Slot
+    {
+        uint16_t seq;
+        bool valid;
+        bool delivered;
+        Time sent;
+    };
+    struct Source
+    {
+        uint64_t sent;
+        uint64_t delivered;
+        uint64_t late; //deliveries whose send time had already left the window
+        std::vector<Slot> window;
+    };
+    struct Node
+    {
+        bool gateway;
+        uint64_t received;
+        uint64_t forwarded;
+        uint64_t frames; //forwarded frames on air, fewer than forwarded with aggregation
+        Time airtime;
+        uint8_t sf; //of the last forwarded frame
+        uint64_t suppressed; //forwards cancelled by overhearing
+        Time airtimeSaved;
+    };
+
+    Source &GetSource(uint32_t nodeId);
+    Node &GetNode(uint32_t nodeId);
+    void CountSend(uint32_t lfid, Time now);
+    void CountDelivery(uint32_t lfid, uint8_t lh, Time now);
+    static uint32_t Bucket(int64_t us);
+    static int64_t BucketUpperEdge(uint32_t bucket);
+
+    uint8_t m_sf;
+    uint32_t m_window;
+    std::vector<Source> m_sources; //indexed by the LNID part of the LFID
+    std::vector<Node> m_nodes;
+    std::vector<uint64_t> m_latency; //histogram over microseconds, SUB_BUCKETS per power of two
+    std::vector<uint64_t> m_hops; //hop count of first deliveries
+    uint64_t m_latencySamples;
+    double m_latencySumUs;
+    int64_t m_latencyMaxUs;
+    uint64_t m_beacons;
+    Time m_beaconAirtime;
+    uint64_t m_lgwChanges;
+    Time m_lastLgwChange;
+    bool m_recording;
+    std::vector<Record> m_records;
+
+    static const uint32_t SUB_BITS = 4; //16 sub-buckets per octave, about 6% resolution
+    static const uint32_t NUM_BUCKETS = (64 - SUB_BITS) << SUB_BITS;
+};
+
+} //namespace ns3
+
+#endif //MULTI_HOP_LORA_METRICS_H
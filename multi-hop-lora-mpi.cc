@@ -0,0 +1,315 @@
+#include "multi-hop-lora-mpi.h"
+#include "multi-hop-lora-channel.h"
+
+#ifdef NS3_MPI
+
+#include "ns3/log.h"
+#include "ns3/assert.h"
+#include "ns3/simulator.h"
+#include "ns3/node-list.h"
+#include "ns3/mobility-model.h"
+#include "ns3/constant-position-mobility-model.h"
+#include "ns3/mpi-interface.h"
+#include "ns3/nstime.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE("MultiHopLoraMpi");
+NS_OBJECT_ENSURE_REGISTERED(MultiHopLoraMpiHeader);
+NS_OBJECT_ENSURE_REGISTERED(MultiHopLoraMpiChannel);
+
+namespace {
+
+void
+WriteDouble(Buffer::Iterator &it, double value)
+{
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    it.WriteHtonU64(bits);
+}
+
+double
+ReadDouble(Buffer::Iterator &it)
+{
+    uint64_t bits = it.ReadNtohU64();
+    double value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+} //namespace
+
+TypeId
+MultiHopLoraMpiHeader::GetTypeId(void)
+{
+    static TypeId tid = TypeId("ns3::MultiHopLoraMpiHeader")
+    .SetParent<Header>()
+    .SetGroupName("lorawan")
+    .AddConstructor<MultiHopLoraMpiHeader>()
+    ;
+    return tid;
+}
+
+TypeId
+MultiHopLoraMpiHeader::GetInstanceTypeId(void) const
+{
+    return GetTypeId();
+}
+
+MultiHopLoraMpiHeader::MultiHopLoraMpiHeader():m_sender(0),m_txTime(0),m_txPowerDbm(0),m_sf(7),m_duration(0),m_frequencyMHz(0)
+{}
+
+MultiHopLoraMpiHeader::~MultiHopLoraMpiHeader()
+{}
+
+uint32_t MultiHopLoraMpiHeader::GetSerializedSize(void) const
+{
+    //sender(4)+txTime(8)+txPower(8)+sf(1)+duration(8)+frequency(8)
+    return 37;
+}
+
+void
+MultiHopLoraMpiHeader::Serialize(Buffer::Iterator start) const
+{
+    start.WriteHtonU32(m_sender);
+    start.WriteHtonU64(m_txTime);
+    WriteDouble(start, m_txPowerDbm);
+    start.WriteU8(m_sf);
+    start.WriteHtonU64(m_duration);
+    WriteDouble(start, m_frequencyMHz);
+}
+
+uint32_t
+MultiHopLoraMpiHeader::Deserialize(Buffer::Iterator start)
+{
+    m_sender = start.ReadNtohU32();
+    m_txTime = start.ReadNtohU64();
+    m_txPowerDbm = ReadDouble(start);
+    m_sf = start.ReadU8();
+    m_duration = start.ReadNtohU64();
+    m_frequencyMHz = ReadDouble(start);
+    return GetSerializedSize();
+}
+
+void
+MultiHopLoraMpiHeader::Print(std::ostream &os) const
+{
+    os << "Sender=" << m_sender << ", TxTime=" << m_txTime << ", TxPower=" << m_txPowerDbm << ", SF=" << (int)m_sf;
+}
+
+TypeId
+MultiHopLoraMpiChannel::GetTypeId(void)
+{
+    static TypeId tid = TypeId("ns3::MultiHopLoraMpiChannel")
+    .SetParent<lorawan::LoraChannel>()
+    .SetGroupName("lorawan")
+    .AddAttribute("TxLatency",
+                  "Time from the PHY handing a frame to the radio until its preamble is on air, added to every reception and to the lookahead",
+                  TimeValue(MilliSeconds(1)),
+                  MakeTimeAccessor(&MultiHopLoraMpiChannel::m_txLatency),
+                  MakeTimeChecker(Seconds(0)))
+    ;
+    return tid;
+}
+
+MultiHopLoraMpiChannel::MultiHopLoraMpiChannel():m_maxRange(1000.0),m_cull(false),m_txLatency(MilliSeconds(1)),m_lookahead(Seconds(0)),m_remoteSent(0),m_remoteReceived(0)
+{}
+
+MultiHopLoraMpiChannel::MultiHopLoraMpiChannel(Ptr<PropagationLossModel> loss, Ptr<PropagationDelayModel> delay)
+    :lorawan::LoraChannel(loss, delay),m_loss(loss),m_delay(delay),m_maxRange(1000.0),m_cull(false),m_txLatency(MilliSeconds(1)),m_lookahead(Seconds(0)),m_remoteSent(0),m_remoteReceived(0)
+{}
+
+MultiHopLoraMpiChannel::~MultiHopLoraMpiChannel()
+{}
+
+std::vector<uint32_t>
+MultiHopLoraMpiChannel::PartitionByRegion(const std::vector<Vector> &positions, uint32_t numRanks, std::vector<double> &edges)
+{
+    NS_ASSERT_MSG(numRanks > 0 && positions.size() >= numRanks, "Need at least one node per rank");
+
+    std::vector<uint32_t> order(positions.size());
+    for (uint32_t i = 0; i < order.size(); ++i)
+    {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&positions](uint32_t a, uint32_t b) {
+        return positions[a].x < positions[b].x;
+    });
+
+    std::vector<uint32_t> owner(positions.size(), 0);
+    edges.assign(numRanks + 1, 0.0);
+    edges.front() = -INFINITY;
+    edges.back() = INFINITY;
+    for (uint32_t k = 0; k < order.size(); ++k)
+    {
+        uint32_t rank = uint64_t(k) * numRanks / order.size();
+        owner[order[k]] = rank;
+        if (k > 0 && rank != owner[order[k - 1]])
+        {
+            //nodes sharing an x coordinate stay on the lower rank's side of the edge
+            edges[rank] = positions[order[k]].x;
+        }
+    }
+    return owner;
+}
+
+void
+MultiHopLoraMpiChannel::SetPartition(const std::vector<double> &edges, const std::vector<uint32_t> &portals, double maxRange, bool cull)
+{
+    m_edges = edges;
+    m_portals = portals;
+    m_maxRange = maxRange;
+    m_cull = cull;
+}
+
+void
+MultiHopLoraMpiChannel::AddLocalPhy(Ptr<lorawan::LoraPhy> phy)
+{
+    m_localPhys.push_back(phy);
+}
+
+Time
+MultiHopLoraMpiChannel::ComputeLookahead(const NodeContainer &nodes, const std::vector<uint32_t> &owner) const
+{
+    auto cellKey = [this](const Vector &p, int dx, int dy) {
+        int64_t cx = int64_t(std::floor(p.x / m_maxRange)) + dx;
+        int64_t cy = int64_t(std::floor(p.y / m_maxRange)) + dy;
+        return (uint64_t(cx) << 32) ^ uint64_t(uint32_t(cy));
+    };
+
+    std::vector<Ptr<MobilityModel>> mobility(nodes.GetN());
+    std::unordered_map<uint64_t, std::vector<uint32_t>> cells;
+    for (uint32_t i = 0; i < nodes.GetN(); ++i)
+    {
+        mobility[i] = nodes.Get(i)->GetObject<MobilityModel>();
+        cells[cellKey(mobility[i]->GetPosition(), 0, 0)].push_back(i);
+    }
+
+    //any pair not visited below is further apart than maxRange
+    Ptr<ConstantPositionMobilityModel> a = CreateObject<ConstantPositionMobilityModel>();
+    Ptr<ConstantPositionMobilityModel> b = CreateObject<ConstantPositionMobilityModel>();
+    a->SetPosition(Vector(0, 0, 0));
+    b->SetPosition(Vector(m_maxRange, 0, 0));
+    Time minDelay = m_delay->GetDelay(a, b);
+
+    for (uint32_t i = 0; i < nodes.GetN(); ++i)
+    {
+        Vector p = mobility[i]->GetPosition();
+        for (int dx = -1; dx <= 1; ++dx)
+        {
+            for (int dy = -1; dy <= 1; ++dy)
+            {
+                auto cell = cells.find(cellKey(p, dx, dy));
+                if (cell == cells.end())
+                {
+                    continue;
+                }
+                for (uint32_t j : cell->second)
+                {
+                    if (owner[i] == owner[j] || CalculateDistance(p, mobility[j]->GetPosition()) > m_maxRange)
+                    {
+                        continue;
+                    }
+                    Time delay = m_delay->GetDelay(mobility[i], mobility[j]);
+                    minDelay = std::min(minDelay, delay);
+                }
+            }
+        }
+    }
+    return m_txLatency + minDelay;
+}
+
+void
+MultiHopLoraMpiChannel::SetLookahead(Time lookahead)
+{
+    m_lookahead = lookahead;
+}
+
+void
+MultiHopLoraMpiChannel::SendLocal(Ptr<lorawan::LoraPhy> sender, Ptr<Packet> packet, double txPowerDbm, lorawan::LoraTxParameters txParams, Time duration, double frequencyMHz) const
+{
+    lorawan::LoraChannel::Send(sender, packet, txPowerDbm, txParams, duration, frequencyMHz);
+}
+
+void
+MultiHopLoraMpiChannel::Send(Ptr<lorawan::LoraPhy> sender, Ptr<Packet> packet, double txPowerDbm, lorawan::LoraTxParameters txParams, Time duration, double frequencyMHz) const
+{
+    MultiHopLoraGridChannel::ApplyTxTag(packet, txParams, duration, frequencyMHz);
+    //local receivers are handled as on a sequential channel, once the radio latency has passed
+    if (m_txLatency.IsStrictlyPositive())
+    {
+        Simulator::Schedule(m_txLatency, &MultiHopLoraMpiChannel::SendLocal, this, sender, packet->Copy(), txPowerDbm, txParams, duration, frequencyMHz);
+    }
+    else
+    {
+        SendLocal(sender, packet, txPowerDbm, txParams, duration, frequencyMHz);
+    }
+
+    Ptr<Node> node = sender->GetDevice()->GetNode();
+    double x = node->GetObject<MobilityModel>()->GetPosition().x;
+    uint32_t self = MpiInterface::GetSystemId();
+    for (uint32_t rank = 0; rank + 1 < m_edges.size(); ++rank)
+    {
+        if (rank == self)
+        {
+            continue;
+        }
+        //skip ranks whose strip is out of range of the sender
+        if (m_cull && (x < m_edges[rank] - m_maxRange || x >= m_edges[rank + 1] + m_maxRange))
+        {
+            continue;
+        }
+
+        MultiHopLoraMpiHeader meta;
+        meta.m_sender = node->GetId();
+        meta.m_txTime = Simulator::Now().GetTimeStep();
+        meta.m_txPowerDbm = txPowerDbm;
+        meta.m_sf = txParams.sf;
+        meta.m_duration = duration.GetTimeStep();
+        meta.m_frequencyMHz = frequencyMHz;
+
+        Ptr<Packet> copy = packet->Copy();
+        copy->AddHeader(meta);
+        MpiInterface::SendPacket(copy, Simulator::Now() + m_lookahead, m_portals[rank], 0);
+        m_remoteSent++;
+    }
+}
+
+void
+MultiHopLoraMpiChannel::ReceiveRemote(Ptr<Packet> packet)
+{
+    MultiHopLoraMpiHeader meta;
+    packet->RemoveHeader(meta);
+    m_remoteReceived++;
+
+    Ptr<MobilityModel> senderMobility = NodeList::GetNode(meta.m_sender)->GetObject<MobilityModel>();
+    Time txTime = Time(meta.m_txTime);
+    for (const Ptr<lorawan::LoraPhy> &phy : m_localPhys)
+    {
+        Ptr<MobilityModel> receiverMobility = phy->GetMobility();
+        if (m_cull && CalculateDistance(senderMobility->GetPosition(), receiverMobility->GetPosition()) > m_maxRange)
+        {
+            continue;
+        }
+
+        //the frame arrives lookahead after transmission, which is never later than the true delay
+        Time delay = m_txLatency + m_delay->GetDelay(senderMobility, receiverMobility);
+        Time remaining = txTime + delay - Simulator::Now();
+        NS_ASSERT_MSG(!(remaining < Seconds(0)), "Remote frame arrived after its reception start, lookahead is too large");
+
+        double rxPowerDbm = m_loss->CalcRxPower(meta.m_txPowerDbm, senderMobility, receiverMobility);
+        uint32_t dstNode = phy->GetDevice()->GetNode()->GetId();
+        Simulator::ScheduleWithContext(dstNode, remaining, &lorawan::LoraPhy::StartReceive, phy, packet->Copy(), rxPowerDbm, meta.m_sf, Time(meta.m_duration), meta.m_frequencyMHz);
+    }
+}
+
+uint64_t MultiHopLoraMpiChannel::GetRemoteSent (void) const { return m_remoteSent; }
+uint64_t MultiHopLoraMpiChannel::GetRemoteReceived (void) const { return m_remoteReceived; }
+
+} // namespace ns3
+
+#endif //NS3_MPI
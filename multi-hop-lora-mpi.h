@@ -0,0 +1,94 @@
+#ifndef MULTI_HOP_LORA_MPI_H
+#define MULTI_HOP_LORA_MPI_H
+
+#include "ns3/lora-channel.h"
+#include "ns3/lora-phy.h"
+#include "ns3/header.h"
+#include "ns3/node-container.h"
+#include "ns3/propagation-delay-model.h"
+#include "ns3/vector.h"
+#include <vector>
+#include <cstdint>
+
+namespace ns3 {
+
+//transmission metadata carried with a frame sent to another MPI rank
+class MultiHopLoraMpiHeader: public Header
+{
+public:
+    MultiHopLoraMpiHeader();
+    virtual ~MultiHopLoraMpiHeader();
+
+    static TypeId GetTypeId(void);
+    virtual TypeId GetInstanceTypeId(void) const;
+    virtual uint32_t GetSerializedSize(void) const;
+    virtual void Serialize(Buffer::Iterator start) const;
+    virtual uint32_t Deserialize(Buffer::Iterator start);
+    virtual void Print(std::ostream &os) const;
+
+    uint32_t m_sender; //node ID of the transmitting node
+    int64_t m_txTime; //transmission start, in time steps
+    double m_txPowerDbm;
+    uint8_t m_sf;
+    int64_t m_duration; //time on air, in time steps
+    double m_frequencyMHz;
+};
+
+//LoraChannel for one spatial partition of a distributed run
+//each rank attaches only its own PHYs, transmissions that can reach another partition
+//are shipped to that rank and replayed there with the exact propagation delay.
+//every reception, local or remote, starts TxLatency after the PHY hands the frame over,
+//the radio's ramp-up before the preamble is on air, which gives the ranks a usable lookahead
+class MultiHopLoraMpiChannel: public lorawan::LoraChannel
+{
+public:
+    static TypeId GetTypeId(void);
+    MultiHopLoraMpiChannel();
+    MultiHopLoraMpiChannel(Ptr<PropagationLossModel> loss, Ptr<PropagationDelayModel> delay);
+    virtual ~MultiHopLoraMpiChannel();
+
+    //split nodes into vertical strips with equal node counts, returns the owning rank of each node
+    //edges receives numRanks + 1 strip boundaries along x
+    static std::vector<uint32_t> PartitionByRegion(const std::vector<Vector> &positions, uint32_t numRanks, std::vector<double> &edges);
+
+    //portals[r] is a node owned by rank r whose device 0 receives remote frames
+    //with cull set, frames are only exchanged with strips and PHYs within maxRange of the sender,
+    //which is cheaper but drops the negligible far-field interference the sequential channel models
+    void SetPartition(const std::vector<double> &edges, const std::vector<uint32_t> &portals, double maxRange, bool cull);
+    void AddLocalPhy(Ptr<lorawan::LoraPhy> phy);
+
+    //TxLatency plus the smallest propagation delay between nodes of different ranks, pairs further
+    //apart than maxRange are bounded by the delay at maxRange. remote frames are stamped this far
+    //ahead, so ranks only need to synchronize that often
+    Time ComputeLookahead(const NodeContainer &nodes, const std::vector<uint32_t> &owner) const;
+    void SetLookahead(Time lookahead);
+
+    void Send(Ptr<lorawan::LoraPhy> sender, Ptr<Packet> packet, double txPowerDbm, lorawan::LoraTxParameters txParams, Time duration, double frequencyMHz) const override;
+
+    //MpiReceiver callback on the portal device
+    void ReceiveRemote(Ptr<Packet> packet);
+
+    uint64_t GetRemoteSent(void) const;
+    uint64_t GetRemoteReceived(void) const;
+
+private:
+    //hands the frame to the local PHYs, once the radio latency has passed
+    void SendLocal(Ptr<lorawan::LoraPhy> sender, Ptr<Packet> packet, double txPowerDbm, lorawan::LoraTxParameters txParams, Time duration, double frequencyMHz) const;
+
+    Ptr<PropagationLossModel> m_loss;
+    Ptr<PropagationDelayModel> m_delay;
+    std::vector<Ptr<lorawan::LoraPhy>> m_localPhys;
+    std::vector<double> m_edges;
+    std::vector<uint32_t> m_portals;
+    double m_maxRange;
+    bool m_cull;
+    Time m_txLatency;
+    Time m_lookahead;
+
+    mutable uint64_t m_remoteSent;
+    uint64_t m_remoteReceived;
+};
+
+} //namespace ns3
+
+#endif //MULTI_HOP_LORA_MPI_H
@@ -0,0 +1,309 @@
+#include "multi-hop-lora-profile.h"
+#include "ns3/log.h"
+#include "ns3/abort.h"
+#include "ns3/simulator.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <new>
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE("MultiHopLoraProfile");
+NS_OBJECT_ENSURE_REGISTERED(MultiHopLoraCountingScheduler);
+
+static const char *SECTION_NAMES[MultiHopLoraProfile::NUM_SECTIONS] = {"ReceivePacket", "ProcessDuplicates", "SendPacket", "HeaderSerialize", "HeaderDeserialize", "PrefixDeserialize"};
+
+bool MultiHopLoraProfile::s_enabled = false;
+std::string MultiHopLoraProfile::s_fileName;
+Time MultiHopLoraProfile::s_sampleInterval;
+std::chrono::steady_clock::time_point MultiHopLoraProfile::s_start;
+uint64_t MultiHopLoraProfile::s_allocationsAtStart = 0;
+std::vector<MultiHopLoraProfile::Sample> MultiHopLoraProfile::s_samples;
+uint64_t MultiHopLoraProfile::s_queue = 0;
+uint64_t MultiHopLoraProfile::s_peakQueue = 0;
+
+//thread blocks are only registered under the lock, and only read after the run
+static std::mutex g_threadsMutex;
+static std::vector<std::unique_ptr<MultiHopLoraProfile::Counters>> g_threads;
+static thread_local MultiHopLoraProfile::Counters *t_counters = nullptr;
+static thread_local uint64_t t_allocations = 0;
+
+void
+MultiHopLoraProfile::Enable(const std::string &fileName, Time sampleInterval)
+{
+    NS_ABORT_MSG_IF(!sampleInterval.IsStrictlyPositive(), "The profile sample interval must be positive");
+    s_fileName = fileName;
+    s_sampleInterval = sampleInterval;
+    s_samples.clear();
+    s_queue = 0;
+    s_peakQueue = 0;
+    Simulator::SetScheduler(ObjectFactory("ns3::MultiHopLoraCountingScheduler"));
+    s_start = std::chrono::steady_clock::now();
+    s_enabled = true;
+    s_allocationsAtStart = t_allocations;
+    Simulator::ScheduleNow(&MultiHopLoraProfile::TakeSample);
+    Simulator::ScheduleDestroy(&MultiHopLoraProfile::Dump);
+}
+
+MultiHopLoraProfile::Counters &
+MultiHopLoraProfile::ThreadCounters(void)
+{
+    if (!t_counters)
+    {
+        std::unique_ptr<Counters> counters(new Counters());
+        t_counters = counters.get();
+        std::lock_guard<std::mutex> lock(g_threadsMutex);
+        g_threads.push_back(std::move(counters));
+    }
+    return *t_counters;
+}
+
+uint64_t
+MultiHopLoraProfile::GetAllocations(void)
+{
+    return t_allocations;
+}
+
+void
+MultiHopLoraProfile::Scope::Begin(Section section)
+{
+    m_section = section;
+    m_allocations = t_allocations;
+    m_start = std::chrono::steady_clock::now();
+}
+
+void
+MultiHopLoraProfile::Scope::End(void)
+{
+    uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start).count();
+    Counters &counters = ThreadCounters();
+    counters.calls[m_section]++;
+    counters.ns[m_section] += ns;
+    counters.allocations[m_section] += t_allocations - m_allocations;
+    counters.histogram[m_section][Bucket(ns)]++;
+}
+
+uint32_t
+MultiHopLoraProfile::Bucket(uint64_t ns)
+{
+    //SUB_BUCKETS linear steps per power of two of nanoseconds
+    if (ns < SUB_BUCKETS)
+    {
+        return uint32_t(ns);
+    }
+    uint32_t exponent = 63 - __builtin_clzll(ns);
+    uint32_t sub = uint32_t((ns >> (exponent - 2)) & (SUB_BUCKETS - 1));
+    return std::min(NUM_BUCKETS - 1, (exponent - 1) * SUB_BUCKETS + sub);
+}
+
+double
+MultiHopLoraProfile::BucketUpperEdgeUs(uint32_t bucket)
+{
+    if (bucket < SUB_BUCKETS)
+    {
+        return (bucket + 1) / 1000.0;
+    }
+    uint32_t exponent = bucket / SUB_BUCKETS + 1;
+    uint32_t sub = bucket % SUB_BUCKETS;
+    return std::ldexp(double(SUB_BUCKETS + sub + 1), exponent - 2) / 1000.0;
+}
+
+void
+MultiHopLoraProfile::AddSample(void)
+{
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - s_start).count();
+    s_samples.push_back(Sample{Simulator::Now().GetSeconds(), wall, Simulator::GetEventCount(), s_queue});
+}
+
+void
+MultiHopLoraProfile::TakeSample(void)
+{
+    AddSample();
+    Simulator::Schedule(s_sampleInterval, &MultiHopLoraProfile::TakeSample);
+}
+
+void
+MultiHopLoraProfile::Dump(void)
+{
+    if (!s_enabled)
+    {
+        return;
+    }
+    AddSample(); //the end of the run
+    s_enabled = false;
+
+    Counters total = Counters();
+    {
+        std::lock_guard<std::mutex> lock(g_threadsMutex);
+        for (const auto &thread : g_threads)
+        {
+            for (uint32_t s = 0; s < NUM_SECTIONS; ++s)
+            {
+                total.calls[s] += thread->calls[s];
+                total.ns[s] += thread->ns[s];
+                total.allocations[s] += thread->allocations[s];
+                for (uint32_t b = 0; b < NUM_BUCKETS; ++b)
+                {
+                    total.histogram[s][b] += thread->histogram[s][b];
+                }
+            }
+        }
+    }
+
+    std::ofstream out(s_fileName);
+    if (!out.good())
+    {
+        NS_LOG_WARN("Cannot write profile to '" << s_fileName << "'");
+        return;
+    }
+    const Sample &last = s_samples.back();
+    uint64_t allocations = t_allocations - s_allocationsAtStart;
+    uint64_t sent = total.calls[SEND_PACKET];
+    uint64_t received = total.calls[RECEIVE_PACKET];
+    out << "{\n  \"wallSeconds\": " << last.wall << ",\n  \"simulatedSeconds\": " << last.time << ",\n  \"events\": " << last.events
+        << ",\n  \"eventsPerSecond\": " << (last.wall > 0 ? last.events / last.wall : 0.0) << ",\n  \"peakQueue\": " << s_peakQueue
+        << ",\n  \"threads\": " << g_threads.size() << ",\n  \"allocations\": " << allocations
+        << ",\n  \"allocationsPerSentPacket\": " << (sent > 0 ? double(allocations) / sent : 0.0)
+        << ",\n  \"allocationsPerReceivedFrame\": " << (received > 0 ? double(allocations) / received : 0.0) << ",\n  \"sections\": {";
+    for (uint32_t s = 0; s < NUM_SECTIONS; ++s)
+    {
+        //percentiles are the upper edge of the bucket holding them
+        double percentiles[3] = {0, 0, 0};
+        const double ranks[3] = {50, 90, 99};
+        for (uint32_t p = 0; p < 3 && total.calls[s] > 0; ++p)
+        {
+            uint64_t rank = std::max<uint64_t>(1, uint64_t(std::ceil(ranks[p] / 100.0 * total.calls[s])));
+            uint64_t seen = 0;
+            for (uint32_t b = 0; b < NUM_BUCKETS; ++b)
+            {
+                seen += total.histogram[s][b];
+                if (seen >= rank)
+                {
+                    percentiles[p] = BucketUpperEdgeUs(b);
+                    break;
+                }
+            }
+        }
+        out << (s > 0 ? "," : "") << "\n    \"" << SECTION_NAMES[s] << "\": {\"calls\": " << total.calls[s] << ", \"totalMs\": " << total.ns[s] / 1e6
+            << ", \"meanUs\": " << (total.calls[s] > 0 ? total.ns[s] / 1e3 / total.calls[s] : 0.0) << ", \"p50Us\": " << percentiles[0]
+            << ", \"p90Us\": " << percentiles[1] << ", \"p99Us\": " << percentiles[2]
+            << ", \"allocationsPerCall\": " << (total.calls[s] > 0 ? double(total.allocations[s]) / total.calls[s] : 0.0) << "}";
+    }
+    out << "\n  },\n  \"samples\": [";
+    for (uint32_t i = 0; i < s_samples.size(); ++i)
+    {
+        const Sample &sample = s_samples[i];
+        double rate = 0;
+        if (i > 0 && sample.wall > s_samples[i - 1].wall)
+        {
+            rate = (sample.events - s_samples[i - 1].events) / (sample.wall - s_samples[i - 1].wall);
+        }
+        out << (i > 0 ? "," : "") << "\n    {\"time\": " << sample.time << ", \"wall\": " << sample.wall << ", \"events\": " << sample.events
+            << ", \"eventsPerSecond\": " << rate << ", \"queue\": " << sample.queue << "}";
+    }
+    out << "\n  ]\n}\n";
+    NS_LOG_INFO("Profile written to " << s_fileName);
+}
+
+TypeId
+MultiHopLoraCountingScheduler::GetTypeId(void)
+{
+    static TypeId tid = TypeId("ns3::MultiHopLoraCountingScheduler")
+    .SetParent<MapScheduler>()
+    .SetGroupName("lorawan")
+    .AddConstructor<MultiHopLoraCountingScheduler>()
+    ;
+    return tid;
+}
+
+MultiHopLoraCountingScheduler::MultiHopLoraCountingScheduler()
+{}
+
+MultiHopLoraCountingScheduler::~MultiHopLoraCountingScheduler()
+{}
+
+void
+MultiHopLoraCountingScheduler::Insert(const Event &ev)
+{
+    MapScheduler::Insert(ev);
+    MultiHopLoraProfile::s_peakQueue = std::max(MultiHopLoraProfile::s_peakQueue, ++MultiHopLoraProfile::s_queue);
+}
+
+Scheduler::Event
+MultiHopLoraCountingScheduler::RemoveNext(void)
+{
+    MultiHopLoraProfile::s_queue--;
+    return MapScheduler::RemoveNext();
+}
+
+void
+MultiHopLoraCountingScheduler::Remove(const Event &ev)
+{
+    MultiHopLoraProfile::s_queue--;
+    MapScheduler::Remove(ev);
+}
+
+} //namespace ns3
+
+#if defined(MULTI_HOP_LORA_PROFILE_ALLOC) && !defined(MULTI_HOP_LORA_NO_PROFILE)
+//allocation counting for the profile, replaces every form of the global operator new and delete
+//so that no allocation bypasses the count and no block is freed by a mismatched allocator.
+//one branch per allocation while the profile is off
+namespace {
+
+void *
+Allocate(std::size_t size, std::size_t alignment)
+{
+    if (ns3::MultiHopLoraProfile::IsEnabled())
+    {
+        ns3::t_allocations++;
+    }
+    size = size ? size : 1;
+    if (alignment <= alignof(std::max_align_t))
+    {
+        return std::malloc(size);
+    }
+    void *p = nullptr;
+    return posix_memalign(&p, alignment, size) == 0 ? p : nullptr;
+}
+
+void *
+AllocateOrThrow(std::size_t size, std::size_t alignment)
+{
+    void *p = Allocate(size, alignment);
+    if (!p)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+} //namespace
+
+void *operator new(std::size_t size) { return AllocateOrThrow(size, 0); }
+void *operator new[](std::size_t size) { return AllocateOrThrow(size, 0); }
+void *operator new(std::size_t size, std::align_val_t alignment) { return AllocateOrThrow(size, std::size_t(alignment)); }
+void *operator new[](std::size_t size, std::align_val_t alignment) { return AllocateOrThrow(size, std::size_t(alignment)); }
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept { return Allocate(size, 0); }
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept { return Allocate(size, 0); }
+void *operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept { return Allocate(size, std::size_t(alignment)); }
+void *operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept { return Allocate(size, std::size_t(alignment)); }
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::size_t) noexcept { std::free(p); }
+void operator delete(void *p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void *p, const std::nothrow_t &) noexcept { std::free(p); }
+void operator delete[](void *p, const std::nothrow_t &) noexcept { std::free(p); }
+void operator delete(void *p, std::align_val_t, const std::nothrow_t &) noexcept { std::free(p); }
+void operator delete[](void *p, std::align_val_t, const std::nothrow_t &) noexcept { std::free(p); }
+#endif
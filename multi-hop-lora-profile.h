@@ -0,0 +1,137 @@
+#ifndef MULTI_HOP_LORA_PROFILE_H
+#define MULTI_HOP_LORA_PROFILE_H
+
+#include "ns3/nstime.h"
+#include "ns3/map-scheduler.h"
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace ns3 {
+
+//opt-in wall-clock profile of the forwarding hot paths
+//every profiled section counts calls, cumulative time, a log-bucketed histogram of its duration
+//(buckets at most 25% wide) and the heap allocations made inside it. allocations are only counted
+//when built with MULTI_HOP_LORA_PROFILE_ALLOC, which replaces the global operator new and delete,
+//otherwise they read 0. counters live in a block owned
+//by the calling thread, so recording takes no lock and no atomic. while disabled a section costs
+//one branch, and building with MULTI_HOP_LORA_NO_PROFILE removes the sections altogether.
+//sections nest and their times are inclusive, e.g. ReceivePacket contains its header parsing
+//the JSON profile is written when Simulator::Destroy runs. the sampling event recurs forever, so
+//the run needs a Simulator::Stop
+class MultiHopLoraProfile
+{
+public:
+    enum Section : uint8_t
+    {
+        RECEIVE_PACKET,
+        PROCESS_DUPLICATES,
+        SEND_PACKET,
+        HEADER_SERIALIZE,
+        HEADER_DESERIALIZE,
+        PREFIX_DESERIALIZE, //LFID, LH and LGw peeked before the full header
+        NUM_SECTIONS
+    };
+
+    //starts profiling, samples the event rate and the event queue every sampleInterval of simulation time
+    //call before anything is scheduled: it swaps in a scheduler that counts pending events
+    static void Enable(const std::string &fileName, Time sampleInterval = Seconds(10));
+    static bool IsEnabled(void)
+    {
+        return s_enabled;
+    }
+
+    //times one section from construction to destruction
+    class Scope
+    {
+    public:
+        explicit Scope(Section section)
+        {
+            if (s_enabled)
+            {
+                Begin(section);
+            }
+        }
+        ~Scope()
+        {
+            if (m_section != NUM_SECTIONS)
+            {
+                End();
+            }
+        }
+
+    private:
+        void Begin(Section section);
+        void End(void);
+
+        Section m_section = NUM_SECTIONS;
+        uint64_t m_allocations;
+        std::chrono::steady_clock::time_point m_start;
+    };
+
+    //heap allocations by this thread while profiling, 0 without MULTI_HOP_LORA_PROFILE_ALLOC
+    static uint64_t GetAllocations(void);
+
+    static const uint32_t SUB_BUCKETS = 4; //per power of two
+    static const uint32_t NUM_BUCKETS = 40 * SUB_BUCKETS; //up to ~1100 s per call
+
+    //counters of one thread, only that thread writes them
+    struct Counters
+    {
+        uint64_t calls[NUM_SECTIONS];
+        uint64_t ns[NUM_SECTIONS];
+        uint64_t allocations[NUM_SECTIONS];
+        uint64_t histogram[NUM_SECTIONS][NUM_BUCKETS];
+    };
+
+private:
+    friend class MultiHopLoraCountingScheduler;
+
+    struct Sample
+    {
+        double time; //simulation seconds
+        double wall; //seconds since Enable
+        uint64_t events;
+        uint64_t queue; //events pending in the scheduler, cancelled ones included
+    };
+
+    static Counters &ThreadCounters(void);
+    static uint32_t Bucket(uint64_t ns);
+    static double BucketUpperEdgeUs(uint32_t bucket);
+    static void TakeSample(void);
+    static void AddSample(void);
+    static void Dump(void);
+
+    static bool s_enabled;
+    static std::string s_fileName;
+    static Time s_sampleInterval;
+    static std::chrono::steady_clock::time_point s_start;
+    static uint64_t s_allocationsAtStart;
+    static std::vector<Sample> s_samples;
+    static uint64_t s_queue;
+    static uint64_t s_peakQueue;
+};
+
+//MapScheduler, the ns-3 default, that keeps count of the events it holds for the profile
+class MultiHopLoraCountingScheduler: public MapScheduler
+{
+public:
+    static TypeId GetTypeId(void);
+    MultiHopLoraCountingScheduler();
+    virtual ~MultiHopLoraCountingScheduler();
+
+    virtual void Insert(const Event &ev);
+    virtual Event RemoveNext(void);
+    virtual void Remove(const Event &ev);
+};
+
+} //namespace ns3
+
+#ifndef MULTI_HOP_LORA_NO_PROFILE
+#define MULTI_HOP_LORA_PROFILE(section) ns3::MultiHopLoraProfile::Scope multiHopLoraProfileScope(ns3::MultiHopLoraProfile::section)
+#else
+#define MULTI_HOP_LORA_PROFILE(section)
+#endif
+
+#endif //MULTI_HOP_LORA_PROFILE_H
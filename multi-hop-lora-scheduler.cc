@@ -0,0 +1,262 @@
+#include "multi-hop-lora-scheduler.h"
+#include "multi-hop-lora-app.h"
+#include "ns3/log.h"
+#include "ns3/assert.h"
+#include "ns3/simulator.h"
+#include <algorithm>
+#include <cmath>
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE("MultiHopLoraTxScheduler");
+
+MultiHopLoraTxScheduler::MultiHopLoraTxScheduler()
+    :m_maxSize(32),m_maxDelay(Seconds(30)),m_sf(7),m_minPriority(0),m_busyUntil(Seconds(0)),m_order(0),m_peakSize(0),m_sizeIntegral(0),m_sizeSince(Seconds(0)),m_start(Seconds(0)),
+     m_sent(0),m_ageDrops(0),m_overflowDrops(0),m_deferrals(0),m_waitSum(Seconds(0)),m_waitMax(Seconds(0)),m_airtime(Seconds(0))
+{
+    SetSubBands(std::vector<double>(1, 0.0), Seconds(60));
+}
+
+void
+MultiHopLoraTxScheduler::SetSubBands(const std::vector<double> &dutyCycles, Time window)
+{
+    NS_ASSERT_MSG(!dutyCycles.empty(), "At least one sub-band is needed");
+    NS_ASSERT_MSG(window.IsStrictlyPositive(), "Duty-cycle window must be positive");
+
+    Time now = Simulator::Now();
+    m_bands.clear();
+    for (double dutyCycle : dutyCycles)
+    {
+        NS_ASSERT_MSG(dutyCycle >= 0 && dutyCycle <= 1, "Invalid duty cycle " << dutyCycle);
+        //buckets start full, a node that has been silent may send a burst
+        double capacity = dutyCycle * window.GetSeconds();
+        m_bands.push_back(SubBand{dutyCycle, capacity, capacity, now});
+    }
+}
+
+void
+MultiHopLoraTxScheduler::SetLimits(uint32_t maxSize, Time maxDelay)
+{
+    NS_ASSERT_MSG(maxSize > 0, "Transmit queue must hold at least one frame");
+    m_maxSize = maxSize;
+    m_maxDelay = maxDelay;
+}
+
+void
+MultiHopLoraTxScheduler::SetSpreadingFactor(uint8_t sf)
+{
+    m_sf = sf;
+}
+
+void
+MultiHopLoraTxScheduler::SetMinPriority(uint8_t priority)
+{
+    m_minPriority = priority;
+    Time now = Simulator::Now();
+    if (!m_queue.empty() && (!m_event.IsPending() || m_busyUntil <= now))
+    {
+        Simulator::Cancel(m_event);
+        TrySend();
+    }
+}
+
+void
+MultiHopLoraTxScheduler::SetSendCallback(SendCallback send)
+{
+    m_send = send;
+}
+
+void
+MultiHopLoraTxScheduler::SetDropCallback(DropCallback drop)
+{
+    m_drop = drop;
+}
+
+void
+MultiHopLoraTxScheduler::Enqueue(Ptr<Packet> packet, uint8_t priority, uint32_t entries, uint32_t subBand)
+{
+    NS_ASSERT_MSG(subBand < m_bands.size(), "Unknown sub-band " << subBand);
+
+    Time now = Simulator::Now();
+    if (m_order == 0)
+    {
+        m_start = now;
+        m_sizeSince = now;
+    }
+    DropExpired(now);
+    if (m_queue.size() >= m_maxSize)
+    {
+        //entries are kept in arrival order, the front is the oldest
+        Drop(m_queue.begin(), m_overflowDrops);
+    }
+
+    UpdateOccupancy(now);
+    m_queue.push_back(Entry{packet, priority, entries, subBand, m_sf, m_order++, now});
+    m_peakSize = std::max<uint32_t>(m_peakSize, m_queue.size());
+
+    //an idle radio waiting for tokens looks again, the new frame's band may have them
+    if (!m_event.IsPending() || m_busyUntil <= now)
+    {
+        Simulator::Cancel(m_event);
+        TrySend();
+    }
+}
+
+void
+MultiHopLoraTxScheduler::Clear(void)
+{
+    Simulator::Cancel(m_event);
+    UpdateOccupancy(Simulator::Now());
+    m_queue.clear();
+}
+
+void
+MultiHopLoraTxScheduler::TrySend(void)
+{
+    Time now = Simulator::Now();
+    DropExpired(now);
+    if (m_queue.empty())
+    {
+        return;
+    }
+    if (m_busyUntil > now)
+    {
+        m_event = Simulator::Schedule(m_busyUntil - now, &MultiHopLoraTxScheduler::TrySend, this);
+        return;
+    }
+
+    //highest priority first, the oldest among equals, among the frames whose sub-band holds
+    //their time on air, so a band out of tokens does not hold back the others; queues are
+    //short so a scan is cheapest
+    for (SubBand &band : m_bands)
+    {
+        if (band.dutyCycle > 0)
+        {
+            Refill(band, now);
+        }
+    }
+    std::vector<Entry>::iterator best = m_queue.end();
+    Time toa;
+    Time refill = Time::Max(); //until the first waiting frame has its tokens
+    for (std::vector<Entry>::iterator it = m_queue.begin(); it != m_queue.end(); ++it)
+    {
+        if (it->priority < m_minPriority || (best != m_queue.end() && it->priority <= best->priority))
+        {
+            continue;
+        }
+        Time frameToa = MultiHopLoraApp::GetTimeOnAir(it->sf, it->packet->GetSize());
+        const SubBand &band = m_bands[it->subBand];
+        //a frame longer than the whole bucket goes out once the bucket is full
+        double cost = std::min(frameToa.GetSeconds(), band.capacity);
+        if (band.dutyCycle > 0 && band.tokens < cost)
+        {
+            //rounded up, so the bucket holds the frame when the timer fires
+            refill = std::min(refill, NanoSeconds(int64_t(std::ceil((cost - band.tokens) / band.dutyCycle * 1e9)) + 1));
+            continue;
+        }
+        best = it;
+        toa = frameToa;
+    }
+    if (best == m_queue.end() && refill == Time::Max())
+    {
+        return; //everything is held, SetMinPriority looks again
+    }
+    if (best == m_queue.end())
+    {
+        m_deferrals++;
+        m_event = Simulator::Schedule(refill, &MultiHopLoraTxScheduler::TrySend, this);
+        return;
+    }
+    if (m_bands[best->subBand].dutyCycle > 0)
+    {
+        m_bands[best->subBand].tokens -= toa.GetSeconds();
+    }
+
+    Entry entry = *best;
+    UpdateOccupancy(now);
+    m_queue.erase(best);
+
+    Time wait = now - entry.enqueued;
+    m_waitSum += wait;
+    m_waitMax = std::max(m_waitMax, wait);
+    m_sent++;
+    m_airtime += toa;
+    m_busyUntil = now + toa;
+
+    if (!m_queue.empty())
+    {
+        m_event = Simulator::Schedule(toa, &MultiHopLoraTxScheduler::TrySend, this);
+    }
+    if (!m_send.IsNull())
+    {
+        m_send(entry.packet, entry.entries, entry.sf);
+    }
+}
+
+void
+MultiHopLoraTxScheduler::DropExpired(Time now)
+{
+    if (m_maxDelay.IsZero())
+    {
+        return;
+    }
+    while (!m_queue.empty() && now - m_queue.front().enqueued > m_maxDelay)
+    {
+        Drop(m_queue.begin(), m_ageDrops);
+    }
+}
+
+void
+MultiHopLoraTxScheduler::Drop(std::vector<Entry>::iterator it, uint64_t &counter)
+{
+    NS_LOG_DEBUG("Dropping queued frame of " << it->packet->GetSize() << " bytes after " << (Simulator::Now() - it->enqueued).GetSeconds() << "s");
+    counter++;
+    Entry entry = *it;
+    UpdateOccupancy(Simulator::Now());
+    m_queue.erase(it);
+    if (!m_drop.IsNull())
+    {
+        m_drop(entry.packet, entry.entries, Simulator::Now() - entry.enqueued);
+    }
+}
+
+void
+MultiHopLoraTxScheduler::Refill(SubBand &band, Time now)
+{
+    band.tokens = std::min(band.capacity, band.tokens + (now - band.updated).GetSeconds() * band.dutyCycle);
+    band.updated = now;
+}
+
+void
+MultiHopLoraTxScheduler::UpdateOccupancy(Time now)
+{
+    m_sizeIntegral += m_queue.size() * (now - m_sizeSince).GetSeconds();
+    m_sizeSince = now;
+}
+
+// Getters implementation
+uint32_t MultiHopLoraTxScheduler::GetSize(void) const { return m_queue.size(); }
+uint32_t MultiHopLoraTxScheduler::GetMaxSize(void) const { return m_peakSize; }
+uint64_t MultiHopLoraTxScheduler::GetSent(void) const { return m_sent; }
+uint64_t MultiHopLoraTxScheduler::GetAgeDrops(void) const { return m_ageDrops; }
+uint64_t MultiHopLoraTxScheduler::GetOverflowDrops(void) const { return m_overflowDrops; }
+uint64_t MultiHopLoraTxScheduler::GetDeferrals(void) const { return m_deferrals; }
+Time MultiHopLoraTxScheduler::GetMaxWait(void) const { return m_waitMax; }
+Time MultiHopLoraTxScheduler::GetAirtime(void) const { return m_airtime; }
+
+double
+MultiHopLoraTxScheduler::GetMeanSize(void) const
+{
+    Time now = Simulator::Now();
+    double elapsed = (now - m_start).GetSeconds();
+    double integral = m_sizeIntegral + m_queue.size() * (now - m_sizeSince).GetSeconds();
+    return elapsed > 0 ? integral / elapsed : 0.0;
+}
+
+Time
+MultiHopLoraTxScheduler::GetMeanWait(void) const
+{
+    return m_sent > 0 ? NanoSeconds(m_waitSum.GetNanoSeconds() / int64_t(m_sent)) : Seconds(0);
+}
+
+} //namespace ns3
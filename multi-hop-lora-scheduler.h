@@ -0,0 +1,109 @@
+#ifndef MULTI_HOP_LORA_SCHEDULER_H
+#define MULTI_HOP_LORA_SCHEDULER_H
+
+#include "ns3/nstime.h"
+#include "ns3/packet.h"
+#include "ns3/callback.h"
+#include "ns3/event-id.h"
+#include <vector>
+#include <cstdint>
+
+namespace ns3 {
+
+//per-node transmit queue in front of the radio
+//frames leave in priority order (higher first, FIFO among equals), one at a time, and only
+//when the token bucket of their sub-band holds their time on air; a frame whose band is out
+//of tokens is passed over for the best frame of a band that has them, and frames below the
+//minimum priority are held. frames that waited longer
+//than the maximum queue delay are dropped, and a full queue drops its oldest frame
+class MultiHopLoraTxScheduler
+{
+public:
+    //frame, entries as given to Enqueue, spreading factor it was enqueued with
+    typedef Callback<void, Ptr<Packet>, uint32_t, uint8_t> SendCallback;
+    //frame, entries, time spent in the queue
+    typedef Callback<void, Ptr<const Packet>, uint32_t, Time> DropCallback;
+
+    MultiHopLoraTxScheduler();
+
+    //dutyCycles[b] is the airtime share allowed in sub-band b (0 = unlimited), the bucket of
+    //each band holds dutyCycle * window of airtime, so bursts are bounded by that much
+    void SetSubBands(const std::vector<double> &dutyCycles, Time window);
+    void SetLimits(uint32_t maxSize, Time maxDelay);
+    //spreading factor of the frames enqueued from now on, sets their time on air
+    void SetSpreadingFactor(uint8_t sf);
+    //frames below this priority stay in the queue until it is lowered again (0 = none held)
+    void SetMinPriority(uint8_t priority);
+    void SetSendCallback(SendCallback send);
+    void SetDropCallback(DropCallback drop);
+
+    //entries is passed back to the callbacks, e.g. the number of forwarded LFIDs in the frame
+    void Enqueue(Ptr<Packet> packet, uint8_t priority, uint32_t entries, uint32_t subBand = 0);
+    //drops everything without reporting it and cancels the pending transmission
+    void Clear(void);
+
+    //Getters
+    uint32_t GetSize(void) const;
+    uint32_t GetMaxSize(void) const; //largest occupancy seen
+    double GetMeanSize(void) const; //time-averaged occupancy
+    uint64_t GetSent(void) const;
+    uint64_t GetAgeDrops(void) const;
+    uint64_t GetOverflowDrops(void) const;
+    uint64_t GetDeferrals(void) const; //times no queued frame had duty-cycle tokens
+    Time GetMeanWait(void) const;
+    Time GetMaxWait(void) const;
+    Time GetAirtime(void) const;
+
+private:
+    struct Entry
+    {
+        Ptr<Packet> packet;
+        uint8_t priority;
+        uint32_t entries;
+        uint32_t subBand;
+        uint8_t sf;
+        uint64_t order; //arrival order, breaks priority ties
+        Time enqueued;
+    };
+    struct SubBand
+    {
+        double dutyCycle;
+        double capacity; //seconds of airtime
+        double tokens;
+        Time updated;
+    };
+
+    void TrySend(void);
+    void DropExpired(Time now);
+    void Drop(std::vector<Entry>::iterator it, uint64_t &counter);
+    void Refill(SubBand &band, Time now);
+    void UpdateOccupancy(Time now);
+
+    std::vector<Entry> m_queue;
+    std::vector<SubBand> m_bands;
+    uint32_t m_maxSize;
+    Time m_maxDelay;
+    uint8_t m_sf;
+    uint8_t m_minPriority;
+    SendCallback m_send;
+    DropCallback m_drop;
+    EventId m_event;
+    Time m_busyUntil; //end of the frame on air
+    uint64_t m_order;
+
+    uint32_t m_peakSize;
+    double m_sizeIntegral; //packet-seconds
+    Time m_sizeSince;
+    Time m_start;
+    uint64_t m_sent;
+    uint64_t m_ageDrops;
+    uint64_t m_overflowDrops;
+    uint64_t m_deferrals;
+    Time m_waitSum;
+    Time m_waitMax;
+    Time m_airtime;
+};
+
+} //namespace ns3
+
+#endif //MULTI_HOP_LORA_SCHEDULER_H
@@ -0,0 +1,149 @@
+#include "multi-hop-lora-server.h"
+#include "ns3/log.h"
+#include "ns3/simulator.h"
+#include "ns3/uinteger.h"
+#include "ns3/nstime.h"
+#include <iomanip>
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE("MultiHopLoraNetworkServer");
+NS_OBJECT_ENSURE_REGISTERED(MultiHopLoraNetworkServer);
+
+TypeId
+MultiHopLoraNetworkServer::GetTypeId(void)
+{
+    static TypeId tid = TypeId("ns3::MultiHopLoraNetworkServer")
+    .SetParent<Application>()
+    .SetGroupName("lorawan")
+    .AddConstructor<MultiHopLoraNetworkServer>()
+    .AddAttribute("CacheSize",
+                  "Number of LFIDs the cross-gateway dedup table can hold (rounded up to a power of two)",
+                  UintegerValue(4096),
+                  MakeUintegerAccessor(&MultiHopLoraNetworkServer::m_cacheSize),
+                  MakeUintegerChecker<uint32_t>(1))
+    .AddAttribute("DedupTtl",
+                  "How long an LFID is remembered after its first arrival",
+                  TimeValue(Seconds(60)),
+                  MakeTimeAccessor(&MultiHopLoraNetworkServer::m_dedupTtl),
+                  MakeTimeChecker())
+    .AddTraceSource("Deliver",
+                    "First arrival of an LFID at the server",
+                    MakeTraceSourceAccessor(&MultiHopLoraNetworkServer::m_deliverTrace),
+                    "ns3::MultiHopLoraNetworkServer::DeliverTracedCallback")
+    ;
+    return tid;
+}
+
+MultiHopLoraNetworkServer::MultiHopLoraNetworkServer():m_cacheSize(4096),m_dedupTtl(Seconds(60)),m_uplinks(0),m_delivered(0),m_duplicates(0),
+    m_unknownOrigin(0),m_latencySum(Seconds(0)),m_latencyMax(Seconds(0)),m_latencySamples(0)
+{}
+
+MultiHopLoraNetworkServer::~MultiHopLoraNetworkServer()
+{}
+
+void
+MultiHopLoraNetworkServer::StartApplication(void)
+{
+    m_seen.Resize(m_cacheSize);
+    m_seen.SetTtl(m_dedupTtl);
+}
+
+void
+MultiHopLoraNetworkServer::StopApplication(void)
+{
+    NS_LOG_INFO("Network server dedup table: hits=" << m_seen.GetHits() << ", evictions=" << m_seen.GetEvictions());
+}
+
+void
+MultiHopLoraNetworkServer::NotifySend(Ptr<const Packet>, uint32_t, uint32_t lfid, uint8_t)
+{
+    m_sendTimes[lfid] = Simulator::Now();
+    m_sendOrder.push_back(std::make_pair(Simulator::Now(), lfid));
+    ExpireSendTimes();
+}
+
+void
+MultiHopLoraNetworkServer::ExpireSendTimes(void)
+{
+    Time horizon = Simulator::Now() - m_dedupTtl;
+    while (!m_sendOrder.empty() && m_sendOrder.front().first < horizon)
+    {
+        auto it = m_sendTimes.find(m_sendOrder.front().second);
+        //a reused LFID keeps the newer send time
+        if (it != m_sendTimes.end() && it->second == m_sendOrder.front().first)
+        {
+            m_sendTimes.erase(it);
+        }
+        m_sendOrder.pop_front();
+    }
+}
+
+void
+MultiHopLoraNetworkServer::ReceiveUplink(MultiHopLoraUplink uplink)
+{
+    m_uplinks++;
+    uint32_t lfid = uplink.header.GetLfid();
+
+    Time firstArrival;
+    if (m_seen.Lookup(lfid, Simulator::Now(), firstArrival))
+    {
+        m_duplicates++;
+        NS_LOG_LOGIC("LFID " << lfid << " from gateway " << uplink.gateway << " already delivered");
+        return;
+    }
+    m_seen.Insert(lfid, Simulator::Now(), Simulator::Now());
+    m_delivered++;
+    m_firstByGateway[uplink.gateway]++;
+
+    auto it = m_sendTimes.find(lfid);
+    if (it == m_sendTimes.end())
+    {
+        m_unknownOrigin++;
+        return;
+    }
+    Time latency = Simulator::Now() - it->second;
+    m_sendTimes.erase(it);
+    m_latencySum += latency;
+    m_latencyMax = std::max(m_latencyMax, latency);
+    m_latencySamples++;
+    m_deliverTrace(lfid, uplink.gateway, latency);
+    NS_LOG_LOGIC("LFID " << lfid << " delivered by gateway " << uplink.gateway << " after " << latency.GetSeconds() << "s, "
+                 << uplink.copies << " copies, RSSI " << uplink.rssiDbm << " dBm");
+}
+
+void
+MultiHopLoraNetworkServer::Print(std::ostream &os) const
+{
+    std::ios::fmtflags flags = os.flags();
+    os << std::fixed << std::setprecision(3);
+    os << "Network server: " << m_uplinks << " uplinks, " << m_delivered << " distinct LFIDs, " << m_duplicates << " cross-gateway duplicates";
+    if (m_unknownOrigin > 0)
+    {
+        os << ", " << m_unknownOrigin << " without send time";
+    }
+    os << std::endl;
+    if (m_latencySamples > 0)
+    {
+        os << "First-arrival latency ms: mean " << GetMeanLatency().GetSeconds() * 1000.0 << ", max " << m_latencyMax.GetSeconds() * 1000.0 << std::endl;
+    }
+    if (!m_firstByGateway.empty())
+    {
+        os << "First arrivals per gateway:";
+        for (const auto &entry : m_firstByGateway)
+        {
+            os << " " << entry.first << "=" << entry.second;
+        }
+        os << std::endl;
+    }
+    os.flags(flags);
+}
+
+// Getters implementation
+uint64_t MultiHopLoraNetworkServer::GetUplinks (void) const { return m_uplinks; }
+uint64_t MultiHopLoraNetworkServer::GetDelivered (void) const { return m_delivered; }
+uint64_t MultiHopLoraNetworkServer::GetCrossGatewayDuplicates (void) const { return m_duplicates; }
+Time MultiHopLoraNetworkServer::GetMeanLatency (void) const { return m_latencySamples > 0 ? NanoSeconds(m_latencySum.GetNanoSeconds() / int64_t(m_latencySamples)) : Seconds(0); }
+Time MultiHopLoraNetworkServer::GetMaxLatency (void) const { return m_latencyMax; }
+
+} //namespace ns3
@@ -0,0 +1,83 @@
+#ifndef MULTI_HOP_LORA_SERVER_H
+#define MULTI_HOP_LORA_SERVER_H
+
+#include "ns3/application.h"
+#include "ns3/nstime.h"
+#include "ns3/packet.h"
+#include "ns3/traced-callback.h"
+#include "multi-hop-lora-header.h"
+#include "multi-hop-lora-cache.h"
+#include <deque>
+#include <map>
+#include <unordered_map>
+
+namespace ns3 {
+
+//what a gateway reports to the network server for one LFID, after its own dedup window
+struct MultiHopLoraUplink
+{
+    uint32_t gateway; //node ID of the reporting gateway
+    MultiHopLoraHeader header; //header of the best copy (strongest, then fewest hops)
+    double rssiDbm; //receive power of the best copy, NaN if the PHY did not tag it
+    uint32_t copies; //copies heard by the gateway within its window
+    Time firstRx; //first reception of the LFID at the gateway
+};
+
+//simulated network server behind the gateways
+//gateways hand over uplinks on an ideal backhaul, the server keeps the first copy of every
+//LFID and measures latency from the source transmission to that first arrival
+class MultiHopLoraNetworkServer: public Application
+{
+public:
+    static TypeId GetTypeId(void);
+    MultiHopLoraNetworkServer();
+    virtual ~MultiHopLoraNetworkServer();
+
+    //trace sink for the Send source of MultiHopLoraApp, records origination times
+    void NotifySend(Ptr<const Packet> packet, uint32_t nodeId, uint32_t lfid, uint8_t lh);
+
+    //backhaul entry point, scheduled by gateways in the server node's context
+    void ReceiveUplink(MultiHopLoraUplink uplink);
+
+    void Print(std::ostream &os) const;
+
+    //signature of the Deliver trace source
+    typedef void (*DeliverTracedCallback)(uint32_t lfid, uint32_t gateway, Time latency);
+
+    //Getters
+    uint64_t GetUplinks(void) const; //every uplink received
+    uint64_t GetDelivered(void) const; //distinct LFIDs
+    uint64_t GetCrossGatewayDuplicates(void) const;
+    Time GetMeanLatency(void) const;
+    Time GetMaxLatency(void) const;
+
+protected:
+    virtual void StartApplication(void);
+    virtual void StopApplication(void);
+
+private:
+    void ExpireSendTimes(void);
+
+    MultiHopLoraCache m_seen; //cross-gateway dedup
+    uint32_t m_cacheSize;
+    Time m_dedupTtl;
+
+    //origination times not delivered yet, dropped after the dedup TTL so memory stays bounded
+    std::unordered_map<uint32_t, Time> m_sendTimes;
+    std::deque<std::pair<Time, uint32_t>> m_sendOrder;
+
+    uint64_t m_uplinks;
+    uint64_t m_delivered;
+    uint64_t m_duplicates;
+    uint64_t m_unknownOrigin; //first arrivals whose send time was not recorded or already expired
+    Time m_latencySum;
+    Time m_latencyMax;
+    uint64_t m_latencySamples;
+    std::map<uint32_t, uint64_t> m_firstByGateway; //gateway node ID -> LFIDs it delivered first
+
+    TracedCallback<uint32_t, uint32_t, Time> m_deliverTrace;
+};
+
+} //namespace ns3
+
+#endif //MULTI_HOP_LORA_SERVER_H
@@ -3,8 +3,28 @@
 #include "ns3/mobility-module.h"
 #include "ns3/lorawan-module.h"
 #include "ns3/buildings-module.h"
-#include "ns3/flow-monitor-module.h"
 #include "multi-hop-lora-app.h" //include our custom application header
+#include "multi-hop-lora-topology.h"
+#include "multi-hop-lora-trace.h"
+#include "multi-hop-lora-metrics.h"
+#include "multi-hop-lora-server.h"
+#include "multi-hop-lora-loss.h"
+#include "multi-hop-lora-channel.h"
+#include "multi-hop-lora-abstract-phy.h"
+#include "multi-hop-lora-traffic.h"
+#include "multi-hop-lora-forwarder.h"
+#include "multi-hop-lora-profile.h"
+#include <algorithm>
+#include <fstream>
+#include <limits>
+
+#ifdef NS3_MPI
+#include "ns3/mpi-interface.h"
+#include "ns3/mpi-receiver.h"
+#include "ns3/distributed-simulator-impl.h"
+#include "multi-hop-lora-mpi.h"
+#include <mpi.h>
+#endif
 
 using namespace ns3;
 using namespace lorawan;
@@ -17,36 +37,266 @@ int main(int argc, char *argv[])
     std::string scenario = "obstructed";
     double simulationTime = 3700.0; //approx 1 hours as in paper
     uint32_t numPackets = 184;
+    double packetIntervalArg = 0.0; //0 = simulationTime / numPackets
+    std::string resultsFile = "";
+    std::string traceFile = "";
+    std::string profileFile = "";
+
+    //--- generated topology parameters ---//
+    std::string topologyMode = "paper";
+    uint32_t numNodes = 100;
+    uint32_t numGateways = 1;
+    uint32_t numSources = 1;
+    uint32_t numClusters = 5;
+    double spacing = 200.0;
+    double areaWidth = 5000.0;
+    double areaLength = 5000.0;
+    double clusterRadius = 300.0;
+    std::string topologyFile = "";
+    double sensitivity = -124.0; //SF7 end device sensitivity
+    double maxLinkRange = 1000.0; //beyond this no link is considered when computing LGw
+    bool distributed = false;
+    bool mpiCull = false;
+    bool networkServer = true;
+    double backhaulDelay = 10.0; //ms
+    bool gradient = false;
+    bool cacheLoss = true;
+    uint32_t lossThreads = 0;
+    bool spatialIndex = false;
+    std::string phyMode = "full";
+
+    //--- traffic parameters ---//
+    std::string trafficMode = "fixed";
+    std::string trafficFile = "";
+    std::string payloadSize = "ns3::ConstantRandomVariable[Constant=32]";
+    double jitter = 0.0;
+    double eventRadius = 500.0;
+
+    //--- network server load test ---//
+    std::string forwarderEndpoint = ""; //host:port of a Semtech UDP packet-forwarder endpoint
+    bool realtime = false;
 
     CommandLine cmd(__FILE__);
     cmd.AddValue("scenario", "Select scenario: unobstructed or obstructed", scenario);
     cmd.AddValue("simulationTime", "Total simulation time in seconds", simulationTime);
     cmd.AddValue("numPackets", "Total number of packets to be sent by the source", numPackets);
+    cmd.AddValue("packetInterval", "Seconds between packets of a source (0 = simulationTime / numPackets)", packetIntervalArg);
+    cmd.AddValue("results", "Append a CSV summary row of this run to the given file", resultsFile);
+    cmd.AddValue("trace", "Write a binary event trace to the given file (decode with tools/multi-hop-lora-trace-decode)", traceFile);
+    cmd.AddValue("profile", "Write a JSON wall-clock profile of the hot paths, the event rate and the event queue to the given file", profileFile);
+    cmd.AddValue("topology", "Node placement: paper (4-node scenario), grid, random, clustered or file", topologyMode);
+    cmd.AddValue("numNodes", "Number of end devices for generated topologies", numNodes);
+    cmd.AddValue("numGateways", "Number of gateways added to generated topologies (file: only if none flagged)", numGateways);
+    cmd.AddValue("numSources", "Number of sources, taken from the nodes farthest from a gateway", numSources);
+    cmd.AddValue("numClusters", "Number of clusters for the clustered topology", numClusters);
+    cmd.AddValue("spacing", "Grid spacing in meters", spacing);
+    cmd.AddValue("areaWidth", "Deployment area width in meters (random/clustered)", areaWidth);
+    cmd.AddValue("areaLength", "Deployment area length in meters (random/clustered)", areaLength);
+    cmd.AddValue("clusterRadius", "Cluster radius in meters", clusterRadius);
+    cmd.AddValue("topologyFile", "CSV file with one x,y,z[,gateway] line per node", topologyFile);
+    cmd.AddValue("sensitivity", "Link threshold in dBm used to compute LGw", sensitivity);
+    cmd.AddValue("maxLinkRange", "Upper bound in meters on link length used to compute LGw", maxLinkRange);
+    cmd.AddValue("distributed", "Partition a generated topology over MPI ranks (run with mpirun)", distributed);
+    cmd.AddValue("mpiCull", "Only exchange frames between partitions within maxLinkRange (faster, not bit-identical)", mpiCull);
+    cmd.AddValue("networkServer", "Forward gateway uplinks to a network server that dedups across gateways (not in distributed runs)", networkServer);
+    cmd.AddValue("backhaulDelay", "Gateway to network server delay in milliseconds", backhaulDelay);
+    cmd.AddValue("gradient", "Nodes learn their LGw from gateway beacons instead of the computed one", gradient);
+    cmd.AddValue("cacheLoss", "Memoize the path loss of every node pair, the nodes do not move", cacheLoss);
+    cmd.AddValue("lossThreads", "Threads computing the path-loss cache of generated topologies before the run (0 = on first use)", lossThreads);
+    cmd.AddValue("spatialIndex", "Only deliver frames of generated topologies to PHYs that could decode or interfere with them, even all at once", spatialIndex);
+    cmd.AddValue("phy", "Receptions: full (every PHY's interference model) or abstract (link PER table and SF collision model, not yet validated against full, see README)", phyMode);
+    cmd.AddValue("traffic", "Source traffic: fixed, periodic (packetInterval +-jitter), poisson (mean packetInterval), burst or trace", trafficMode);
+    cmd.AddValue("trafficFile", "CSV file with one time,node,size line per packet for trace traffic, every end device is a source", trafficFile);
+    cmd.AddValue("payloadSize", "Payload size distribution of periodic, poisson and burst traffic", payloadSize);
+    cmd.AddValue("jitter", "Uniform jitter in seconds added to every periodic interval", jitter);
+    cmd.AddValue("eventRadius", "Burst traffic: sources within this many meters of an event send a burst, events arrive every packetInterval on average", eventRadius);
+    cmd.AddValue("forwarder", "Push every gateway uplink to this host:port as a Semtech UDP PUSH_DATA (e.g. 127.0.0.1:1700)", forwarderEndpoint);
+    cmd.AddValue("realtime", "Run on the real-time simulator, so uplinks reach the network server at the simulated rate", realtime);
     cmd.Parse(argc, argv);
+    if (gradient)
+    {
+        Config::SetDefault("ns3::MultiHopLoraApp::GradientDiscovery", BooleanValue(true));
+    }
+
+    uint32_t rank = 0;
+#ifdef NS3_MPI
+    uint32_t numRanks = 1;
+#endif
+    if (distributed)
+    {
+#ifdef NS3_MPI
+        GlobalValue::Bind("SimulatorImplementationType", StringValue("ns3::DistributedSimulatorImpl"));
+        MpiInterface::Enable(&argc, &argv);
+        rank = MpiInterface::GetSystemId();
+        numRanks = MpiInterface::GetSize();
+#else
+        NS_FATAL_ERROR("--distributed needs ns-3 built with --enable-mpi");
+#endif
+    }
+    NS_ABORT_MSG_IF(phyMode != "full" && phyMode != "abstract", "Unknown --phy " << phyMode);
+    NS_ABORT_MSG_IF(phyMode == "abstract" && distributed, "--phy=abstract cannot be combined with --distributed");
+    if (realtime)
+    {
+        NS_ABORT_MSG_IF(distributed, "--realtime cannot be combined with --distributed");
+        GlobalValue::Bind("SimulatorImplementationType", StringValue("ns3::RealtimeSimulatorImpl"));
+    }
+    if (!profileFile.empty())
+    {
+        //before anything is scheduled, the profile replaces the scheduler
+        MultiHopLoraProfile::Enable(distributed ? profileFile + "." + std::to_string(rank) : profileFile);
+    }
 
     //base network configuration
-    LogComponentEnable("MultiHopLoraApp", LOG_LEVEL_INFO);
     LogComponentEnable("MultiHopLoraSimulation", LOG_LEVEL_INFO);
 
-    //create nodes: 1 source, 2 repeaters, 1 gateway
+    bool paperTopology = (topologyMode == "paper");
+    if (distributed && paperTopology)
+    {
+        NS_FATAL_ERROR("--distributed needs a generated topology");
+    }
+    MultiHopLoraTopology topology;
+    if (!paperTopology)
+    {
+        Ptr<UniformRandomVariable> placement = CreateObject<UniformRandomVariable>();
+        if (topologyMode == "grid")
+        {
+            topology.CreateGrid(numNodes, spacing, 1.5);
+        }
+        else if (topologyMode == "random")
+        {
+            topology.CreateUniformRandom(numNodes, areaWidth, areaLength, 1.5, placement);
+        }
+        else if (topologyMode == "clustered")
+        {
+            topology.CreateClustered(numNodes, numClusters, areaWidth, areaLength, clusterRadius, 1.5, placement);
+        }
+        else if (topologyMode == "file")
+        {
+            if (!topology.LoadFile(topologyFile))
+            {
+                NS_FATAL_ERROR("Could not load topology file '" << topologyFile << "'");
+            }
+        }
+        else
+        {
+            NS_FATAL_ERROR("Unknown topology '" << topologyMode << "'");
+        }
+
+        if (topologyMode != "file" || topology.GetNGateways() == 0)
+        {
+            topology.AddGateways(numGateways, 15.0);
+        }
+        //LFIDs carry the node ID in their upper 16 bits
+        NS_ABORT_MSG_IF(topology.GetN() > MultiHopLoraHeader::MAX_LNID + 1, "At most " << MultiHopLoraHeader::MAX_LNID + 1 << " nodes fit in an LFID, the topology has " << topology.GetN());
+    }
+
+    //create nodes: paper scenario is 1 source, 2 repeaters, 1 gateway
+    //in a distributed run every rank creates all nodes but only installs devices and apps on its own
     NodeContainer nodes;
-    nodes.Create(4);
-    Ptr<Node> sourceNode = nodes.Get(0);
-    Ptr<Node> repeater1Node = nodes.Get(1);
-    Ptr<Node> repeater2Node = nodes.Get(2);
-    Ptr<Node> gatewayNode = nodes.Get(3);
+    NodeContainer localNodes;
+    std::vector<uint32_t> owner;
+    std::vector<double> edges;
+    if (distributed)
+    {
+#ifdef NS3_MPI
+        std::vector<Vector> positions;
+        for (uint32_t i = 0; i < topology.GetN(); ++i)
+        {
+            positions.push_back(topology.GetPosition(i));
+        }
+        owner = MultiHopLoraMpiChannel::PartitionByRegion(positions, numRanks, edges);
+        for (uint32_t i = 0; i < owner.size(); ++i)
+        {
+            Ptr<Node> node = CreateObject<Node>(owner[i]);
+            nodes.Add(node);
+            if (owner[i] == rank)
+            {
+                localNodes.Add(node);
+            }
+        }
+        NS_LOG_INFO("Rank " << rank << " owns " << localNodes.GetN() << " of " << nodes.GetN() << " nodes");
+#endif
+    }
+    else
+    {
+        nodes.Create(paperTopology ? 4 : topology.GetN());
+        localNodes = nodes;
+    }
+    Ptr<Node> sourceNode, repeater1Node, repeater2Node, gatewayNode;
+    if (paperTopology)
+    {
+        sourceNode = nodes.Get(0);
+        repeater1Node = nodes.Get(1);
+        repeater2Node = nodes.Get(2);
+        gatewayNode = nodes.Get(3);
+    }
 
     //---lora PHY and channel configuration---//
-    Ptr<LoraChannel> channel = CreateObject<LoraChannel>();
+    //every frame evaluates the loss to every receiver, with static nodes that only needs doing once per pair
+    Ptr<MultiHopLoraCachedLossModel> lossCache;
+    auto withCache = [cacheLoss, &lossCache](Ptr<PropagationLossModel> loss) -> Ptr<PropagationLossModel> {
+        if (!cacheLoss)
+        {
+            return loss;
+        }
+        lossCache = CreateObject<MultiHopLoraCachedLossModel>(loss);
+        return lossCache;
+    };
+    Ptr<PropagationLossModel> logDistance = CreateObject<LogDistancePropagationLossModel>();
+    Ptr<PropagationLossModel> generatedLoss = withCache(logDistance);
+    Ptr<LoraChannel> channel;
+#ifdef NS3_MPI
+    Ptr<MultiHopLoraMpiChannel> mpiChannel;
+    if (distributed)
+    {
+        //each rank owns a channel region holding only its PHYs
+        mpiChannel = CreateObject<MultiHopLoraMpiChannel>(generatedLoss, CreateObject<ConstantSpeedPropagationDelayModel>());
+        channel = mpiChannel;
+    }
+#endif
+    Ptr<MultiHopLoraAbstractChannel> abstractChannel;
+    if (!channel && phyMode == "abstract")
+    {
+        //the paper scenarios replace the loss model below, the link table is built on first transmission
+        abstractChannel = CreateObject<MultiHopLoraAbstractChannel>(generatedLoss, CreateObject<ConstantSpeedPropagationDelayModel>());
+        channel = abstractChannel;
+    }
+    //without a range the grid channel is a full broadcast
+    Ptr<MultiHopLoraGridChannel> gridChannel;
+    if (!channel)
+    {
+        gridChannel = CreateObject<MultiHopLoraGridChannel>(generatedLoss, CreateObject<ConstantSpeedPropagationDelayModel>());
+        channel = gridChannel;
+    }
     LoraPhyHelper phyHelper = LoraPhyHelper();
     phyHelper.SetChannel(channel);
 
     LoraHelper helper = LoraHelper();
-    helper.SetPhyHelper(phyHelper);
 
-    //all nodes in the multi-hop network use the same PHY parameters
+    //an end-device PHY decodes one SF on one frequency, the app tunes it to its ring and SF,
+    //gateways get a gateway PHY that hears every SF on every frequency of the plan
+    NodeContainer localGateways;
+    NodeContainer localEndNodes;
+    for (NodeContainer::Iterator it = localNodes.Begin(); it != localNodes.End(); ++it)
+    {
+        bool isGateway = paperTopology ? *it == gatewayNode : topology.IsGateway((*it)->GetId());
+        if (isGateway)
+        {
+            localGateways.Add(*it);
+        }
+        else
+        {
+            localEndNodes.Add(*it);
+        }
+    }
+
     //we are not using LORAWAN MAC, so we install devices directly
-    NetDeviceContainer devices = helper.Install(nodes);
+    phyHelper.SetDeviceType(LoraPhyHelper::ED);
+    helper.SetPhyHelper(phyHelper);
+    NetDeviceContainer devices = helper.Install(localEndNodes);
+    phyHelper.SetDeviceType(LoraPhyHelper::GW);
+    helper.SetPhyHelper(phyHelper);
+    devices.Add(helper.Install(localGateways));
 
     //set ccconsistent SF and frequency for all devices
     //note: the lorawan module primarily configure device via the MAC layer
@@ -57,9 +307,8 @@ int main(int argc, char *argv[])
     {
         Ptr<LoraNetDevice> loraDevice = devices.Get(i)->GetObject<LoraNetDevice>();
         Ptr<LoraPhy> phy = loraDevice->GetPhy();
-        //the lorawan module does not expose aa simple SetSpreadingFactor on the helper
-        //we rely on the default channel/PHY settings for this simulation
-        //all devices on the same channel will be able to communicate
+        //the SF of each frame is chosen by the app (AdaptiveSf) and carried in a MultiHopLoraTxTag,
+        //which the channel applies; the app tunes end-device PHYs to the network-wide receive SF
         phy->SetTxPower(12.0); //set tx power to 12 dBm as per paper
     }
 
@@ -68,7 +317,28 @@ int main(int argc, char *argv[])
     mobility.SetMobilityModel("ns3::ConstantPositionMobilityModel");
     mobility.Install(nodes);
 
-    if (scenario == "unobstructed")
+    if (!paperTopology)
+    {
+        NS_LOG_INFO("Configuring generated " << topologyMode << " topology with " << nodes.GetN() << " nodes");
+        topology.Install(nodes);
+        if (lossCache)
+        {
+            lossCache->Prefill(nodes, lossThreads);
+        }
+        if (!distributed)
+        {
+            channel->SetPropagationLossModel(generatedLoss);
+        }
+        topology.ComputeLgw(nodes, generatedLoss, 12.0, sensitivity, maxLinkRange);
+        if (gridChannel && spatialIndex)
+        {
+            //LogDistance grows with distance, so beyond this range even every other node sending at once stays under the floor
+            double linkFloor = gridChannel->GetLinkFloor(nodes.GetN() - 1);
+            gridChannel->SetMaxRange(MultiHopLoraGridChannel::ComputeRange(logDistance, 12.0, linkFloor, 1e6));
+            NS_LOG_INFO("Frames reach PHYs within " << gridChannel->GetMaxRange() << " m (" << linkFloor << " dBm link floor)");
+        }
+    }
+    else if (scenario == "unobstructed")
     {
         NS_LOG_INFO("Configuring UNOBSTRUCTED scenario");
         //place nodes in a line, 1.8m apart as in fig.5
@@ -78,7 +348,7 @@ int main(int argc, char *argv[])
         gatewayNode->GetObject<ConstantPositionMobilityModel>()->SetPosition(Vector(5.4, 0, 1.5));
 
         //use a simple propagation model for LoS
-        channel->SetPropagationLossModel(CreateObject<LogDistancePropagationLossModel>());
+        channel->SetPropagationLossModel(withCache(CreateObject<LogDistancePropagationLossModel>()));
     }
     else // Default to obstructed scenario
     {
@@ -112,56 +382,449 @@ int main(int argc, char *argv[])
         BuildingsHelper::MakeMobilityModelConsistent();
 
         //use buildingsPropagationLossModel for NLoS
-        channel->SetPropagationLossModel(CreateObject<HybridBuildingsPropagationLossModel>());
+        channel->SetPropagationLossModel(withCache(CreateObject<HybridBuildingsPropagationLossModel>()));
     }
 
     //---Aplication Deployment---//
-    double packetInterval = simulationTime / numPackets;
+    double packetInterval = packetIntervalArg > 0 ? packetIntervalArg : simulationTime / numPackets;
     uint32_t packetSize = 32; //assumed payload size
 
+    //every source gets its own traffic model, so its draws only depend on its node ID
+    NS_ABORT_MSG_IF(trafficMode != "fixed" && trafficMode != "periodic" && trafficMode != "poisson" && trafficMode != "burst" && trafficMode != "trace",
+                    "Unknown traffic '" << trafficMode << "'");
+    NS_ABORT_MSG_IF(trafficMode == "trace" && trafficFile.empty(), "Trace traffic needs a trafficFile");
+    Config::SetDefault("ns3::MultiHopLoraTrafficModel::PayloadSize", StringValue(payloadSize));
+    bool allSources = trafficMode == "trace"; //the file decides which nodes send
+    Ptr<MultiHopLoraEventField> eventField;
+    if (trafficMode == "burst")
+    {
+        eventField = CreateObject<MultiHopLoraEventField>();
+        eventField->SetAttribute("MeanInterval", TimeValue(Seconds(packetInterval)));
+        eventField->SetAttribute("Radius", DoubleValue(eventRadius));
+    }
+    auto makeTraffic = [&](uint32_t i) -> Ptr<MultiHopLoraTrafficModel> {
+        Ptr<MultiHopLoraTrafficModel> traffic;
+        if (trafficMode == "periodic")
+        {
+            traffic = CreateObject<MultiHopLoraPeriodicTraffic>();
+            traffic->SetAttribute("Interval", TimeValue(Seconds(packetInterval)));
+            traffic->SetAttribute("Jitter", TimeValue(Seconds(jitter)));
+        }
+        else if (trafficMode == "poisson")
+        {
+            traffic = CreateObject<MultiHopLoraPoissonTraffic>();
+            traffic->SetAttribute("MeanInterval", TimeValue(Seconds(packetInterval)));
+        }
+        else if (trafficMode == "burst")
+        {
+            Ptr<MultiHopLoraBurstTraffic> burst = CreateObject<MultiHopLoraBurstTraffic>();
+            burst->SetNodeId(i);
+            eventField->AddSource(burst, nodes.Get(i)->GetObject<MobilityModel>()->GetPosition());
+            traffic = burst;
+        }
+        else if (trafficMode == "trace")
+        {
+            traffic = CreateObject<MultiHopLoraTraceTraffic>();
+            traffic->SetAttribute("FileName", StringValue(trafficFile));
+        }
+        return traffic;
+    };
+
     //install aappliication on all nodes
     ApplicationContainer apps;
+    std::vector<uint8_t> expectedLgw; //per app, what the gradient should converge to
+    auto initialLgw = [gradient](uint8_t lgw, bool isGateway) { return gradient && !isGateway ? uint8_t(255) : lgw; };
+
+    if (!paperTopology)
+    {
+        //sources are the reachable end devices with the largest LGw
+        std::vector<uint32_t> order;
+        for (uint32_t i = 0; i < topology.GetN(); ++i)
+        {
+            if (!topology.IsGateway(i) && topology.GetLgw(i) != 255)
+            {
+                order.push_back(i);
+            }
+        }
+        std::stable_sort(order.begin(), order.end(), [&topology](uint32_t a, uint32_t b) {
+            return topology.GetLgw(a) > topology.GetLgw(b);
+        });
+        std::vector<bool> isSource(topology.GetN(), false);
+        for (uint32_t i = 0; i < (allSources ? order.size() : std::min<uint32_t>(numSources, order.size())); ++i)
+        {
+            isSource[order[i]] = true;
+        }
+
+        for (uint32_t i = 0; i < nodes.GetN(); ++i)
+        {
+            if (distributed && owner[i] != rank)
+            {
+                //every rank must draw the same events over the same field
+                if (eventField && isSource[i])
+                {
+                    eventField->AddSource(0, topology.GetPosition(i));
+                }
+                continue;
+            }
+            Ptr<MultiHopLoraApp> app = CreateObject<MultiHopLoraApp>();
+            nodes.Get(i)->AddApplication(app);
+            app->Setup(i, initialLgw(topology.GetLgw(i), topology.IsGateway(i)), topology.IsGateway(i), isSource[i], packetInterval, packetSize);
+            if (isSource[i])
+            {
+                app->SetTrafficModel(makeTraffic(i));
+            }
+            apps.Add(app);
+            expectedLgw.push_back(topology.GetLgw(i));
+        }
+    }
+    else
+    {
+        //source node (ID = 0, LGW = 4)
+        Ptr<MultiHopLoraApp> sourceApp = CreateObject<MultiHopLoraApp>();
+        sourceNode->AddApplication(sourceApp);
+        sourceApp->Setup(0, initialLgw(4, false), false, true, packetInterval, packetSize);
+        sourceApp->SetTrafficModel(makeTraffic(0));
+        apps.Add(sourceApp);
+        expectedLgw.push_back(4);
+
+        // Repeater 1 (ID 1, LGw=3)
+        Ptr<MultiHopLoraApp> repeater1App = CreateObject<MultiHopLoraApp>();
+        repeater1Node->AddApplication(repeater1App);
+        repeater1App->Setup(1, initialLgw(3, false), false, allSources, packetInterval, packetSize);
+        repeater1App->SetTrafficModel(allSources ? makeTraffic(1) : 0);
+        apps.Add(repeater1App);
+        expectedLgw.push_back(3);
+
+        // Repeater 2 (ID 2, LGw=2)
+        Ptr<MultiHopLoraApp> repeater2App = CreateObject<MultiHopLoraApp>();
+        repeater2Node->AddApplication(repeater2App);
+        repeater2App->Setup(2, initialLgw(2, false), false, allSources, packetInterval, packetSize);
+        repeater2App->SetTrafficModel(allSources ? makeTraffic(2) : 0);
+        apps.Add(repeater2App);
+        expectedLgw.push_back(2);
+
+        // Gateway Node (ID 3, LGw=1)
+        Ptr<MultiHopLoraApp> gatewayApp = CreateObject<MultiHopLoraApp>();
+        gatewayNode->AddApplication(gatewayApp);
+        gatewayApp->Setup(3, 1, true, false, packetInterval, packetSize);
+        apps.Add(gatewayApp);
+        expectedLgw.push_back(1);
+    }
+
+    //network server behind all gateways on an ideal fixed-delay backhaul, created after the
+    //LoRa nodes so their IDs do not change. gateways on different ranks cannot share it
+    Ptr<MultiHopLoraNetworkServer> server;
+    if (networkServer && !distributed)
+    {
+        Ptr<Node> serverNode = CreateObject<Node>();
+        server = CreateObject<MultiHopLoraNetworkServer>();
+        serverNode->AddApplication(server);
+        for (uint32_t i = 0; i < apps.GetN(); ++i)
+        {
+            Ptr<MultiHopLoraApp> app = DynamicCast<MultiHopLoraApp>(apps.Get(i));
+            if (app->IsGateway())
+            {
+                app->SetNetworkServer(server, MilliSeconds(backhaulDelay));
+            }
+            else
+            {
+                app->TraceConnectWithoutContext("Send", MakeCallback(&MultiHopLoraNetworkServer::NotifySend, server));
+            }
+        }
+    }
+
+    //one socket of the host carries the PUSH_DATA of every gateway, each under its own EUI
+    Ptr<MultiHopLoraPacketForwarder> forwarder;
+    if (!forwarderEndpoint.empty())
+    {
+        std::size_t colon = forwarderEndpoint.rfind(':');
+        NS_ABORT_MSG_IF(colon == std::string::npos, "--forwarder must be host:port");
+        forwarder = CreateObject<MultiHopLoraPacketForwarder>();
+        forwarder->SetAttribute("RemoteAddress", StringValue(forwarderEndpoint.substr(0, colon)));
+        forwarder->SetAttribute("RemotePort", UintegerValue(std::stoul(forwarderEndpoint.substr(colon + 1))));
+        for (uint32_t i = 0; i < apps.GetN(); ++i)
+        {
+            Ptr<MultiHopLoraApp> app = DynamicCast<MultiHopLoraApp>(apps.Get(i));
+            if (app->IsGateway())
+            {
+                app->SetPacketForwarder(forwarder);
+            }
+        }
+    }
+
+    //one stream per app keyed on the node ID, so draws do not depend on creation order or partitioning
+    for (uint32_t i = 0; i < apps.GetN(); ++i)
+    {
+        Ptr<MultiHopLoraApp> app = DynamicCast<MultiHopLoraApp>(apps.Get(i));
+        app->AssignStreams(1000 + app->GetNode()->GetId());
+        if (app->GetTrafficModel())
+        {
+            app->GetTrafficModel()->AssignStreams(1000000 + 4 * app->GetNode()->GetId());
+        }
+    }
+    if (eventField)
+    {
+        eventField->AssignStreams(900);
+    }
+    if (abstractChannel)
+    {
+        abstractChannel->AssignStreams(800);
+    }
 
-    //source node (ID = 0, LGW = 4)
-    Ptr<MultiHopLoraApp> sourceApp = CreateObject<MultiHopLoraApp>();
-    sourceNode->AddApplication(sourceApp);
-    sourceApp->Setup(0, 4, false, true, packetInterval, packetSize);
-    apps.Add(sourceApp);
-
-    // Repeater 1 (ID 1, LGw=3)
-    Ptr<MultiHopLoraApp> repeater1App = CreateObject<MultiHopLoraApp>();
-    repeater1Node->AddApplication(repeater1App);
-    repeater1App->Setup(1, 3, false, false, packetInterval, packetSize);
-    apps.Add(repeater1App);
-
-    // Repeater 2 (ID 2, LGw=2)
-    Ptr<MultiHopLoraApp> repeater2App = CreateObject<MultiHopLoraApp>();
-    repeater2Node->AddApplication(repeater2App);
-    repeater2App->Setup(2, 2, false, false, packetInterval, packetSize);
-    apps.Add(repeater2App);
-
-    // Gateway Node (ID 3, LGw=1)
-    Ptr<MultiHopLoraApp> gatewayApp = CreateObject<MultiHopLoraApp>();
-    gatewayNode->AddApplication(gatewayApp);
-    gatewayApp->Setup(3, 1, true, false, packetInterval, packetSize);
-    apps.Add(gatewayApp);
+#ifdef NS3_MPI
+    if (distributed)
+    {
+        //portal r is the first node of rank r, remote frames for that rank are addressed to it
+        std::vector<uint32_t> portals(numRanks, 0);
+        for (uint32_t i = owner.size(); i-- > 0;)
+        {
+            portals[owner[i]] = i;
+        }
+        mpiChannel->SetPartition(edges, portals, maxLinkRange, mpiCull);
+        for (uint32_t i = 0; i < devices.GetN(); ++i)
+        {
+            mpiChannel->AddLocalPhy(devices.Get(i)->GetObject<LoraNetDevice>()->GetPhy());
+        }
+        Ptr<MpiReceiver> receiver = CreateObject<MpiReceiver>();
+        receiver->SetReceiveCallback(MakeCallback(&MultiHopLoraMpiChannel::ReceiveRemote, mpiChannel));
+        nodes.Get(portals[rank])->GetDevice(0)->AggregateObject(receiver);
+
+        //no frame can reach another partition sooner than the radio latency plus the shortest cross-partition propagation delay
+        Time lookahead = mpiChannel->ComputeLookahead(nodes, owner);
+        NS_ABORT_MSG_IF(!lookahead.IsStrictlyPositive(), "Nodes of different partitions are co-located, lookahead is zero");
+        mpiChannel->SetLookahead(lookahead);
+        DynamicCast<DistributedSimulatorImpl>(Simulator::GetImplementation())->BoundLookAhead(lookahead);
+        NS_LOG_INFO("Rank " << rank << " lookahead " << lookahead.GetNanoSeconds() << "ns");
+    }
+#endif
 
     apps.Start(Seconds(1.0));
     apps.Stop(Seconds(simulationTime - 1.0));
+    if (eventField)
+    {
+        Simulator::Schedule(Seconds(1.0), &MultiHopLoraEventField::Start, eventField);
+        Simulator::Schedule(Seconds(simulationTime - 1.0), &MultiHopLoraEventField::Stop, eventField);
+    }
 
-    // --- Data Collection (FlowMonitor) ---//
-    FlowMonitorHelper flowmon;
-    Ptr<FlowMonitor> monitor = flowmon.InstallAll();
+    // --- Data Collection ---//
+    //FlowMonitor only follows IP flows, the protocol metrics come from the app trace sources
+    MultiHopLoraMetrics metrics;
+    metrics.SetRecording(distributed);
+    for (uint32_t i = 0; i < apps.GetN(); ++i)
+    {
+        metrics.Attach(DynamicCast<MultiHopLoraApp>(apps.Get(i)));
+    }
 
     //--- Run Simulation --//
+    if (!traceFile.empty())
+    {
+        //every rank traces its own nodes
+        MultiHopLoraTrace::Open(distributed ? traceFile + "." + std::to_string(rank) : traceFile);
+    }
     Simulator::Stop(Seconds(simulationTime));
+    SystemWallClockMs wallClock;
+    wallClock.Start();
     Simulator::Run();
+    double wallSeconds = wallClock.End() / 1000.0;
+    uint64_t events = Simulator::GetEventCount();
+    MultiHopLoraTrace::Close();
 
     //--- Performance Analysis ---//
-    monitor->CheckForLostPackets();
-    monitor->SerializeToXmlFile("multi-hop-lora-results.xml", true, true);
+    uint64_t sent = 0, forwarded = 0, delivered = 0, suppressed = 0, savedNs = 0, beacons = 0, beaconNs = 0;
+    int64_t convergenceNs = 0; //last LGw change of any node
+    for (uint32_t i = 0; i < apps.GetN(); ++i)
+    {
+        Ptr<MultiHopLoraApp> app = DynamicCast<MultiHopLoraApp>(apps.Get(i));
+        sent += app->GetPacketsSent();
+        forwarded += app->GetPacketsForwarded();
+        suppressed += app->GetForwardsSuppressed();
+        savedNs += app->GetAirtimeSaved().GetNanoSeconds();
+        beacons += app->GetBeaconsSent();
+        beaconNs += app->GetBeaconAirtime().GetNanoSeconds();
+        convergenceNs = std::max(convergenceNs, app->GetLastLgwChange().GetNanoSeconds());
+    }
+    //gateways each count their own distinct LFIDs, the metrics count an LFID once however many gateways heard it
+    delivered = metrics.GetDelivered();
+    //in distributed runs rank 0 merges the sends and deliveries of every rank, so the delivery and latency
+    //figures are those of the sequential run
+    MultiHopLoraMetrics merged;
+    const MultiHopLoraMetrics *summary = &metrics;
+#ifdef NS3_MPI
+    if (distributed)
+    {
+        uint64_t local[7] = {sent, forwarded, events, suppressed, savedNs, beacons, beaconNs};
+        uint64_t total[7] = {0, 0, 0, 0, 0, 0, 0};
+        MPI_Reduce(local, total, 7, MPI_UINT64_T, MPI_SUM, 0, MPI_COMM_WORLD);
+        sent = total[0];
+        forwarded = total[1];
+        events = total[2];
+        suppressed = total[3];
+        savedNs = total[4];
+        beacons = total[5];
+        beaconNs = total[6];
+        int64_t localNs = convergenceNs;
+        MPI_Reduce(&localNs, &convergenceNs, 1, MPI_INT64_T, MPI_MAX, 0, MPI_COMM_WORLD);
+
+        const std::vector<MultiHopLoraMetrics::Record> &records = metrics.GetRecords();
+        int bytes = records.size() * sizeof(MultiHopLoraMetrics::Record);
+        std::vector<int> counts(numRanks, 0);
+        std::vector<int> offsets(numRanks, 0);
+        MPI_Gather(&bytes, 1, MPI_INT, counts.data(), 1, MPI_INT, 0, MPI_COMM_WORLD);
+        uint64_t totalBytes = 0;
+        for (uint32_t r = 0; r < numRanks; ++r)
+        {
+            offsets[r] = totalBytes;
+            totalBytes += counts[r];
+        }
+        NS_ABORT_MSG_IF(totalBytes > uint64_t(std::numeric_limits<int>::max()), "Too many sends and deliveries to gather on rank 0");
+        std::vector<MultiHopLoraMetrics::Record> all(rank == 0 ? totalBytes / sizeof(MultiHopLoraMetrics::Record) : 0);
+        MPI_Gatherv(records.data(), bytes, MPI_BYTE, all.data(), counts.data(), offsets.data(), MPI_BYTE, 0, MPI_COMM_WORLD);
+        if (rank == 0)
+        {
+            merged.Replay(std::move(all));
+            summary = &merged;
+        }
+    }
+#endif
+    sent = distributed ? summary->GetSent() : sent;
+    delivered = summary->GetDelivered();
+    double pdr = sent > 0 ? double(delivered) / sent : 0.0;
+    NS_LOG_INFO("Sent " << sent << ", delivered " << delivered << " (PDR " << pdr << "), forwarded " << forwarded);
+
+    if (!resultsFile.empty() && rank == 0)
+    {
+        //one row per run, the key columns come first so sweeps can group on them
+        std::ifstream existing(resultsFile);
+        bool writeHeader = !existing.good() || existing.peek() == std::ifstream::traits_type::eof();
+        existing.close();
+        std::ofstream out(resultsFile, std::ios::app);
+        if (writeHeader)
+        {
+            out << "scenario,topology,numPackets,packetInterval,run,sent,delivered,forwarded,pdr,events,wallSeconds,suppressed,airtimeSaved,beacons,beaconAirtime,convergence,latencyP50,latencyP99" << std::endl;
+        }
+        out << scenario << "," << topologyMode << "," << numPackets << "," << packetInterval << "," << RngSeedManager::GetRun()
+            << "," << sent << "," << delivered << "," << forwarded << "," << pdr << "," << events << "," << wallSeconds
+            << "," << suppressed << "," << savedNs / 1e9 << "," << beacons << "," << beaconNs / 1e9 << "," << convergenceNs / 1e9
+            << "," << summary->GetLatencyPercentile(50).GetSeconds() << "," << summary->GetLatencyPercentile(99).GetSeconds() << std::endl;
+    }
+
+    //in distributed runs each rank only sees its own nodes, e.g. a delivery of a packet sent on another rank counts as late
+    if (distributed && rank == 0)
+    {
+        std::cout << "--- Metrics (all ranks) ---" << std::endl;
+        merged.Print(std::cout);
+    }
+    if (distributed)
+    {
+        std::cout << "--- Rank " << rank << " metrics (local nodes only) ---" << std::endl;
+    }
+    else
+    {
+        std::cout << "--- Metrics ---" << std::endl;
+    }
+    metrics.Print(std::cout);
+
+    //transmit queues: occupancy and waits over all local nodes
+    uint64_t queued = 0, ageDrops = 0, overflowDrops = 0, deferrals = 0;
+    uint32_t peakSize = 0;
+    double meanSize = 0, waitSum = 0, maxWait = 0;
+    for (uint32_t i = 0; i < apps.GetN(); ++i)
+    {
+        const MultiHopLoraTxScheduler &queue = DynamicCast<MultiHopLoraApp>(apps.Get(i))->GetTxScheduler();
+        queued += queue.GetSent();
+        ageDrops += queue.GetAgeDrops();
+        overflowDrops += queue.GetOverflowDrops();
+        deferrals += queue.GetDeferrals();
+        peakSize = std::max(peakSize, queue.GetMaxSize());
+        meanSize += queue.GetMeanSize();
+        waitSum += queue.GetMeanWait().GetSeconds() * queue.GetSent();
+        maxWait = std::max(maxWait, queue.GetMaxWait().GetSeconds());
+    }
+    if (apps.GetN() > 0)
+    {
+        std::cout << "Transmit queue: " << queued << " frames sent, mean wait " << (queued > 0 ? waitSum / queued * 1000.0 : 0.0) << " ms, max wait "
+                  << maxWait * 1000.0 << " ms, mean occupancy " << meanSize / apps.GetN() << ", peak " << peakSize << ", duty-cycle deferrals "
+                  << deferrals << ", dropped " << ageDrops << " by age and " << overflowDrops << " by overflow" << std::endl;
+
+        //windows due in the same tick share one event, see WindowTick
+        uint64_t windows = 0, windowEvents = 0;
+        for (uint32_t i = 0; i < apps.GetN(); ++i)
+        {
+            Ptr<MultiHopLoraApp> app = DynamicCast<MultiHopLoraApp>(apps.Get(i));
+            windows += app->GetWindowsOpened();
+            windowEvents += app->GetWindowEvents();
+        }
+        std::cout << "Contention windows: " << windows << " opened, closed by " << windowEvents << " simulator events" << std::endl;
+
+        //with AdaptiveSf this is where every node ended up
+        uint32_t perSf[6] = {0, 0, 0, 0, 0, 0};
+        for (uint32_t i = 0; i < apps.GetN(); ++i)
+        {
+            Ptr<MultiHopLoraApp> app = DynamicCast<MultiHopLoraApp>(apps.Get(i));
+            if (!app->IsGateway())
+            {
+                perSf[app->GetTxSpreadingFactor() - 7]++;
+            }
+        }
+        std::cout << "Spreading factors:";
+        for (uint32_t sf = 7; sf <= 12; ++sf)
+        {
+            if (perSf[sf - 7] > 0)
+            {
+                std::cout << " SF" << sf << "=" << perSf[sf - 7];
+            }
+        }
+        std::cout << std::endl;
+
+        //beacons see the real channel, so a node may legitimately end up off the computed LGw
+        if (gradient)
+        {
+            uint32_t matching = 0;
+            for (uint32_t i = 0; i < apps.GetN(); ++i)
+            {
+                matching += DynamicCast<MultiHopLoraApp>(apps.Get(i))->GetLgw() == expectedLgw[i];
+            }
+            std::cout << "Gradient: " << matching << " of " << apps.GetN() << " nodes on the computed LGw" << std::endl;
+        }
+    }
+    if (eventField)
+    {
+        std::cout << "Events: " << eventField->GetEvents() << " triggered " << eventField->GetTriggers() << " bursts" << std::endl;
+    }
+    if (gridChannel && gridChannel->GetMaxRange() > 0)
+    {
+        std::cout << "Channel: " << gridChannel->GetDelivered() << " receptions scheduled, " << gridChannel->GetCulled() << " culled beyond "
+                  << gridChannel->GetMaxRange() << " m" << std::endl;
+    }
+    if (abstractChannel)
+    {
+        std::cout << "Abstract PHY: " << abstractChannel->GetDelivered() << " receptions delivered, " << abstractChannel->GetCollisions() << " collided, "
+                  << abstractChannel->GetHalfDuplexLosses() << " lost to half-duplex, " << abstractChannel->GetPerLosses() << " lost to PER" << std::endl;
+    }
+    if (lossCache)
+    {
+        std::cout << "Path-loss cache: " << lossCache->GetHits() << " hits, " << lossCache->GetMisses() << " evaluations, "
+                  << lossCache->GetEntries() << " pairs " << (lossCache->IsDense() ? "in a matrix" : "hashed") << ", "
+                  << lossCache->GetInvalidations() << " invalidations" << std::endl;
+    }
+    if (server)
+    {
+        server->Print(std::cout);
+    }
+    if (forwarder)
+    {
+        forwarder->Dispose(); //collects the last acknowledgements
+        std::cout << "Packet forwarder: " << forwarder->GetSent() << " PUSH_DATA sent to " << forwarderEndpoint << ", " << forwarder->GetSendErrors()
+                  << " refused, " << forwarder->GetAcks() << " acknowledged, mean round trip " << forwarder->GetMeanAckRtt() * 1000.0 << " ms" << std::endl;
+    }
 
     Simulator::Destroy();
+#ifdef NS3_MPI
+    if (distributed)
+    {
+        MpiInterface::Disable();
+    }
+#endif
 
     NS_LOG_INFO("Simulated Finished");
     return 0;
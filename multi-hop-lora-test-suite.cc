@@ -0,0 +1,583 @@
+#include "multi-hop-lora-app.h"
+#include "multi-hop-lora-cache.h"
+#include "multi-hop-lora-channel.h"
+#include "multi-hop-lora-header.h"
+#include "multi-hop-lora-scheduler.h"
+#include "ns3/constant-position-mobility-model.h"
+#include "ns3/lora-net-device.h"
+#include "ns3/node.h"
+#include "ns3/packet.h"
+#include "ns3/propagation-delay-model.h"
+#include "ns3/propagation-loss-model.h"
+#include "ns3/simple-end-device-lora-phy.h"
+#include "ns3/simulator.h"
+#include "ns3/test.h"
+#include <cmath>
+#include <random>
+#include <vector>
+
+namespace ns3 {
+
+//streaming and buffered selection must pick the same copy of an LFID, i.e. the same forwarder
+class MultiHopLoraSelectionTestCase: public TestCase
+{
+public:
+    MultiHopLoraSelectionTestCase();
+
+private:
+    virtual void DoRun(void);
+
+    //last hop of the copy each mode selects, 0 when it selects none
+    uint32_t Streaming(Ptr<MultiHopLoraApp> app, const std::vector<Ptr<Packet>> &copies) const;
+    uint32_t Buffered(Ptr<MultiHopLoraApp> app, const std::vector<Ptr<Packet>> &copies) const;
+    void Check(uint8_t ownLgw, const std::vector<Ptr<Packet>> &copies, const std::string &what);
+};
+
+namespace {
+
+//a copy relayed by forwarder, which is the last node of its path
+Ptr<Packet>
+MakeCopy(uint8_t lh, uint8_t lgw, uint32_t forwarder)
+{
+    MultiHopLoraHeader header;
+    header.SetLfid(MultiHopLoraHeader::MakeLfid(1, 7));
+    header.SetLnid(1);
+    header.SetLpty(MultiHopLoraHeader::LPTY_DATA);
+    header.SetLh(lh);
+    header.SetLgw(lgw);
+    header.AddNodeToPath(1);
+    header.AddNodeToPath(forwarder);
+    Ptr<Packet> packet = Create<Packet>(32);
+    packet->AddHeader(header);
+    return packet;
+}
+
+uint32_t
+Forwarder(Ptr<Packet> packet)
+{
+    if (!packet)
+    {
+        return 0;
+    }
+    MultiHopLoraHeader header;
+    packet->PeekHeader(header);
+    return header.GetPath()[header.GetPath().size() - 1];
+}
+
+} //namespace
+
+MultiHopLoraSelectionTestCase::MultiHopLoraSelectionTestCase()
+    :TestCase("Streaming selection picks the forwarder of the buffered F1/F2/max-LGw policy")
+{}
+
+uint32_t
+MultiHopLoraSelectionTestCase::Streaming(Ptr<MultiHopLoraApp> app, const std::vector<Ptr<Packet>> &copies) const
+{
+    MultiHopLoraApp::Candidate best{nullptr, 0, 0, 0, 0, 0, 0};
+    for (const Ptr<Packet> &packet : copies)
+    {
+        MultiHopLoraPrefixHeader header;
+        packet->PeekHeader(header);
+        best.copies++;
+        app->UpdateCandidate(best, packet, header);
+    }
+    return Forwarder(app->SelectCandidate(best));
+}
+
+uint32_t
+MultiHopLoraSelectionTestCase::Buffered(Ptr<MultiHopLoraApp> app, const std::vector<Ptr<Packet>> &copies) const
+{
+    return Forwarder(app->SelectBuffered(copies));
+}
+
+void
+MultiHopLoraSelectionTestCase::Check(uint8_t ownLgw, const std::vector<Ptr<Packet>> &copies, const std::string &what)
+{
+    Ptr<MultiHopLoraApp> app = CreateObject<MultiHopLoraApp>();
+    app->Setup(100, ownLgw, false, false, 20.0, 32);
+    NS_TEST_ASSERT_MSG_EQ(Streaming(app, copies), Buffered(app, copies), what << " (own LGw " << int(ownLgw) << ", " << copies.size() << " copies)");
+}
+
+void
+MultiHopLoraSelectionTestCase::DoRun(void)
+{
+    //F1 is empty: every copy comes from RETREAT_FACTOR or more rings closer to the gateway
+    Check(3, {MakeCopy(2, 2, 11), MakeCopy(1, 1, 12)}, "empty F1");
+    //one copy with the fewest hops
+    Check(3, {MakeCopy(3, 3, 11), MakeCopy(2, 4, 12), MakeCopy(4, 5, 13)}, "single F2 member");
+    //F2 ties go to the highest LGw, and among equal LGw to the earliest arrival
+    Check(3, {MakeCopy(2, 3, 11), MakeCopy(2, 5, 12), MakeCopy(2, 5, 13), MakeCopy(2, 4, 14)}, "F2 tie on LGw");
+    //a tie where every LGw is 0 selects nothing in the buffered scan
+    Check(0, {MakeCopy(1, 0, 11), MakeCopy(1, 0, 12)}, "F2 tie at LGw 0");
+    Check(0, {MakeCopy(1, 0, 11)}, "lone copy at LGw 0");
+
+    //random duplicate sets, the mix the bench selection benchmark uses
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<int> lh(1, 6);
+    std::uniform_int_distribution<int> lgw(0, 6);
+    std::uniform_int_distribution<int> count(1, 20);
+    for (uint32_t round = 0; round < 2000; ++round)
+    {
+        std::vector<Ptr<Packet>> copies;
+        uint32_t n = count(rng);
+        for (uint32_t i = 0; i < n; ++i)
+        {
+            copies.push_back(MakeCopy(uint8_t(lh(rng)), uint8_t(lgw(rng)), 1000 + i));
+        }
+        Check(uint8_t(lgw(rng)), copies, "random set " + std::to_string(round));
+    }
+}
+
+//both wire formats must read back what was written, and the prefix view must agree with the full header
+class MultiHopLoraHeaderTestCase: public TestCase
+{
+public:
+    MultiHopLoraHeaderTestCase();
+
+private:
+    virtual void DoRun(void);
+
+    //serializes header in front of a payload and checks what both header classes read back
+    void RoundTrip(const MultiHopLoraHeader &header, uint32_t expectedSize, const std::string &what);
+    //deserializes a hand-built frame whose path is longer than the capacity
+    void Truncated(const std::vector<uint8_t> &frame, uint32_t lnid, uint32_t firstHop, int32_t step, const std::string &what);
+
+    static constexpr uint32_t PAYLOAD = 5;
+};
+
+MultiHopLoraHeaderTestCase::MultiHopLoraHeaderTestCase()
+    :TestCase("v1, v2 and path-hash headers round-trip, with varint boundaries and path truncation")
+{}
+
+void
+MultiHopLoraHeaderTestCase::RoundTrip(const MultiHopLoraHeader &header, uint32_t expectedSize, const std::string &what)
+{
+    NS_TEST_ASSERT_MSG_EQ(header.GetSerializedSize(), expectedSize, what << ": serialized size");
+    Ptr<Packet> packet = Create<Packet>(PAYLOAD);
+    packet->AddHeader(header);
+    NS_TEST_ASSERT_MSG_EQ(packet->GetSize(), expectedSize + PAYLOAD, what << ": frame size");
+
+    MultiHopLoraPrefixHeader prefix;
+    packet->PeekHeader(prefix);
+    MultiHopLoraHeader read;
+    NS_TEST_ASSERT_MSG_EQ(packet->RemoveHeader(read), expectedSize, what << ": bytes consumed");
+    NS_TEST_ASSERT_MSG_EQ(packet->GetSize(), PAYLOAD, what << ": payload left");
+
+    NS_TEST_ASSERT_MSG_EQ(read.GetLfid(), header.GetLfid(), what << ": LFID");
+    NS_TEST_ASSERT_MSG_EQ(read.GetLnid(), header.GetLnid(), what << ": LNID");
+    NS_TEST_ASSERT_MSG_EQ(int(read.GetLpty()), int(header.GetLpty()), what << ": LPTY");
+    NS_TEST_ASSERT_MSG_EQ(int(read.GetLh()), int(header.GetLh()), what << ": LH");
+    NS_TEST_ASSERT_MSG_EQ(int(read.GetLgw()), int(header.GetLgw()), what << ": LGw");
+    NS_TEST_ASSERT_MSG_EQ(int(read.GetSf()), int(header.GetSf()), what << ": SF");
+    NS_TEST_ASSERT_MSG_EQ(read.GetPathHash(), header.GetPathHash(), what << ": path hash");
+    if (header.IsPathHashOnly())
+    {
+        NS_TEST_ASSERT_MSG_EQ(read.GetPath().empty(), true, what << ": a path-hash frame carries no path");
+    }
+    else
+    {
+        NS_TEST_ASSERT_MSG_EQ(read.GetPath() == header.GetPath(), true, what << ": path");
+    }
+
+    NS_TEST_ASSERT_MSG_EQ(prefix.GetLfid(), header.GetLfid(), what << ": prefix LFID");
+    NS_TEST_ASSERT_MSG_EQ(prefix.GetLnid(), header.GetLnid(), what << ": prefix LNID");
+    NS_TEST_ASSERT_MSG_EQ(int(prefix.GetLpty()), int(header.GetLpty()), what << ": prefix LPTY");
+    NS_TEST_ASSERT_MSG_EQ(int(prefix.GetLh()), int(header.GetLh()), what << ": prefix LH");
+    NS_TEST_ASSERT_MSG_EQ(int(prefix.GetLgw()), int(header.GetLgw()), what << ": prefix LGw");
+    NS_TEST_ASSERT_MSG_EQ(int(prefix.GetSf()), int(header.GetSf()), what << ": prefix SF");
+}
+
+void
+MultiHopLoraHeaderTestCase::Truncated(const std::vector<uint8_t> &frame, uint32_t lnid, uint32_t firstHop, int32_t step, const std::string &what)
+{
+    std::vector<uint8_t> bytes(frame);
+    bytes.resize(frame.size() + PAYLOAD, 0xaa);
+    Ptr<Packet> packet = Create<Packet>(bytes.data(), bytes.size());
+    MultiHopLoraHeader read;
+    NS_TEST_ASSERT_MSG_EQ(packet->RemoveHeader(read), frame.size(), what << ": the whole path should be consumed");
+    NS_TEST_ASSERT_MSG_EQ(packet->GetSize(), PAYLOAD, what << ": payload left");
+    NS_TEST_ASSERT_MSG_EQ(read.GetLnid(), lnid, what << ": LNID");
+    NS_TEST_ASSERT_MSG_EQ(int(read.GetPath().size()), int(MultiHopLoraHeader::Path::CAPACITY), what << ": path kept up to the capacity");
+    for (uint8_t i = 0; i < read.GetPath().size(); ++i)
+    {
+        NS_TEST_ASSERT_MSG_EQ(read.GetPath()[i], uint32_t(firstHop + i * step), what << ": hop " << int(i));
+    }
+}
+
+void
+MultiHopLoraHeaderTestCase::DoRun(void)
+{
+    const uint8_t capacity = MultiHopLoraHeader::Path::CAPACITY;
+
+    //v1: 11-byte prefix, path count and 4 bytes per node
+    MultiHopLoraHeader v1;
+    v1.SetLfid(MultiHopLoraHeader::MakeLfid(0x7fff, 0xffff));
+    v1.SetLnid(0x7fff);
+    v1.SetLpty(MultiHopLoraHeader::LPTY_DATA);
+    v1.SetSf(12);
+    v1.SetLh(3);
+    v1.SetLgw(4);
+    RoundTrip(v1, 12, "v1 without path");
+    for (uint8_t i = 0; i < capacity; ++i)
+    {
+        v1.AddNodeToPath(0x7fff - i * 1000);
+    }
+    RoundTrip(v1, 12 + 4 * capacity, "v1 with a full path");
+
+    //v2: lpty, varint LNID, sequence, LH, LGw, path count, zigzag varint deltas
+    uint32_t lnids[] = {0, 127, 128, 16383, 16384, 0x8000, MultiHopLoraHeader::MAX_LNID};
+    uint32_t lnidSizes[] = {1, 1, 2, 2, 3, 3, 3};
+    for (uint32_t i = 0; i < 7; ++i)
+    {
+        MultiHopLoraHeader v2;
+        v2.SetLfid(MultiHopLoraHeader::MakeLfid(lnids[i], 0x1234));
+        v2.SetLnid(lnids[i]);
+        v2.SetLpty(MultiHopLoraHeader::LPTY_COMPACT | MultiHopLoraHeader::LPTY_DATA);
+        v2.SetSf(9);
+        v2.SetLh(1);
+        v2.SetLgw(2);
+        RoundTrip(v2, 1 + lnidSizes[i] + 2 + 2 + 1, "v2 LNID " + std::to_string(lnids[i]));
+    }
+
+    //zigzag maps a delta d >= 0 to 2d and d < 0 to -2d - 1, a varint byte holds values below 128
+    struct Delta
+    {
+        int32_t delta;
+        uint32_t size;
+    };
+    Delta deltas[] = {{1, 1}, {-1, 1}, {63, 1}, {-64, 1}, {64, 2}, {-65, 2}, {8191, 2}, {-8192, 2}, {8192, 3}, {-8193, 3}, {-40000, 3}};
+    for (const Delta &d : deltas)
+    {
+        MultiHopLoraHeader v2;
+        v2.SetLfid(MultiHopLoraHeader::MakeLfid(50000, 7));
+        v2.SetLnid(50000);
+        v2.SetLpty(MultiHopLoraHeader::LPTY_COMPACT | MultiHopLoraHeader::LPTY_DATA);
+        v2.AddNodeToPath(50000 + d.delta);
+        RoundTrip(v2, 1 + 3 + 2 + 2 + 1 + d.size, "v2 path delta " + std::to_string(d.delta));
+    }
+
+    //a full path that goes down and up again
+    MultiHopLoraHeader full;
+    full.SetLfid(MultiHopLoraHeader::MakeLfid(300, 9));
+    full.SetLnid(300);
+    full.SetLpty(MultiHopLoraHeader::LPTY_COMPACT | MultiHopLoraHeader::LPTY_DATA);
+    uint32_t fullSize = 1 + 2 + 2 + 2 + 1;
+    uint32_t previous = 300;
+    for (uint8_t i = 0; i < capacity; ++i)
+    {
+        uint32_t nodeId = i % 2 ? 300 + i : 300 - i * 20;
+        full.AddNodeToPath(nodeId);
+        int64_t delta = int64_t(nodeId) - previous;
+        fullSize += (delta >= 0 ? 2 * delta : -2 * delta - 1) < 128 ? 1 : 2;
+        previous = nodeId;
+    }
+    RoundTrip(full, fullSize, "v2 with a full path");
+
+    //path hash instead of the node list
+    full.SetLpty(MultiHopLoraHeader::LPTY_COMPACT | MultiHopLoraHeader::LPTY_PATH_HASH | MultiHopLoraHeader::LPTY_DATA);
+    RoundTrip(full, 1 + 2 + 2 + 2 + 2, "v2 path hash");
+
+    //paths longer than this build holds are cut at the capacity and the rest is skipped
+    uint8_t longer = capacity + 3;
+    std::vector<uint8_t> v1Frame = {0x00, 0x05, 0x00, 0x01, 0x00, 0x00, 0x00, 0x05, MultiHopLoraHeader::LPTY_DATA, 2, 3, longer};
+    std::vector<uint8_t> v2Frame = {MultiHopLoraHeader::LPTY_COMPACT | MultiHopLoraHeader::LPTY_DATA, 0x05, 0x00, 0x01, 2, 3, longer};
+    for (uint8_t i = 0; i < longer; ++i)
+    {
+        uint32_t nodeId = 10 + i;
+        v1Frame.insert(v1Frame.end(), {0, 0, uint8_t(nodeId >> 8), uint8_t(nodeId)});
+        v2Frame.push_back(i == 0 ? 2 * (10 - 5) : 2); //zigzag of +5, then of +1
+    }
+    Truncated(v1Frame, 5, 10, 1, "v1 path past the capacity");
+    Truncated(v2Frame, 5, 10, 1, "v2 path past the capacity");
+}
+
+//the bounded LFID table: eviction of full probe windows, TTL expiry and the false re-forwards
+//an unbounded table would have suppressed
+class MultiHopLoraCacheTestCase: public TestCase
+{
+public:
+    MultiHopLoraCacheTestCase();
+
+private:
+    virtual void DoRun(void);
+};
+
+MultiHopLoraCacheTestCase::MultiHopLoraCacheTestCase()
+    :TestCase("LFID cache evicts, expires and counts false re-forwards once per LFID")
+{}
+
+void
+MultiHopLoraCacheTestCase::DoRun(void)
+{
+    MultiHopLoraCache cache;
+    Time expiry;
+    cache.SetTtl(Seconds(60));
+    cache.Resize(5);
+    NS_TEST_ASSERT_MSG_EQ(cache.GetCapacity(), 8, "capacity should round up to a power of two");
+
+    //8 slots are one probe window, so every LFID collides with every other
+    for (uint32_t i = 0; i < 8; ++i)
+    {
+        cache.Insert(MultiHopLoraHeader::MakeLfid(i, 1), Seconds(i + 1), Seconds(i));
+    }
+    NS_TEST_ASSERT_MSG_EQ(cache.GetEvictions(), 0, "a full table should not have evicted yet");
+    //one more live LFID evicts the one with the earliest deadline, LFID 0 (60 s)
+    cache.Insert(MultiHopLoraHeader::MakeLfid(8, 1), Seconds(9), Seconds(8));
+    NS_TEST_ASSERT_MSG_EQ(cache.GetEvictions(), 1, "inserting past capacity should evict");
+    for (uint32_t i = 1; i <= 8; ++i)
+    {
+        NS_TEST_ASSERT_MSG_EQ(cache.Lookup(MultiHopLoraHeader::MakeLfid(i, 1), Seconds(10), expiry), true, "LFID " << i << " should be retained");
+        NS_TEST_ASSERT_MSG_EQ(expiry, Seconds(i + 1), "LFID " << i << " should keep its window end");
+    }
+    NS_TEST_ASSERT_MSG_EQ(cache.GetHits(), 8, "every retained LFID should be a hit");
+
+    //the evicted LFID comes back while it would still be live: one false re-forward, however often it is looked up
+    NS_TEST_ASSERT_MSG_EQ(cache.Lookup(MultiHopLoraHeader::MakeLfid(0, 1), Seconds(10), expiry), false, "the evicted LFID should be unknown");
+    NS_TEST_ASSERT_MSG_EQ(cache.Lookup(MultiHopLoraHeader::MakeLfid(0, 1), Seconds(11), expiry), false, "the evicted LFID should stay unknown");
+    NS_TEST_ASSERT_MSG_EQ(cache.GetFalseReforwards(), 1, "an evicted LFID should count once");
+
+    //past its TTL an LFID is forgotten, and the unbounded table would still have known it
+    NS_TEST_ASSERT_MSG_EQ(cache.Lookup(MultiHopLoraHeader::MakeLfid(1, 1), Seconds(62), expiry), false, "LFID 1 should expire after 61 s");
+    NS_TEST_ASSERT_MSG_EQ(cache.Lookup(MultiHopLoraHeader::MakeLfid(1, 1), Seconds(63), expiry), false, "LFID 1 should stay expired");
+    NS_TEST_ASSERT_MSG_EQ(cache.GetFalseReforwards(), 2, "an expired LFID should count once");
+    //an expired slot is reused without an eviction, and the new entry counts afresh
+    cache.Insert(MultiHopLoraHeader::MakeLfid(9, 1), Seconds(64), Seconds(63));
+    NS_TEST_ASSERT_MSG_EQ(cache.GetEvictions(), 1, "an expired slot should be reused without evicting");
+    NS_TEST_ASSERT_MSG_EQ(cache.Lookup(MultiHopLoraHeader::MakeLfid(9, 1), Seconds(63), expiry), true, "the new LFID should be known");
+
+    //resizing empties the table
+    cache.Resize(100);
+    NS_TEST_ASSERT_MSG_EQ(cache.GetCapacity(), 128, "capacity should round up to a power of two");
+    NS_TEST_ASSERT_MSG_EQ(cache.Lookup(MultiHopLoraHeader::MakeLfid(9, 1), Seconds(63), expiry), false, "a resized table should be empty");
+    cache.Insert(MultiHopLoraHeader::MakeLfid(9, 1), Seconds(64), Seconds(63));
+    NS_TEST_ASSERT_MSG_EQ(cache.Lookup(MultiHopLoraHeader::MakeLfid(9, 1), Seconds(63), expiry), true, "the resized table should take new LFIDs");
+}
+
+//the transmit queue under a 1% duty cycle: priority order, a frame of a band with tokens passing
+//one that waits for them, deferrals, drops by overflow and by age, and frames held below a priority
+class MultiHopLoraSchedulerTestCase: public TestCase
+{
+public:
+    MultiHopLoraSchedulerTestCase();
+
+private:
+    virtual void DoRun(void);
+
+    void Send(Ptr<Packet> packet, uint32_t frame, uint8_t sf);
+    void Drop(Ptr<const Packet> packet, uint32_t frame, Time wait);
+    void Burst(void);
+    void Hold(void);
+    void Release(void);
+
+    MultiHopLoraTxScheduler m_queue;
+    std::vector<std::pair<uint32_t, Time>> m_sent; //frame, send time
+    std::vector<std::pair<uint32_t, Time>> m_dropped; //frame, time spent in the queue
+
+    static constexpr uint32_t PAYLOAD = 20;
+    static constexpr double DUTY_CYCLE = 0.01;
+};
+
+MultiHopLoraSchedulerTestCase::MultiHopLoraSchedulerTestCase()
+    :TestCase("Transmit queue sends by priority within the duty cycle of each sub-band")
+{}
+
+void
+MultiHopLoraSchedulerTestCase::Send(Ptr<Packet>, uint32_t frame, uint8_t)
+{
+    m_sent.push_back(std::make_pair(frame, Simulator::Now()));
+}
+
+void
+MultiHopLoraSchedulerTestCase::Drop(Ptr<const Packet>, uint32_t frame, Time wait)
+{
+    m_dropped.push_back(std::make_pair(frame, wait));
+}
+
+void
+MultiHopLoraSchedulerTestCase::Burst(void)
+{
+    //frame 10 goes at once, 11-13 fill the queue and 14 pushes out the oldest, 11
+    for (uint32_t frame = 10; frame <= 14; ++frame)
+    {
+        m_queue.Enqueue(Create<Packet>(PAYLOAD), 1, frame, 1);
+    }
+}
+
+void
+MultiHopLoraSchedulerTestCase::Hold(void)
+{
+    //as in a beacon slot: the data frame 20 waits, the beacon 21 goes at once
+    m_queue.SetMinPriority(255);
+    m_queue.Enqueue(Create<Packet>(PAYLOAD), 1, 20, 0);
+    m_queue.Enqueue(Create<Packet>(PAYLOAD), 255, 21, 0);
+}
+
+void
+MultiHopLoraSchedulerTestCase::Release(void)
+{
+    m_queue.SetMinPriority(0);
+}
+
+void
+MultiHopLoraSchedulerTestCase::DoRun(void)
+{
+    //every frame takes t on air and each bucket holds 2.5 t, so a band sends two frames and
+    //then needs 100 t per frame
+    Time t = MultiHopLoraApp::GetTimeOnAir(7, PAYLOAD);
+    auto at = [t](double frames) { return NanoSeconds(int64_t(frames * t.GetNanoSeconds())); };
+    m_queue.SetSubBands(std::vector<double>(2, DUTY_CYCLE), at(2.5 / DUTY_CYCLE));
+    m_queue.SetLimits(3, at(100));
+    m_queue.SetSpreadingFactor(7);
+    m_queue.SetSendCallback(MakeCallback(&MultiHopLoraSchedulerTestCase::Send, this));
+    m_queue.SetDropCallback(MakeCallback(&MultiHopLoraSchedulerTestCase::Drop, this));
+
+    //frame 1 finds the radio idle, 2 has the highest priority of the rest. 3 outranks 4 but its
+    //band is down to 0.51 t, so 4 goes on the other band and 3 waits 47 t for its tokens
+    m_queue.Enqueue(Create<Packet>(PAYLOAD), 1, 1, 0);
+    m_queue.Enqueue(Create<Packet>(PAYLOAD), 3, 2, 0);
+    m_queue.Enqueue(Create<Packet>(PAYLOAD), 2, 3, 0);
+    m_queue.Enqueue(Create<Packet>(PAYLOAD), 0, 4, 1);
+    //band 1 is full again by then; 10 and 12 empty it, 13 waits 48 t and 14 waits 99 t, past
+    //the 100 t limit, and is dropped when it would have had its tokens
+    Simulator::Schedule(at(300), &MultiHopLoraSchedulerTestCase::Burst, this);
+    //a held frame is not a deferral and goes as soon as it is released
+    Simulator::Schedule(at(500), &MultiHopLoraSchedulerTestCase::Hold, this);
+    Simulator::Schedule(at(510), &MultiHopLoraSchedulerTestCase::Release, this);
+    Simulator::Run();
+    Simulator::Destroy();
+
+    const std::vector<std::pair<uint32_t, Time>> sent = {{1, at(0)}, {2, at(1)}, {4, at(2)}, {3, at(50)}, {10, at(300)}, {12, at(301)}, {13, at(350)}, {21, at(500)}, {20, at(510)}};
+    NS_TEST_ASSERT_MSG_EQ(m_sent.size(), sent.size(), "wrong number of frames sent");
+    for (uint32_t i = 0; i < sent.size(); ++i)
+    {
+        NS_TEST_ASSERT_MSG_EQ(m_sent[i].first, sent[i].first, "frame " << sent[i].first << " sent out of order");
+        //waits for tokens are rounded up to the next nanosecond
+        NS_TEST_ASSERT_MSG_EQ_TOL(m_sent[i].second, sent[i].second, MicroSeconds(1), "frame " << sent[i].first << " sent at the wrong time");
+    }
+    NS_TEST_ASSERT_MSG_EQ(m_queue.GetSent(), sent.size(), "the queue should count every frame sent");
+    NS_TEST_ASSERT_MSG_EQ(m_queue.GetDeferrals(), 3, "only frames 3, 13 and 14 should find no band with tokens");
+
+    NS_TEST_ASSERT_MSG_EQ(m_queue.GetOverflowDrops(), 1, "the fifth frame of the burst should overflow the queue");
+    NS_TEST_ASSERT_MSG_EQ(m_queue.GetAgeDrops(), 1, "frame 14 should expire");
+    NS_TEST_ASSERT_MSG_EQ(m_dropped.size(), 2, "both drops should be reported");
+    NS_TEST_ASSERT_MSG_EQ(m_dropped[0].first, 11, "the overflow should drop the oldest frame");
+    NS_TEST_ASSERT_MSG_EQ(m_dropped[0].second, Seconds(0), "frame 11 should be dropped as the burst arrives");
+    NS_TEST_ASSERT_MSG_EQ(m_dropped[1].first, 14, "frame 14 should be dropped by age");
+    NS_TEST_ASSERT_MSG_EQ_TOL(m_dropped[1].second, at(150), MicroSeconds(1), "frame 14 should be dropped when its tokens are in");
+    NS_TEST_ASSERT_MSG_EQ(m_queue.GetSize(), 0, "the queue should be empty");
+}
+
+//a grid channel culling at its link floor must not change the outcome of overlapping frames:
+//a decodable frame and a ring of interferers that are each below the floor but destroy it together
+class MultiHopLoraGridInterferenceTestCase: public TestCase
+{
+public:
+    MultiHopLoraGridInterferenceTestCase();
+
+private:
+    virtual void DoRun(void);
+
+    //whether the receiver decodes the wanted frame with receptions culled beyond maxRange (0 = none)
+    bool Received(double maxRange);
+    void Receive(Ptr<const Packet> packet, uint32_t nodeId);
+
+    uint32_t m_received;
+
+    static const uint32_t INTERFERERS = 100;
+    static constexpr double TX_POWER = 14.0;
+    static constexpr double WANTED_DISTANCE = 800.0; //about -120 dBm, 4 dB above the SF7 sensitivity
+    static constexpr double RING_DISTANCE = 5200.0; //about -144 dBm each, -124 dBm together
+};
+
+MultiHopLoraGridInterferenceTestCase::MultiHopLoraGridInterferenceTestCase()
+    :TestCase("Grid channel culling keeps the aggregate interference of overlapping frames"),m_received(0)
+{}
+
+void
+MultiHopLoraGridInterferenceTestCase::Receive(Ptr<const Packet>, uint32_t)
+{
+    m_received++;
+}
+
+bool
+MultiHopLoraGridInterferenceTestCase::Received(double maxRange)
+{
+    Ptr<MultiHopLoraGridChannel> channel = CreateObject<MultiHopLoraGridChannel>(CreateObject<LogDistancePropagationLossModel>(), CreateObject<ConstantSpeedPropagationDelayModel>());
+    channel->SetMaxRange(maxRange);
+    auto addPhy = [channel](const Vector &position) {
+        Ptr<Node> node = CreateObject<Node>();
+        Ptr<ConstantPositionMobilityModel> mobility = CreateObject<ConstantPositionMobilityModel>();
+        mobility->SetPosition(position);
+        node->AggregateObject(mobility);
+        Ptr<lorawan::LoraNetDevice> device = CreateObject<lorawan::LoraNetDevice>();
+        Ptr<lorawan::SimpleEndDeviceLoraPhy> phy = CreateObject<lorawan::SimpleEndDeviceLoraPhy>();
+        phy->SetMobility(mobility);
+        phy->SetChannel(channel);
+        phy->SetDevice(device);
+        device->SetPhy(phy);
+        node->AddDevice(device);
+        channel->Add(phy);
+        return phy;
+    };
+
+    Ptr<lorawan::SimpleEndDeviceLoraPhy> receiver = addPhy(Vector(0, 0, 0));
+    receiver->SwitchToStandby();
+    receiver->TraceConnectWithoutContext("ReceivedPacket", MakeCallback(&MultiHopLoraGridInterferenceTestCase::Receive, this));
+    Ptr<lorawan::SimpleEndDeviceLoraPhy> wanted = addPhy(Vector(WANTED_DISTANCE, 0, 0));
+    std::vector<Ptr<lorawan::SimpleEndDeviceLoraPhy>> interferers;
+    for (uint32_t i = 0; i < INTERFERERS; ++i)
+    {
+        double angle = 2 * M_PI * i / INTERFERERS;
+        interferers.push_back(addPhy(Vector(RING_DISTANCE * std::cos(angle), RING_DISTANCE * std::sin(angle), 0)));
+    }
+
+    //all frames start together, the wanted one arrives first and locks the receiver
+    lorawan::LoraTxParameters params;
+    params.sf = 7;
+    Time duration = lorawan::LoraPhy::GetOnAirTime(Create<Packet>(20), params);
+    m_received = 0;
+    channel->Send(wanted, Create<Packet>(20), TX_POWER, params, duration, 868.1);
+    for (const Ptr<lorawan::SimpleEndDeviceLoraPhy> &phy : interferers)
+    {
+        channel->Send(phy, Create<Packet>(20), TX_POWER, params, duration, 868.1);
+    }
+    Simulator::Run();
+    Simulator::Destroy();
+    return m_received > 0;
+}
+
+void
+MultiHopLoraGridInterferenceTestCase::DoRun(void)
+{
+    Ptr<MultiHopLoraGridChannel> reference = CreateObject<MultiHopLoraGridChannel>();
+    Ptr<PropagationLossModel> loss = CreateObject<LogDistancePropagationLossModel>();
+    double linkRange = MultiHopLoraGridChannel::ComputeRange(loss, TX_POWER, reference->GetLinkFloor(INTERFERERS + 1), 1e6);
+    double floorRange = MultiHopLoraGridChannel::ComputeRange(loss, TX_POWER, reference->GetRxPowerFloor(), 1e6);
+
+    NS_TEST_ASSERT_MSG_EQ(Received(0), false, "the interferers together should destroy the frame on a full broadcast");
+    //the scenario only tests something if culling each link at the floor would lose the aggregate
+    NS_TEST_ASSERT_MSG_EQ(floorRange < RING_DISTANCE, true, "the ring should lie beyond the single-link range " << floorRange << " m");
+    NS_TEST_ASSERT_MSG_EQ(Received(floorRange), true, "culling at the single-link floor should drop the aggregate");
+    NS_TEST_ASSERT_MSG_EQ(linkRange > RING_DISTANCE, true, "the link range " << linkRange << " m should reach the ring");
+    NS_TEST_ASSERT_MSG_EQ(Received(linkRange), false, "culling at the link floor should keep the full broadcast outcome");
+}
+
+class MultiHopLoraTestSuite: public TestSuite
+{
+public:
+    MultiHopLoraTestSuite();
+};
+
+MultiHopLoraTestSuite::MultiHopLoraTestSuite()
+    :TestSuite("multi-hop-lora", Type::UNIT)
+{
+    AddTestCase(new MultiHopLoraSelectionTestCase, TestCase::Duration::QUICK);
+    AddTestCase(new MultiHopLoraHeaderTestCase, TestCase::Duration::QUICK);
+    AddTestCase(new MultiHopLoraCacheTestCase, TestCase::Duration::QUICK);
+    AddTestCase(new MultiHopLoraSchedulerTestCase, TestCase::Duration::QUICK);
+    AddTestCase(new MultiHopLoraGridInterferenceTestCase, TestCase::Duration::QUICK);
+}
+
+static MultiHopLoraTestSuite g_multiHopLoraTestSuite;
+
+} //namespace ns3
@@ -0,0 +1,256 @@
+#include "multi-hop-lora-topology.h"
+#include "ns3/log.h"
+#include "ns3/assert.h"
+#include "ns3/abort.h"
+#include "ns3/mobility-model.h"
+#include "ns3/constant-position-mobility-model.h"
+#include <cmath>
+#include <cctype>
+#include <fstream>
+#include <sstream>
+#include <deque>
+#include <unordered_map>
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE("MultiHopLoraTopology");
+
+MultiHopLoraTopology::MultiHopLoraTopology()
+{}
+
+void
+MultiHopLoraTopology::Clear(void)
+{
+    m_positions.clear();
+    m_isGateway.clear();
+    m_lgw.clear();
+}
+
+void
+MultiHopLoraTopology::CreateGrid(uint32_t numNodes, double spacing, double height)
+{
+    Clear();
+    uint32_t columns = std::ceil(std::sqrt(double(numNodes)));
+    m_positions.reserve(numNodes);
+    for (uint32_t i = 0; i < numNodes; ++i)
+    {
+        m_positions.push_back(Vector((i % columns) * spacing, (i / columns) * spacing, height));
+    }
+    m_isGateway.assign(numNodes, false);
+    NS_LOG_INFO("Grid topology: " << numNodes << " nodes, " << columns << " columns, spacing " << spacing << "m");
+}
+
+void
+MultiHopLoraTopology::CreateUniformRandom(uint32_t numNodes, double width, double length, double height, Ptr<UniformRandomVariable> rng)
+{
+    Clear();
+    m_positions.reserve(numNodes);
+    for (uint32_t i = 0; i < numNodes; ++i)
+    {
+        m_positions.push_back(Vector(rng->GetValue(0, width), rng->GetValue(0, length), height));
+    }
+    m_isGateway.assign(numNodes, false);
+    NS_LOG_INFO("Uniform random topology: " << numNodes << " nodes over " << width << "x" << length << "m");
+}
+
+void
+MultiHopLoraTopology::CreateClustered(uint32_t numNodes, uint32_t numClusters, double width, double length, double radius, double height, Ptr<UniformRandomVariable> rng)
+{
+    NS_ASSERT_MSG(numClusters > 0, "Clustered topology needs at least one cluster");
+    Clear();
+
+    std::vector<Vector> centres;
+    for (uint32_t c = 0; c < numClusters; ++c)
+    {
+        centres.push_back(Vector(rng->GetValue(0, width), rng->GetValue(0, length), height));
+    }
+
+    //nodes are spread uniformly over a disc around their cluster centre
+    m_positions.reserve(numNodes);
+    for (uint32_t i = 0; i < numNodes; ++i)
+    {
+        const Vector &centre = centres[i % numClusters];
+        double r = radius * std::sqrt(rng->GetValue(0, 1));
+        double theta = rng->GetValue(0, 2 * M_PI);
+        m_positions.push_back(Vector(centre.x + r * std::cos(theta), centre.y + r * std::sin(theta), height));
+    }
+    m_isGateway.assign(numNodes, false);
+    NS_LOG_INFO("Clustered topology: " << numNodes << " nodes in " << numClusters << " clusters of radius " << radius << "m");
+}
+
+bool
+MultiHopLoraTopology::LoadFile(const std::string &fileName)
+{
+    Clear();
+    std::ifstream in(fileName);
+    if (!in.is_open())
+    {
+        NS_LOG_ERROR("Cannot open topology file " << fileName);
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(in, line))
+    {
+        if (line.empty() || line[0] == '#' || std::isalpha(static_cast<unsigned char>(line[0])))
+        {
+            continue; //comment or column header
+        }
+        for (char &c : line)
+        {
+            if (c == ',' || c == ';')
+            {
+                c = ' ';
+            }
+        }
+        std::istringstream fields(line);
+        Vector pos;
+        int gateway = 0;
+        if (!(fields >> pos.x >> pos.y >> pos.z))
+        {
+            NS_LOG_WARN("Skipping malformed topology line: " << line);
+            continue;
+        }
+        fields >> gateway;
+        m_positions.push_back(pos);
+        m_isGateway.push_back(gateway != 0);
+    }
+    NS_LOG_INFO("Loaded " << m_positions.size() << " nodes (" << GetNGateways() << " gateways) from " << fileName);
+    return !m_positions.empty();
+}
+
+void
+MultiHopLoraTopology::AddGateways(uint32_t numGateways, double height)
+{
+    if (numGateways == 0)
+    {
+        return;
+    }
+
+    double xMin = 0, xMax = 0, yMin = 0, yMax = 0;
+    for (uint32_t i = 0; i < m_positions.size(); ++i)
+    {
+        const Vector &p = m_positions[i];
+        xMin = (i == 0 || p.x < xMin) ? p.x : xMin;
+        xMax = (i == 0 || p.x > xMax) ? p.x : xMax;
+        yMin = (i == 0 || p.y < yMin) ? p.y : yMin;
+        yMax = (i == 0 || p.y > yMax) ? p.y : yMax;
+    }
+
+    //centre of each cell of a columns x rows lattice
+    uint32_t columns = std::ceil(std::sqrt(double(numGateways)));
+    uint32_t rows = (numGateways + columns - 1) / columns;
+    for (uint32_t g = 0; g < numGateways; ++g)
+    {
+        double x = xMin + (xMax - xMin) * ((g % columns) + 0.5) / columns;
+        double y = yMin + (yMax - yMin) * ((g / columns) + 0.5) / rows;
+        m_positions.push_back(Vector(x, y, height));
+        m_isGateway.push_back(true);
+    }
+}
+
+void
+MultiHopLoraTopology::Install(const NodeContainer &nodes) const
+{
+    NS_ASSERT_MSG(nodes.GetN() == m_positions.size(), "Node count does not match the topology");
+    for (uint32_t i = 0; i < m_positions.size(); ++i)
+    {
+        nodes.Get(i)->GetObject<ConstantPositionMobilityModel>()->SetPosition(m_positions[i]);
+    }
+}
+
+void
+MultiHopLoraTopology::ComputeLgw(const NodeContainer &nodes, Ptr<PropagationLossModel> loss, double txPowerDbm, double sensitivityDbm, double maxRange)
+{
+    NS_ASSERT_MSG(nodes.GetN() == m_positions.size(), "Node count does not match the topology");
+    //the range is the grid cell size
+    NS_ABORT_MSG_IF(maxRange <= 0, "ComputeLgw needs a positive maxRange, got " << maxRange);
+    uint32_t n = m_positions.size();
+    m_lgw.assign(n, 255);
+
+    //bucket nodes into maxRange-sized cells, candidate neighbours are in the 3x3 block around a cell
+    auto cellKey = [maxRange](const Vector &p, int dx, int dy) {
+        int64_t cx = int64_t(std::floor(p.x / maxRange)) + dx;
+        int64_t cy = int64_t(std::floor(p.y / maxRange)) + dy;
+        return (uint64_t(cx) << 32) ^ uint64_t(uint32_t(cy));
+    };
+    std::unordered_map<uint64_t, std::vector<uint32_t>> cells;
+    std::vector<Ptr<MobilityModel>> mobility(n);
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        cells[cellKey(m_positions[i], 0, 0)].push_back(i);
+        mobility[i] = nodes.Get(i)->GetObject<MobilityModel>();
+    }
+
+    std::deque<uint32_t> queue;
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        if (m_isGateway[i])
+        {
+            m_lgw[i] = 1;
+            queue.push_back(i);
+        }
+    }
+
+    uint64_t linkEvaluations = 0;
+    while (!queue.empty())
+    {
+        uint32_t u = queue.front();
+        queue.pop_front();
+        if (m_lgw[u] >= 254)
+        {
+            continue;
+        }
+        for (int dx = -1; dx <= 1; ++dx)
+        {
+            for (int dy = -1; dy <= 1; ++dy)
+            {
+                auto cell = cells.find(cellKey(m_positions[u], dx, dy));
+                if (cell == cells.end())
+                {
+                    continue;
+                }
+                for (uint32_t v : cell->second)
+                {
+                    if (m_lgw[v] != 255 || CalculateDistance(m_positions[u], m_positions[v]) > maxRange)
+                    {
+                        continue;
+                    }
+                    //v forwards towards u, so the link is v transmitting and u receiving
+                    linkEvaluations++;
+                    if (loss->CalcRxPower(txPowerDbm, mobility[v], mobility[u]) >= sensitivityDbm)
+                    {
+                        m_lgw[v] = m_lgw[u] + 1;
+                        queue.push_back(v);
+                    }
+                }
+            }
+        }
+    }
+
+    uint32_t unreachable = 0;
+    for (uint8_t lgw : m_lgw)
+    {
+        unreachable += (lgw == 255);
+    }
+    NS_LOG_INFO("Computed LGw for " << n << " nodes with " << linkEvaluations << " link evaluations, " << unreachable << " unreachable");
+}
+
+// Getters implementation
+uint32_t MultiHopLoraTopology::GetN (void) const { return m_positions.size(); }
+Vector MultiHopLoraTopology::GetPosition (uint32_t i) const { return m_positions[i]; }
+bool MultiHopLoraTopology::IsGateway (uint32_t i) const { return m_isGateway[i]; }
+uint8_t MultiHopLoraTopology::GetLgw (uint32_t i) const { return m_lgw.empty() ? 255 : m_lgw[i]; }
+
+uint32_t
+MultiHopLoraTopology::GetNGateways(void) const
+{
+    uint32_t count = 0;
+    for (bool gw : m_isGateway)
+    {
+        count += gw;
+    }
+    return count;
+}
+
+} // namespace ns3
@@ -0,0 +1,56 @@
+#ifndef MULTI_HOP_LORA_TOPOLOGY_H
+#define MULTI_HOP_LORA_TOPOLOGY_H
+
+#include "ns3/node-container.h"
+#include "ns3/vector.h"
+#include "ns3/propagation-loss-model.h"
+#include "ns3/random-variable-stream.h"
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace ns3 {
+
+//node placement for large multi-hop deployments
+//end devices are generated first, gateways are appended after them
+class MultiHopLoraTopology
+{
+public:
+    MultiHopLoraTopology();
+
+    //placement modes, each one replaces the current node list
+    void CreateGrid(uint32_t numNodes, double spacing, double height);
+    void CreateUniformRandom(uint32_t numNodes, double width, double length, double height, Ptr<UniformRandomVariable> rng);
+    void CreateClustered(uint32_t numNodes, uint32_t numClusters, double width, double length, double radius, double height, Ptr<UniformRandomVariable> rng);
+    //one node per line: x,y,z[,gateway], lines starting with '#' or a letter are skipped
+    bool LoadFile(const std::string &fileName);
+
+    //spread gateways on a regular lattice over the bounding box of the current nodes
+    void AddGateways(uint32_t numGateways, double height);
+
+    //positions are installed in one pass, nodes must already have a mobility model
+    void Install(const NodeContainer &nodes) const;
+
+    //LGw is the BFS hop distance to the nearest gateway over links whose received power
+    //is at least sensitivity (gateway = 1, unreachable = 255)
+    //maxRange bounds the neighbour search so the pass stays close to linear in node count
+    void ComputeLgw(const NodeContainer &nodes, Ptr<PropagationLossModel> loss, double txPowerDbm, double sensitivityDbm, double maxRange);
+
+    //Getters
+    uint32_t GetN(void) const;
+    uint32_t GetNGateways(void) const;
+    Vector GetPosition(uint32_t i) const;
+    bool IsGateway(uint32_t i) const;
+    uint8_t GetLgw(uint32_t i) const;
+
+private:
+    void Clear(void);
+
+    std::vector<Vector> m_positions;
+    std::vector<bool> m_isGateway;
+    std::vector<uint8_t> m_lgw;
+};
+
+} //namespace ns3
+
+#endif //MULTI_HOP_LORA_TOPOLOGY_H
@@ -0,0 +1,124 @@
+#include "multi-hop-lora-trace.h"
+#include "ns3/log.h"
+#include "ns3/assert.h"
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE("MultiHopLoraTrace");
+
+MultiHopLoraTrace *MultiHopLoraTrace::s_trace = nullptr;
+
+bool
+MultiHopLoraTrace::Open(const std::string &fileName, uint32_t blockRecords, uint32_t blocks)
+{
+    NS_ASSERT_MSG(!s_trace, "A trace is already open");
+    NS_ASSERT_MSG(blockRecords > 0 && blocks >= 2, "The trace ring needs at least two non-empty blocks");
+
+    std::FILE *file = std::fopen(fileName.c_str(), "wb");
+    if (!file)
+    {
+        NS_LOG_WARN("Cannot open trace file " << fileName);
+        return false;
+    }
+    uint32_t fileHeader[3] = {0x544c484d, VERSION, sizeof(MultiHopLoraTraceRecord)}; //"MHLT"
+    std::fwrite(fileHeader, sizeof(fileHeader), 1, file);
+
+    s_trace = new MultiHopLoraTrace(file, blockRecords, blocks);
+    return true;
+}
+
+void
+MultiHopLoraTrace::Close(void)
+{
+    if (!s_trace)
+    {
+        return;
+    }
+    MultiHopLoraTrace *trace = s_trace;
+    s_trace = nullptr;
+    NS_LOG_INFO("Trace closed after " << trace->m_records + trace->m_fill << " records, " << trace->m_stalls << " writer stalls");
+    delete trace;
+}
+
+bool
+MultiHopLoraTrace::IsOpen(void)
+{
+    return s_trace != nullptr;
+}
+
+uint64_t MultiHopLoraTrace::GetRecords (void) { return s_trace ? s_trace->m_records + s_trace->m_fill : 0; }
+uint64_t MultiHopLoraTrace::GetStalls (void) { return s_trace ? s_trace->m_stalls : 0; }
+
+MultiHopLoraTrace::MultiHopLoraTrace(std::FILE *file, uint32_t blockRecords, uint32_t blocks)
+    :m_file(file),m_blockRecords(blockRecords),m_blocks(blocks, std::vector<MultiHopLoraTraceRecord>(blockRecords)),m_blockFill(blocks, 0),
+     m_current(0),m_fill(0),m_closing(false),m_records(0),m_stalls(0)
+{
+    for (uint32_t i = 1; i < blocks; ++i)
+    {
+        m_free.push_back(i);
+    }
+    m_writer = std::thread(&MultiHopLoraTrace::Writer, this);
+}
+
+MultiHopLoraTrace::~MultiHopLoraTrace()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_fill > 0)
+        {
+            m_blockFill[m_current] = m_fill;
+            m_full.push_back(m_current);
+            m_records += m_fill;
+            m_fill = 0;
+        }
+        m_closing = true;
+    }
+    m_fullReady.notify_one();
+    m_writer.join();
+    std::fclose(m_file);
+}
+
+void
+MultiHopLoraTrace::Submit(void)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_blockFill[m_current] = m_fill;
+    m_full.push_back(m_current);
+    m_records += m_fill;
+    m_fullReady.notify_one();
+
+    //a full ring blocks the simulation instead of dropping records
+    if (m_free.empty())
+    {
+        m_stalls++;
+        m_freeReady.wait(lock, [this] { return !m_free.empty(); });
+    }
+    m_current = m_free.front();
+    m_free.pop_front();
+    m_fill = 0;
+}
+
+void
+MultiHopLoraTrace::Writer(void)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true)
+    {
+        m_fullReady.wait(lock, [this] { return m_closing || !m_full.empty(); });
+        if (m_full.empty())
+        {
+            break; //closing and drained
+        }
+        uint32_t block = m_full.front();
+        m_full.pop_front();
+
+        lock.unlock();
+        std::fwrite(m_blocks[block].data(), sizeof(MultiHopLoraTraceRecord), m_blockFill[block], m_file);
+        lock.lock();
+
+        m_free.push_back(block);
+        m_freeReady.notify_one();
+    }
+}
+
+} //namespace ns3
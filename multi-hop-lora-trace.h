@@ -0,0 +1,117 @@
+#ifndef MULTI_HOP_LORA_TRACE_H
+#define MULTI_HOP_LORA_TRACE_H
+
+#include "ns3/simulator.h"
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace ns3 {
+
+//one fixed-size event, written to the trace file as is (little-endian hosts)
+struct MultiHopLoraTraceRecord
+{
+    int64_t timeNs;
+    uint32_t node;
+    uint32_t lfid;
+    uint8_t type;
+    uint8_t lh;
+    uint8_t lgw;
+    uint8_t reserved;
+    uint32_t aux; //frame bytes for tx/rx/forward/drop-maxhop, copies heard so far for dup-buffered and
+                  //the drops at selection time (1 = first copy), 1 on the first delivery of an LFID to a gateway
+};
+static_assert(sizeof(MultiHopLoraTraceRecord) == 24, "Trace records must stay 24 bytes, the decoder depends on it");
+
+//binary event trace of the forwarding protocol
+//records are appended to fixed-size blocks of a ring, full blocks are written to the file
+//by a background thread. with no trace open a record costs one branch, and building with
+//MULTI_HOP_LORA_NO_TRACE removes the calls altogether
+//file layout: "MHLT", version(u32), record size(u32), then records
+class MultiHopLoraTrace
+{
+public:
+    enum Type : uint8_t
+    {
+        TX = 1, //source originated a packet
+        RX, //frame received, before any filtering
+        DUP_BUFFERED, //copy of a pending LFID added to the candidates
+        FORWARD,
+        DROP_MAX_HOP,
+        DROP_SPATIAL, //no copy satisfied the LGw constraint (F1 empty)
+        DROP_FILTER, //F1 not empty, but the final selection picked nothing
+        GATEWAY_DELIVER,
+        AGGREGATE, //several forwards sent in one frame, lh holds the entry count
+        DROP_QUEUE, //frame left the transmit queue unsent, aux is the wait in ms (lh is the entry count for aggregates)
+        SUPPRESSED, //pending forward cancelled by an overheard copy with lower LGw, aux is the copies overheard
+        BEACON, //gradient beacon sent, lfid is its epoch, lgw the announced LGw, aux the frame bytes
+        LGW_CHANGE //node adopted a new LGw, lh is the old one, aux the current epoch
+    };
+
+    static const uint32_t VERSION = 1;
+
+    //opens the trace file, blockRecords records per block, blocks blocks in the ring
+    static bool Open(const std::string &fileName, uint32_t blockRecords = 4096, uint32_t blocks = 8);
+    //flushes outstanding records and closes the file
+    static void Close(void);
+    static bool IsOpen(void);
+
+    static inline void Record(Type type, uint32_t node, uint32_t lfid, uint8_t lh, uint8_t lgw, uint32_t aux)
+    {
+#ifndef MULTI_HOP_LORA_NO_TRACE
+        if (s_trace)
+        {
+            s_trace->Append(MultiHopLoraTraceRecord{Simulator::Now().GetNanoSeconds(), node, lfid, uint8_t(type), lh, lgw, 0, aux});
+        }
+#endif
+    }
+
+    //Getters, valid until Close
+    static uint64_t GetRecords(void);
+    static uint64_t GetStalls(void);
+
+private:
+    MultiHopLoraTrace(std::FILE *file, uint32_t blockRecords, uint32_t blocks);
+    ~MultiHopLoraTrace();
+
+    inline void Append(const MultiHopLoraTraceRecord &record)
+    {
+        if (m_fill == m_blockRecords)
+        {
+            Submit();
+        }
+        m_blocks[m_current][m_fill++] = record;
+    }
+
+    void Submit(void); //hands the current block to the writer and takes a free one
+    void Writer(void);
+
+    static MultiHopLoraTrace *s_trace;
+
+    std::FILE *m_file;
+    uint32_t m_blockRecords;
+    std::vector<std::vector<MultiHopLoraTraceRecord>> m_blocks;
+    std::vector<uint32_t> m_blockFill;
+    uint32_t m_current;
+    uint32_t m_fill;
+
+    std::mutex m_mutex;
+    std::condition_variable m_fullReady;
+    std::condition_variable m_freeReady;
+    std::deque<uint32_t> m_full;
+    std::deque<uint32_t> m_free;
+    bool m_closing;
+    std::thread m_writer;
+
+    uint64_t m_records;
+    uint64_t m_stalls; //times the simulation waited for the writer
+};
+
+} //namespace ns3
+
+#endif //MULTI_HOP_LORA_TRACE_H
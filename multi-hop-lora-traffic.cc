@@ -0,0 +1,473 @@
+#include "multi-hop-lora-traffic.h"
+#include "ns3/log.h"
+#include "ns3/assert.h"
+#include "ns3/abort.h"
+#include "ns3/simulator.h"
+#include "ns3/uinteger.h"
+#include "ns3/double.h"
+#include "ns3/string.h"
+#include "ns3/pointer.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE("MultiHopLoraTraffic");
+NS_OBJECT_ENSURE_REGISTERED(MultiHopLoraTrafficModel);
+NS_OBJECT_ENSURE_REGISTERED(MultiHopLoraPeriodicTraffic);
+NS_OBJECT_ENSURE_REGISTERED(MultiHopLoraPoissonTraffic);
+NS_OBJECT_ENSURE_REGISTERED(MultiHopLoraTraceTraffic);
+NS_OBJECT_ENSURE_REGISTERED(MultiHopLoraBurstTraffic);
+NS_OBJECT_ENSURE_REGISTERED(MultiHopLoraEventField);
+
+TypeId
+MultiHopLoraTrafficModel::GetTypeId(void)
+{
+    static TypeId tid = TypeId("ns3::MultiHopLoraTrafficModel")
+    .SetParent<Object>()
+    .SetGroupName("lorawan")
+    .AddAttribute("PayloadSize",
+                  "Payload size in bytes of every packet, e.g. ns3::UniformRandomVariable[Min=10|Max=50]",
+                  StringValue("ns3::ConstantRandomVariable[Constant=32]"),
+                  MakePointerAccessor(&MultiHopLoraTrafficModel::m_size),
+                  MakePointerChecker<RandomVariableStream>())
+    ;
+    return tid;
+}
+
+MultiHopLoraTrafficModel::MultiHopLoraTrafficModel():m_nodeId(0),m_generated(0)
+{}
+
+MultiHopLoraTrafficModel::~MultiHopLoraTrafficModel()
+{}
+
+void
+MultiHopLoraTrafficModel::SetSendCallback(SendCallback send)
+{
+    m_send = send;
+}
+
+void
+MultiHopLoraTrafficModel::SetNodeId(uint32_t nodeId)
+{
+    m_nodeId = nodeId;
+}
+
+uint32_t
+MultiHopLoraTrafficModel::GetNodeId(void) const
+{
+    return m_nodeId;
+}
+
+void
+MultiHopLoraTrafficModel::Stop(void)
+{
+    Simulator::Cancel(m_event);
+}
+
+int64_t
+MultiHopLoraTrafficModel::AssignStreams(int64_t stream)
+{
+    m_size->SetStream(stream);
+    return 1;
+}
+
+void
+MultiHopLoraTrafficModel::Generate(void)
+{
+    Generate(uint32_t(std::max(1.0, std::round(m_size->GetValue()))));
+}
+
+void
+MultiHopLoraTrafficModel::Generate(uint32_t size)
+{
+    m_generated++;
+    if (!m_send.IsNull())
+    {
+        m_send(size);
+    }
+}
+
+uint64_t MultiHopLoraTrafficModel::GetGenerated (void) const { return m_generated; }
+
+TypeId
+MultiHopLoraPeriodicTraffic::GetTypeId(void)
+{
+    static TypeId tid = TypeId("ns3::MultiHopLoraPeriodicTraffic")
+    .SetParent<MultiHopLoraTrafficModel>()
+    .SetGroupName("lorawan")
+    .AddConstructor<MultiHopLoraPeriodicTraffic>()
+    .AddAttribute("Interval",
+                  "Time between two packets",
+                  TimeValue(Seconds(20)),
+                  MakeTimeAccessor(&MultiHopLoraPeriodicTraffic::m_interval),
+                  MakeTimeChecker())
+    .AddAttribute("Jitter",
+                  "Every interval is shortened or lengthened by a uniform amount up to this",
+                  TimeValue(Seconds(0)),
+                  MakeTimeAccessor(&MultiHopLoraPeriodicTraffic::m_jitter),
+                  MakeTimeChecker())
+    ;
+    return tid;
+}
+
+MultiHopLoraPeriodicTraffic::MultiHopLoraPeriodicTraffic():m_interval(Seconds(20)),m_jitter(Seconds(0))
+{
+    m_rng = CreateObject<UniformRandomVariable>();
+}
+
+MultiHopLoraPeriodicTraffic::~MultiHopLoraPeriodicTraffic()
+{}
+
+void
+MultiHopLoraPeriodicTraffic::Start(void)
+{
+    NS_ASSERT_MSG(m_interval.IsStrictlyPositive(), "Interval must be positive");
+    //sources started together would otherwise send in lockstep
+    m_event = Simulator::Schedule(Seconds(m_rng->GetValue(0, m_interval.GetSeconds())), &MultiHopLoraPeriodicTraffic::Send, this);
+}
+
+void
+MultiHopLoraPeriodicTraffic::Send(void)
+{
+    Generate();
+    double jitter = m_rng->GetValue(-m_jitter.GetSeconds(), m_jitter.GetSeconds());
+    m_event = Simulator::Schedule(Seconds(std::max(0.0, m_interval.GetSeconds() + jitter)), &MultiHopLoraPeriodicTraffic::Send, this);
+}
+
+int64_t
+MultiHopLoraPeriodicTraffic::AssignStreams(int64_t stream)
+{
+    int64_t used = MultiHopLoraTrafficModel::AssignStreams(stream);
+    m_rng->SetStream(stream + used);
+    return used + 1;
+}
+
+TypeId
+MultiHopLoraPoissonTraffic::GetTypeId(void)
+{
+    static TypeId tid = TypeId("ns3::MultiHopLoraPoissonTraffic")
+    .SetParent<MultiHopLoraTrafficModel>()
+    .SetGroupName("lorawan")
+    .AddConstructor<MultiHopLoraPoissonTraffic>()
+    .AddAttribute("MeanInterval",
+                  "Mean time between two packets",
+                  TimeValue(Seconds(20)),
+                  MakeTimeAccessor(&MultiHopLoraPoissonTraffic::m_meanInterval),
+                  MakeTimeChecker())
+    ;
+    return tid;
+}
+
+MultiHopLoraPoissonTraffic::MultiHopLoraPoissonTraffic():m_meanInterval(Seconds(20))
+{
+    m_rng = CreateObject<ExponentialRandomVariable>();
+}
+
+MultiHopLoraPoissonTraffic::~MultiHopLoraPoissonTraffic()
+{}
+
+void
+MultiHopLoraPoissonTraffic::Start(void)
+{
+    NS_ASSERT_MSG(m_meanInterval.IsStrictlyPositive(), "MeanInterval must be positive");
+    m_event = Simulator::Schedule(Seconds(m_rng->GetValue(m_meanInterval.GetSeconds(), 0)), &MultiHopLoraPoissonTraffic::Send, this);
+}
+
+void
+MultiHopLoraPoissonTraffic::Send(void)
+{
+    Generate();
+    //bound 0 leaves the distribution untruncated
+    m_event = Simulator::Schedule(Seconds(m_rng->GetValue(m_meanInterval.GetSeconds(), 0)), &MultiHopLoraPoissonTraffic::Send, this);
+}
+
+int64_t
+MultiHopLoraPoissonTraffic::AssignStreams(int64_t stream)
+{
+    int64_t used = MultiHopLoraTrafficModel::AssignStreams(stream);
+    m_rng->SetStream(stream + used);
+    return used + 1;
+}
+
+TypeId
+MultiHopLoraTraceTraffic::GetTypeId(void)
+{
+    static TypeId tid = TypeId("ns3::MultiHopLoraTraceTraffic")
+    .SetParent<MultiHopLoraTrafficModel>()
+    .SetGroupName("lorawan")
+    .AddConstructor<MultiHopLoraTraceTraffic>()
+    .AddAttribute("FileName",
+                  "CSV file with one time,node,size line per packet, # starts a comment",
+                  StringValue(""),
+                  MakeStringAccessor(&MultiHopLoraTraceTraffic::m_fileName),
+                  MakeStringChecker())
+    ;
+    return tid;
+}
+
+MultiHopLoraTraceTraffic::MultiHopLoraTraceTraffic():m_packets(nullptr),m_next(0)
+{}
+
+MultiHopLoraTraceTraffic::~MultiHopLoraTraceTraffic()
+{}
+
+std::shared_ptr<const MultiHopLoraTraceTraffic::Trace>
+MultiHopLoraTraceTraffic::Load(const std::string &fileName)
+{
+    //every source of a large run replays the same file, reading it once per source is quadratic
+    static std::unordered_map<std::string, std::weak_ptr<const Trace>> loaded;
+    std::shared_ptr<const Trace> cached = loaded[fileName].lock();
+    if (cached)
+    {
+        return cached;
+    }
+
+    std::ifstream in(fileName);
+    NS_ABORT_MSG_IF(!in.good(), "Cannot open traffic trace '" << fileName << "'");
+
+    std::shared_ptr<Trace> trace = std::make_shared<Trace>();
+    std::string line;
+    uint32_t lineNumber = 0;
+    while (std::getline(in, line))
+    {
+        lineNumber++;
+        line = line.substr(0, line.find('#'));
+        if (line.find_first_not_of(" \t\r") == std::string::npos)
+        {
+            continue;
+        }
+        std::replace(line.begin(), line.end(), ',', ' ');
+        std::istringstream fields(line);
+        double seconds;
+        uint32_t node, size;
+        NS_ABORT_MSG_IF(!(fields >> seconds >> node >> size), "Malformed line " << lineNumber << " in '" << fileName << "'");
+        (*trace)[node].push_back(std::make_pair(Seconds(seconds), size));
+    }
+    for (auto &entry : *trace)
+    {
+        std::stable_sort(entry.second.begin(), entry.second.end(), [](const std::pair<Time, uint32_t> &a, const std::pair<Time, uint32_t> &b) {
+            return a.first < b.first;
+        });
+    }
+    NS_LOG_INFO("Loaded " << trace->size() << " nodes from " << fileName);
+    loaded[fileName] = trace;
+    return trace;
+}
+
+void
+MultiHopLoraTraceTraffic::Start(void)
+{
+    m_trace = Load(m_fileName);
+    auto it = m_trace->find(m_nodeId);
+    m_packets = it != m_trace->end() ? &it->second : nullptr;
+    m_next = 0;
+    if (!m_packets)
+    {
+        NS_LOG_INFO("Node " << m_nodeId << " has no packets in " << m_fileName);
+        return;
+    }
+    //lines before the start are skipped
+    m_next = std::lower_bound(m_packets->begin(), m_packets->end(), Simulator::Now(), [](const std::pair<Time, uint32_t> &packet, const Time &now) {
+        return packet.first < now;
+    }) - m_packets->begin();
+    NS_LOG_INFO("Node " << m_nodeId << " replays " << m_packets->size() - m_next << " packets from " << m_fileName);
+    ScheduleNext();
+}
+
+void
+MultiHopLoraTraceTraffic::ScheduleNext(void)
+{
+    if (m_next < m_packets->size())
+    {
+        m_event = Simulator::Schedule((*m_packets)[m_next].first - Simulator::Now(), &MultiHopLoraTraceTraffic::Send, this);
+    }
+}
+
+void
+MultiHopLoraTraceTraffic::Send(void)
+{
+    Generate((*m_packets)[m_next++].second);
+    ScheduleNext();
+}
+
+TypeId
+MultiHopLoraBurstTraffic::GetTypeId(void)
+{
+    static TypeId tid = TypeId("ns3::MultiHopLoraBurstTraffic")
+    .SetParent<MultiHopLoraTrafficModel>()
+    .SetGroupName("lorawan")
+    .AddConstructor<MultiHopLoraBurstTraffic>()
+    .AddAttribute("BurstSize",
+                  "Packets sent for every event",
+                  UintegerValue(3),
+                  MakeUintegerAccessor(&MultiHopLoraBurstTraffic::m_burstSize),
+                  MakeUintegerChecker<uint32_t>(1))
+    .AddAttribute("BurstSpacing",
+                  "Time between the packets of a burst",
+                  TimeValue(Seconds(5)),
+                  MakeTimeAccessor(&MultiHopLoraBurstTraffic::m_burstSpacing),
+                  MakeTimeChecker())
+    .AddAttribute("ReactionDelay",
+                  "Upper bound of the uniform delay between the event and the first packet",
+                  TimeValue(Seconds(2)),
+                  MakeTimeAccessor(&MultiHopLoraBurstTraffic::m_reactionDelay),
+                  MakeTimeChecker())
+    ;
+    return tid;
+}
+
+MultiHopLoraBurstTraffic::MultiHopLoraBurstTraffic():m_burstSize(3),m_burstSpacing(Seconds(5)),m_reactionDelay(Seconds(2)),m_running(false),m_remaining(0)
+{
+    m_rng = CreateObject<UniformRandomVariable>();
+}
+
+MultiHopLoraBurstTraffic::~MultiHopLoraBurstTraffic()
+{}
+
+void
+MultiHopLoraBurstTraffic::Start(void)
+{
+    m_running = true;
+    m_remaining = 0;
+}
+
+void
+MultiHopLoraBurstTraffic::Stop(void)
+{
+    m_running = false;
+    MultiHopLoraTrafficModel::Stop();
+}
+
+void
+MultiHopLoraBurstTraffic::Trigger(void)
+{
+    if (!m_running)
+    {
+        return;
+    }
+    bool idle = m_remaining == 0;
+    m_remaining += m_burstSize;
+    if (idle)
+    {
+        m_event = Simulator::Schedule(Seconds(m_rng->GetValue(0, m_reactionDelay.GetSeconds())), &MultiHopLoraBurstTraffic::Send, this);
+    }
+}
+
+void
+MultiHopLoraBurstTraffic::Send(void)
+{
+    Generate();
+    if (--m_remaining > 0)
+    {
+        m_event = Simulator::Schedule(m_burstSpacing, &MultiHopLoraBurstTraffic::Send, this);
+    }
+}
+
+int64_t
+MultiHopLoraBurstTraffic::AssignStreams(int64_t stream)
+{
+    int64_t used = MultiHopLoraTrafficModel::AssignStreams(stream);
+    m_rng->SetStream(stream + used);
+    return used + 1;
+}
+
+TypeId
+MultiHopLoraEventField::GetTypeId(void)
+{
+    static TypeId tid = TypeId("ns3::MultiHopLoraEventField")
+    .SetParent<Object>()
+    .SetGroupName("lorawan")
+    .AddConstructor<MultiHopLoraEventField>()
+    .AddAttribute("MeanInterval",
+                  "Mean time between two events anywhere in the field",
+                  TimeValue(Seconds(600)),
+                  MakeTimeAccessor(&MultiHopLoraEventField::m_meanInterval),
+                  MakeTimeChecker())
+    .AddAttribute("Radius",
+                  "Sources within this many meters of an event react to it",
+                  DoubleValue(500.0),
+                  MakeDoubleAccessor(&MultiHopLoraEventField::m_radius),
+                  MakeDoubleChecker<double>(0.0))
+    ;
+    return tid;
+}
+
+MultiHopLoraEventField::MultiHopLoraEventField():m_meanInterval(Seconds(600)),m_radius(500.0),m_events(0),m_triggers(0)
+{
+    m_time = CreateObject<ExponentialRandomVariable>();
+    m_position = CreateObject<UniformRandomVariable>();
+}
+
+MultiHopLoraEventField::~MultiHopLoraEventField()
+{}
+
+void
+MultiHopLoraEventField::AddSource(Ptr<MultiHopLoraBurstTraffic> source, const Vector &position)
+{
+    m_sources.push_back(std::make_pair(source, position));
+}
+
+void
+MultiHopLoraEventField::Start(void)
+{
+    NS_ASSERT_MSG(m_meanInterval.IsStrictlyPositive(), "MeanInterval must be positive");
+    m_event = Simulator::Schedule(Seconds(m_time->GetValue(m_meanInterval.GetSeconds(), 0)), &MultiHopLoraEventField::Fire, this);
+}
+
+void
+MultiHopLoraEventField::Stop(void)
+{
+    Simulator::Cancel(m_event);
+}
+
+void
+MultiHopLoraEventField::Fire(void)
+{
+    m_event = Simulator::Schedule(Seconds(m_time->GetValue(m_meanInterval.GetSeconds(), 0)), &MultiHopLoraEventField::Fire, this);
+    if (m_sources.empty())
+    {
+        return;
+    }
+
+    double xMin = m_sources.front().second.x, xMax = xMin;
+    double yMin = m_sources.front().second.y, yMax = yMin;
+    for (const auto &source : m_sources)
+    {
+        xMin = std::min(xMin, source.second.x);
+        xMax = std::max(xMax, source.second.x);
+        yMin = std::min(yMin, source.second.y);
+        yMax = std::max(yMax, source.second.y);
+    }
+    //both coordinates are drawn on every rank, so distributed runs see the same events
+    Vector event(m_position->GetValue(xMin, xMax), m_position->GetValue(yMin, yMax), 0);
+    m_events++;
+
+    for (const auto &source : m_sources)
+    {
+        double dx = source.second.x - event.x;
+        double dy = source.second.y - event.y;
+        if (source.first && dx * dx + dy * dy <= m_radius * m_radius)
+        {
+            m_triggers++;
+            Simulator::ScheduleWithContext(source.first->GetNodeId(), Seconds(0), &MultiHopLoraBurstTraffic::Trigger, source.first);
+        }
+    }
+    NS_LOG_DEBUG("Event " << m_events << " at (" << event.x << ", " << event.y << ")");
+}
+
+int64_t
+MultiHopLoraEventField::AssignStreams(int64_t stream)
+{
+    m_time->SetStream(stream);
+    m_position->SetStream(stream + 1);
+    return 2;
+}
+
+// Getters implementation
+uint64_t MultiHopLoraEventField::GetEvents (void) const { return m_events; }
+uint64_t MultiHopLoraEventField::GetTriggers (void) const { return m_triggers; }
+
+} //namespace ns3
@@ -0,0 +1,186 @@
+#ifndef MULTI_HOP_LORA_TRAFFIC_H
+#define MULTI_HOP_LORA_TRAFFIC_H
+
+#include "ns3/object.h"
+#include "ns3/nstime.h"
+#include "ns3/callback.h"
+#include "ns3/event-id.h"
+#include "ns3/vector.h"
+#include "ns3/random-variable-stream.h"
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <cstdint>
+
+namespace ns3 {
+
+//decides when a source originates a packet and how large its payload is
+//a model drives one source: the app hands it a callback in StartApplication and the model calls
+//it with the payload size of every packet. payload sizes are drawn from PayloadSize, rounded and
+//at least 1 byte; with the multi-hop header on top they must stay within a LoRa frame
+class MultiHopLoraTrafficModel: public Object
+{
+public:
+    static TypeId GetTypeId(void);
+    MultiHopLoraTrafficModel();
+    virtual ~MultiHopLoraTrafficModel();
+
+    typedef Callback<void, uint32_t> SendCallback;
+
+    void SetSendCallback(SendCallback send);
+    void SetNodeId(uint32_t nodeId);
+    uint32_t GetNodeId(void) const;
+
+    virtual void Start(void) = 0;
+    virtual void Stop(void);
+
+    //returns the number of streams used, models reserve at most 4
+    virtual int64_t AssignStreams(int64_t stream);
+
+    uint64_t GetGenerated(void) const;
+
+protected:
+    //draws a payload size and hands the packet to the app
+    void Generate(void);
+    void Generate(uint32_t size);
+
+    uint32_t m_nodeId;
+    EventId m_event;
+
+private:
+    SendCallback m_send;
+    Ptr<RandomVariableStream> m_size;
+    uint64_t m_generated;
+};
+
+//fixed interval with a uniform jitter of up to +-Jitter, the first packet at a random phase
+class MultiHopLoraPeriodicTraffic: public MultiHopLoraTrafficModel
+{
+public:
+    static TypeId GetTypeId(void);
+    MultiHopLoraPeriodicTraffic();
+    virtual ~MultiHopLoraPeriodicTraffic();
+
+    virtual void Start(void);
+    virtual int64_t AssignStreams(int64_t stream);
+
+private:
+    void Send(void);
+
+    Time m_interval;
+    Time m_jitter;
+    Ptr<UniformRandomVariable> m_rng;
+};
+
+//exponential inter-arrival times, MeanInterval apart on average
+class MultiHopLoraPoissonTraffic: public MultiHopLoraTrafficModel
+{
+public:
+    static TypeId GetTypeId(void);
+    MultiHopLoraPoissonTraffic();
+    virtual ~MultiHopLoraPoissonTraffic();
+
+    virtual void Start(void);
+    virtual int64_t AssignStreams(int64_t stream);
+
+private:
+    void Send(void);
+
+    Time m_meanInterval;
+    Ptr<ExponentialRandomVariable> m_rng;
+};
+
+//replays "time,node,size" lines of a CSV file, time in seconds of simulation time
+//only the lines of this model's node are used, lines before the start are skipped
+class MultiHopLoraTraceTraffic: public MultiHopLoraTrafficModel
+{
+public:
+    static TypeId GetTypeId(void);
+    MultiHopLoraTraceTraffic();
+    virtual ~MultiHopLoraTraceTraffic();
+
+    virtual void Start(void);
+
+private:
+    typedef std::vector<std::pair<Time, uint32_t>> Packets; //sorted by time
+    typedef std::unordered_map<uint32_t, Packets> Trace; //by node
+
+    //parses a file on first use, the sources replaying it share the result
+    static std::shared_ptr<const Trace> Load(const std::string &fileName);
+
+    void Send(void);
+    void ScheduleNext(void);
+
+    std::string m_fileName;
+    std::shared_ptr<const Trace> m_trace;
+    const Packets *m_packets; //this node's, null if it has none
+    uint32_t m_next;
+};
+
+//sends BurstSize packets BurstSpacing apart after an event of a MultiHopLoraEventField near it
+//the burst starts after a uniform reaction delay, events during a burst lengthen it
+class MultiHopLoraBurstTraffic: public MultiHopLoraTrafficModel
+{
+public:
+    static TypeId GetTypeId(void);
+    MultiHopLoraBurstTraffic();
+    virtual ~MultiHopLoraBurstTraffic();
+
+    virtual void Start(void);
+    virtual void Stop(void);
+    virtual int64_t AssignStreams(int64_t stream);
+
+    //called by the event field in the node's context
+    void Trigger(void);
+
+private:
+    void Send(void);
+
+    uint32_t m_burstSize;
+    Time m_burstSpacing;
+    Time m_reactionDelay;
+    Ptr<UniformRandomVariable> m_rng;
+    bool m_running;
+    uint32_t m_remaining;
+};
+
+//spatially correlated events, e.g. a fire or a flood front seen by every sensor nearby
+//events arrive as a Poisson process at uniform positions over the bounding box of the
+//registered sources, and trigger every source within Radius of them
+class MultiHopLoraEventField: public Object
+{
+public:
+    static TypeId GetTypeId(void);
+    MultiHopLoraEventField();
+    virtual ~MultiHopLoraEventField();
+
+    //a null source only widens the field, for sources owned by another rank
+    void AddSource(Ptr<MultiHopLoraBurstTraffic> source, const Vector &position);
+    void Start(void);
+    void Stop(void);
+
+    //returns the number of streams used, all ranks of a distributed run must pass the same
+    int64_t AssignStreams(int64_t stream);
+
+    //Getters
+    uint64_t GetEvents(void) const;
+    uint64_t GetTriggers(void) const;
+
+private:
+    void Fire(void);
+
+    Time m_meanInterval;
+    double m_radius;
+    std::vector<std::pair<Ptr<MultiHopLoraBurstTraffic>, Vector>> m_sources;
+    Ptr<ExponentialRandomVariable> m_time;
+    Ptr<UniformRandomVariable> m_position;
+    EventId m_event;
+    uint64_t m_events;
+    uint64_t m_triggers;
+};
+
+} //namespace ns3
+
+#endif //MULTI_HOP_LORA_TRAFFIC_H
@@ -0,0 +1,392 @@
+// Benchmarks for the multi-hop header, the forwarding policy and whole runs of
+// multi-hop-lora-sim, written as one JSON document so builds can be compared.
+//
+// - header: Serialize, Deserialize and prefix peek for every wire format and
+//   path lengths 1..MULTI_HOP_LORA_PATH_CAPACITY
+// - selection: the F1/F2/max-LGw decision of one LFID with 1..50 candidates,
+//   both the streaming candidate and the buffered scan
+// - loss: CalcRxPower of LogDistance on its own and behind the path-loss cache,
+//   for random pairs of 1000 static nodes
+// - scale (with --sim): the sim on a grid of 10, 100 and 1000 nodes, each run in
+//   its own process, reporting events/s, wall time per simulated hour and peak RSS
+//
+// Build against an ns-3 install, e.g.
+//   g++ -std=c++17 -O2 -I$NS3/build/include -o multi-hop-lora-bench tools/multi-hop-lora-bench.cc
+//       multi-hop-lora-app.cc multi-hop-lora-header.cc multi-hop-lora-cache.cc multi-hop-lora-trace.cc multi-hop-lora-server.cc
+//       multi-hop-lora-scheduler.cc multi-hop-lora-loss.cc multi-hop-lora-traffic.cc multi-hop-lora-forwarder.cc multi-hop-lora-profile.cc
+//       -L$NS3/build/lib -lns3.45-core-default -lns3.45-network-default -lns3.45-mobility-default
+//       -lns3.45-propagation-default -lns3.45-lorawan-default -pthread
+// Example:
+//   ./multi-hop-lora-bench --sim=./ns3.45-multi-hop-lora-sim-optimized --out=bench.json
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/mobility-module.h"
+#include "ns3/propagation-loss-model.h"
+#include "../multi-hop-lora-app.h"
+#include "../multi-hop-lora-header.h"
+#include "../multi-hop-lora-loss.h"
+
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace ns3 {
+
+//friend of MultiHopLoraApp, drives the private selection functions directly
+class MultiHopLoraAppBenchmark
+{
+public:
+    explicit MultiHopLoraAppBenchmark(uint8_t lgw)
+    {
+        m_app = CreateObject<MultiHopLoraApp>();
+        m_app->Setup(100, lgw, false, false, 20.0, 32);
+    }
+
+    //running candidate, as done while the window is open
+    bool Streaming(const std::vector<Ptr<Packet>> &copies) const
+    {
+        MultiHopLoraApp::Candidate best{nullptr, 0, 0, 0, 0, 0, 0};
+        for (const Ptr<Packet> &packet : copies)
+        {
+            MultiHopLoraPrefixHeader header;
+            packet->PeekHeader(header);
+            m_app->UpdateCandidate(best, packet, header);
+        }
+        return bool(m_app->SelectCandidate(best));
+    }
+
+    bool Buffered(const std::vector<Ptr<Packet>> &copies) const
+    {
+        return bool(m_app->SelectBuffered(copies));
+    }
+
+private:
+    Ptr<MultiHopLoraApp> m_app;
+};
+
+} //namespace ns3
+
+using namespace ns3;
+
+namespace {
+
+//defeats dead-code elimination of the measured calls
+volatile uint64_t g_sink = 0;
+
+typedef std::chrono::steady_clock Clock;
+
+double
+NsPerOp(Clock::time_point start, Clock::time_point end, uint64_t ops)
+{
+    return std::chrono::duration<double, std::nano>(end - start).count() / ops;
+}
+
+MultiHopLoraHeader
+MakeHeader(uint8_t lpty, uint8_t hops)
+{
+    MultiHopLoraHeader header;
+    header.SetLfid(MultiHopLoraHeader::MakeLfid(17, 4242));
+    header.SetLnid(17);
+    header.SetLpty(lpty);
+    header.SetLh(hops);
+    header.SetLgw(3);
+    for (uint8_t i = 0; i < hops; ++i)
+    {
+        header.AddNodeToPath(17 + i);
+    }
+    return header;
+}
+
+std::string
+BenchHeader(uint64_t iterations)
+{
+    struct Format
+    {
+        const char *name;
+        uint8_t lpty;
+    };
+    const Format formats[] = {{"v1", MultiHopLoraHeader::LPTY_DATA},
+                              {"v2", uint8_t(MultiHopLoraHeader::LPTY_DATA | MultiHopLoraHeader::LPTY_COMPACT)},
+                              {"v2-hash", uint8_t(MultiHopLoraHeader::LPTY_DATA | MultiHopLoraHeader::LPTY_COMPACT | MultiHopLoraHeader::LPTY_PATH_HASH)}};
+
+    std::ostringstream os;
+    os << "[";
+    bool first = true;
+    for (const Format &format : formats)
+    {
+        for (uint8_t hops = 1; hops <= MultiHopLoraHeader::Path::CAPACITY; ++hops)
+        {
+            MultiHopLoraHeader header = MakeHeader(format.lpty, hops);
+            uint32_t size = header.GetSerializedSize();
+            Buffer buffer;
+            buffer.AddAtStart(size);
+
+            Clock::time_point t0 = Clock::now();
+            for (uint64_t i = 0; i < iterations; ++i)
+            {
+                header.Serialize(buffer.Begin());
+            }
+            Clock::time_point t1 = Clock::now();
+            uint64_t sum = 0;
+            for (uint64_t i = 0; i < iterations; ++i)
+            {
+                MultiHopLoraHeader parsed;
+                sum += parsed.Deserialize(buffer.Begin());
+            }
+            Clock::time_point t2 = Clock::now();
+            for (uint64_t i = 0; i < iterations; ++i)
+            {
+                MultiHopLoraPrefixHeader prefix;
+                sum += prefix.Deserialize(buffer.Begin());
+            }
+            Clock::time_point t3 = Clock::now();
+            g_sink += sum;
+
+            os << (first ? "" : ",") << "\n    {\"format\": \"" << format.name << "\", \"hops\": " << int(hops) << ", \"bytes\": " << size
+               << ", \"serializeNs\": " << NsPerOp(t0, t1, iterations) << ", \"deserializeNs\": " << NsPerOp(t1, t2, iterations)
+               << ", \"peekPrefixNs\": " << NsPerOp(t2, t3, iterations) << "}";
+            first = false;
+        }
+    }
+    os << "\n  ]";
+    return os.str();
+}
+
+std::string
+BenchSelection(uint64_t iterations)
+{
+    const uint8_t ownLgw = 3;
+    MultiHopLoraAppBenchmark bench(ownLgw);
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<int> lh(1, 6);
+    std::uniform_int_distribution<int> lgw(0, 6);
+
+    std::ostringstream os;
+    os << "[";
+    bool first = true;
+    for (uint32_t n : {1, 2, 5, 10, 20, 50})
+    {
+        //random copies of one LFID, so F1 and F2 filter a realistic mix
+        std::vector<Ptr<Packet>> copies;
+        for (uint32_t i = 0; i < n; ++i)
+        {
+            MultiHopLoraHeader header = MakeHeader(MultiHopLoraHeader::LPTY_DATA, uint8_t(lh(rng)));
+            header.SetLgw(uint8_t(lgw(rng)));
+            Ptr<Packet> packet = Create<Packet>(32);
+            packet->AddHeader(header);
+            copies.push_back(packet);
+        }
+
+        uint64_t rounds = std::max<uint64_t>(1, iterations / n);
+        uint64_t selected = 0;
+        Clock::time_point t0 = Clock::now();
+        for (uint64_t i = 0; i < rounds; ++i)
+        {
+            selected += bench.Streaming(copies);
+        }
+        Clock::time_point t1 = Clock::now();
+        for (uint64_t i = 0; i < rounds; ++i)
+        {
+            selected += bench.Buffered(copies);
+        }
+        Clock::time_point t2 = Clock::now();
+        g_sink += selected;
+
+        os << (first ? "" : ",") << "\n    {\"candidates\": " << n << ", \"streamingNs\": " << NsPerOp(t0, t1, rounds)
+           << ", \"bufferedNs\": " << NsPerOp(t1, t2, rounds) << "}";
+        first = false;
+    }
+    os << "\n  ]";
+    return os.str();
+}
+
+std::string
+BenchLoss(uint64_t iterations)
+{
+    const uint32_t nodes = 1000;
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<double> coordinate(0.0, 6000.0);
+    std::vector<Ptr<MobilityModel>> mobility;
+    for (uint32_t i = 0; i < nodes; ++i)
+    {
+        Ptr<ConstantPositionMobilityModel> position = CreateObject<ConstantPositionMobilityModel>();
+        position->SetPosition(Vector(coordinate(rng), coordinate(rng), 1.5));
+        mobility.push_back(position);
+    }
+    std::uniform_int_distribution<uint32_t> node(0, nodes - 1);
+    std::vector<std::pair<uint32_t, uint32_t>> pairs(std::min<uint64_t>(iterations, 1 << 16));
+    for (auto &pair : pairs)
+    {
+        pair = std::make_pair(node(rng), node(rng));
+    }
+
+    Ptr<PropagationLossModel> raw = CreateObject<LogDistancePropagationLossModel>();
+    Ptr<MultiHopLoraCachedLossModel> cached = CreateObject<MultiHopLoraCachedLossModel>(CreateObject<LogDistancePropagationLossModel>());
+    double sum = 0;
+    //every pair is cached before the cached model is timed
+    for (const auto &pair : pairs)
+    {
+        sum += cached->CalcRxPower(12.0, mobility[pair.first], mobility[pair.second]);
+    }
+    Clock::time_point t0 = Clock::now();
+    for (uint64_t i = 0; i < iterations; ++i)
+    {
+        const auto &pair = pairs[i % pairs.size()];
+        sum += raw->CalcRxPower(12.0, mobility[pair.first], mobility[pair.second]);
+    }
+    Clock::time_point t1 = Clock::now();
+    for (uint64_t i = 0; i < iterations; ++i)
+    {
+        const auto &pair = pairs[i % pairs.size()];
+        sum += cached->CalcRxPower(12.0, mobility[pair.first], mobility[pair.second]);
+    }
+    Clock::time_point t2 = Clock::now();
+    g_sink += uint64_t(std::abs(sum));
+
+    std::ostringstream os;
+    os << "{\"nodes\": " << nodes << ", \"logDistanceNs\": " << NsPerOp(t0, t1, iterations) << ", \"cachedNs\": " << NsPerOp(t1, t2, iterations)
+       << ", \"cachedPairs\": " << cached->GetEntries() << "}";
+    return os.str();
+}
+
+//last row of a results file written by the sim, split on commas
+std::vector<std::string>
+LastRow(const std::string &file)
+{
+    std::ifstream in(file);
+    std::string line, last;
+    while (std::getline(in, line))
+    {
+        if (!line.empty())
+        {
+            last = line;
+        }
+    }
+    std::vector<std::string> fields;
+    std::istringstream row(last);
+    while (std::getline(row, line, ','))
+    {
+        fields.push_back(line);
+    }
+    return fields;
+}
+
+std::string
+BenchScale(const std::string &sim, double simulationTime, const std::vector<std::string> &extraArgs)
+{
+    std::ostringstream os;
+    os << "[";
+    bool first = true;
+    for (uint32_t nodes : {10, 100, 1000})
+    {
+        std::string results = "multi-hop-lora-bench-" + std::to_string(nodes) + ".csv";
+        std::remove(results.c_str());
+        std::vector<std::string> args = {sim,
+                                         "--topology=grid",
+                                         "--numNodes=" + std::to_string(nodes),
+                                         "--numGateways=" + std::to_string(std::max(1u, nodes / 100)),
+                                         "--numSources=" + std::to_string(std::max(1u, nodes / 10)),
+                                         "--simulationTime=" + std::to_string(simulationTime),
+                                         "--results=" + results};
+        args.insert(args.end(), extraArgs.begin(), extraArgs.end());
+
+        Clock::time_point start = Clock::now();
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            std::freopen("/dev/null", "w", stdout);
+            std::vector<char *> argv;
+            for (const std::string &a : args)
+            {
+                argv.push_back(const_cast<char *>(a.c_str()));
+            }
+            argv.push_back(nullptr);
+            execv(sim.c_str(), argv.data());
+            std::perror("execv");
+            _exit(127);
+        }
+        //peak RSS of this child alone, which a run inside this process could not isolate
+        int status = 0;
+        struct rusage usage;
+        wait4(pid, &status, 0, &usage);
+        double processSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        std::vector<std::string> row = LastRow(results);
+        bool ok = WIFEXITED(status) && WEXITSTATUS(status) == 0 && row.size() >= 11;
+        os << (first ? "" : ",") << "\n    {\"nodes\": " << nodes << ", \"ok\": " << (ok ? "true" : "false");
+        if (ok)
+        {
+            //columns 9 and 10 are events and wallSeconds of Simulator::Run
+            double events = std::atof(row[9].c_str());
+            double wall = std::atof(row[10].c_str());
+            os << ", \"simulatedSeconds\": " << simulationTime << ", \"events\": " << uint64_t(events) << ", \"runWallSeconds\": " << wall
+               << ", \"processWallSeconds\": " << processSeconds << ", \"eventsPerSecond\": " << (wall > 0 ? events / wall : 0.0)
+               << ", \"wallSecondsPerSimulatedHour\": " << wall * 3600.0 / simulationTime << ", \"pdr\": " << row[8];
+        }
+        os << ", \"peakRssKb\": " << usage.ru_maxrss << "}";
+        first = false;
+    }
+    os << "\n  ]";
+    return os.str();
+}
+
+} //namespace
+
+int main(int argc, char *argv[])
+{
+    uint64_t iterations = 200000;
+    std::string sim = "";
+    double simulationTime = 3600.0;
+    std::string simArgs = "";
+    std::string outFile = "";
+
+    CommandLine cmd(__FILE__);
+    cmd.AddValue("iterations", "Operations per microbenchmark", iterations);
+    cmd.AddValue("sim", "multi-hop-lora-sim binary for the scale benchmark (skipped if empty)", sim);
+    cmd.AddValue("simulationTime", "Simulated seconds per scale run", simulationTime);
+    cmd.AddValue("simArgs", "Extra arguments for the scale runs, separated by spaces", simArgs);
+    cmd.AddValue("out", "Write the JSON report to this file instead of stdout", outFile);
+    cmd.Parse(argc, argv);
+
+    std::vector<std::string> extraArgs;
+    std::istringstream words(simArgs);
+    std::string word;
+    while (words >> word)
+    {
+        extraArgs.push_back(word);
+    }
+
+    std::ostringstream json;
+    json << "{\n  \"pathCapacity\": " << int(MultiHopLoraHeader::Path::CAPACITY) << ",\n  \"iterations\": " << iterations;
+    json << ",\n  \"header\": " << BenchHeader(iterations);
+    json << ",\n  \"selection\": " << BenchSelection(iterations);
+    json << ",\n  \"loss\": " << BenchLoss(iterations);
+    if (!sim.empty())
+    {
+        json << ",\n  \"scale\": " << BenchScale(sim, simulationTime, extraArgs);
+    }
+    json << "\n}\n";
+
+    if (outFile.empty())
+    {
+        std::cout << json.str();
+    }
+    else
+    {
+        std::ofstream(outFile) << json.str();
+    }
+    return 0;
+}
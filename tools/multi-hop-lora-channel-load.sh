@@ -0,0 +1,31 @@
+#!/usr/bin/env bash
+# Delivered throughput versus offered load, single channel against a multi-channel plan.
+#
+# usage: tools/multi-hop-lora-channel-load.sh <sim binary> "<packet intervals>" <simulation time> [extra sim args]
+#   e.g. tools/multi-hop-lora-channel-load.sh ./build/scratch/ns3-dev-multi-hop-lora-sim-optimized "20 10 5 2 1" 600 \
+#            --topology=grid --numNodes=400 --numSources=40
+#
+# Every interval is run once per plan with the same seed. Offered load and throughput are
+# packets per second over the time the applications run (simulation time - 2 s).
+# PLANS overrides the compared plans, one comma-separated frequency list per word.
+set -euo pipefail
+
+SIM=$1
+INTERVALS=$2
+SIM_TIME=$3
+shift 3
+PLANS=${PLANS:-"868.1 868.1,868.3,868.5,867.1,867.3,867.5,867.7,867.9"}
+
+OUT=$(mktemp -d)
+printf "%-10s %-9s %-12s %-14s %-10s\n" interval channels offered_pps throughput_pps pdr
+for interval in $INTERVALS; do
+    for plan in $PLANS; do
+        channels=$(echo "$plan" | awk -F, '{print NF}')
+        csv="$OUT/i${interval}_c${channels}.csv"
+        "$SIM" --packetInterval="$interval" --simulationTime="$SIM_TIME" --results="$csv" \
+            --ns3::MultiHopLoraApp::ChannelPlan="$plan" "$@" > "${csv%.csv}.log" 2>&1
+        awk -F, -v t="$SIM_TIME" -v i="$interval" -v c="$channels" 'NR == 1 { for (k = 1; k <= NF; k++) col[$k] = k; next }
+            { d = t - 2; printf "%-10s %-9s %-12.3f %-14.3f %-10s\n", i, c, $col["sent"] / d, $col["delivered"] / d, $col["pdr"] }' "$csv"
+    done
+done
+echo "logs and result rows in $OUT"
@@ -0,0 +1,49 @@
+#!/usr/bin/env bash
+# Convergence time and control overhead of beacon gradient discovery as the network grows,
+# and a check that it converges as well with a multi-channel plan as with a single channel.
+#
+# usage: tools/multi-hop-lora-gradient-scaling.sh <sim binary> "<node counts>" <simulation time> [extra sim args]
+#   e.g. tools/multi-hop-lora-gradient-scaling.sh ./build/scratch/ns3-dev-multi-hop-lora-sim-optimized "100 400 1600" 1800 \
+#            --topology=grid --numSources=10
+#
+# Convergence is the simulation time of the last LGw change of any node, so the simulation
+# time must leave room for a few BeaconIntervals. Beacon airtime is summed over all nodes.
+# PLANS overrides the compared channel plans, one comma-separated frequency list per word; the
+# first is the reference. A later plan that leaves more than TOLERANCE (0) more nodes off the
+# computed LGw than the reference fails the check, and the script exits with status 1.
+set -euo pipefail
+
+SIM=$1
+COUNTS=$2
+SIM_TIME=$3
+shift 3
+PLANS=${PLANS:-"868.1 868.1,868.3 868.1,868.3,868.5,867.1,867.3,867.5,867.7,867.9"}
+TOLERANCE=${TOLERANCE:-0}
+
+OUT=$(mktemp -d)
+failed=0
+printf "%-8s %-9s %-14s %-9s %-18s %-16s %-10s %-10s\n" nodes channels convergence_s beacons beacon_airtime_s beacons_per_node on_lgw pdr
+for n in $COUNTS; do
+    reference=
+    for plan in $PLANS; do
+        channels=$(echo "$plan" | awk -F, '{print NF}')
+        csv="$OUT/n${n}_c${channels}.csv"
+        log="${csv%.csv}.log"
+        "$SIM" --numNodes="$n" --simulationTime="$SIM_TIME" --gradient=1 --results="$csv" \
+            --ns3::MultiHopLoraApp::ChannelPlan="$plan" "$@" > "$log" 2>&1
+        # "Gradient: <m> of <n> nodes on the computed LGw"
+        matching=$(awk '/^Gradient: / { print $2 }' "$log")
+        # columns are looked up by name, the results file grows new ones at the end
+        awk -F, -v n="$n" -v c="$channels" -v m="$matching" 'NR == 1 { for (i = 1; i <= NF; i++) col[$i] = i; next }
+            END { printf "%-8s %-9s %-14.1f %-9s %-18.3f %-16.2f %-10s %-10s\n", n, c, $col["convergence"], $col["beacons"],
+                         $col["beaconAirtime"], $col["beacons"] / n, m, $col["pdr"] }' "$csv"
+        if [ -z "$reference" ]; then
+            reference=$matching
+        elif [ "$matching" -lt $((reference - TOLERANCE)) ]; then
+            echo "FAIL: $n nodes, $channels channels: $matching nodes on the computed LGw, $reference with the first plan"
+            failed=1
+        fi
+    done
+done
+echo "logs and result rows in $OUT"
+exit $failed
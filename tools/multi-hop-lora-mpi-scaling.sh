@@ -0,0 +1,41 @@
+#!/usr/bin/env bash
+# Speedup of a distributed multi-hop-lora-sim run versus MPI rank count.
+#
+# usage: tools/multi-hop-lora-mpi-scaling.sh <sim binary> "<rank counts>" [extra sim args]
+#   e.g. tools/multi-hop-lora-mpi-scaling.sh ./build/scratch/ns3-dev-multi-hop-lora-sim-optimized "1 2 4 8" \
+#            --topology=grid --numNodes=5000 --numSources=50 --simulationTime=600
+#
+# A sequential run (without --distributed) comes first, it is the baseline for the speedup and
+# for the results: every distributed run prints its PDR and p99 latency next to the sequential ones.
+# The report is also written as CSV to REPORT (default mpi-scaling.csv).
+set -euo pipefail
+
+SIM=$1
+RANKS=$2
+shift 2
+REPORT=${REPORT:-mpi-scaling.csv}
+
+OUT=$(mktemp -d)
+
+# prints wall seconds, pdr and latencyP99 of one run, the columns are looked up by name
+run() {
+    local name=$1
+    shift
+    local start end
+    start=$(date +%s.%N)
+    "$@" --results="$OUT/$name.csv" > "$OUT/$name.log" 2>&1
+    end=$(date +%s.%N)
+    awk -F, -v wall="$(awk -v s="$start" -v e="$end" 'BEGIN { print e - s }')" 'NR == 1 { for (i = 1; i <= NF; i++) col[$i] = i; next }
+        { pdr = $col["pdr"]; p99 = $col["latencyP99"] } END { print wall, pdr, p99 }' "$OUT/$name.csv"
+}
+
+read -r base basePdr baseP99 < <(run sequential "$SIM" "$@")
+echo "ranks,wallSeconds,speedup,efficiency,pdr,pdrDelta,latencyP99,latencyP99Delta" > "$REPORT"
+awk -v base="$base" -v pdr="$basePdr" -v p99="$baseP99" 'BEGIN { printf "sequential,%.2f,1,1,%s,0,%s,0\n", base, pdr, p99 }' >> "$REPORT"
+for np in $RANKS; do
+    read -r wall pdr p99 < <(run "np$np" mpirun -np "$np" "$SIM" --distributed=1 "$@")
+    awk -v np="$np" -v wall="$wall" -v base="$base" -v pdr="$pdr" -v basePdr="$basePdr" -v p99="$p99" -v baseP99="$baseP99" \
+        'BEGIN { printf "%s,%.2f,%.2f,%.2f,%s,%.4f,%s,%.4f\n", np, wall, base / wall, base / wall / np, pdr, pdr - basePdr, p99, p99 - baseP99 }' >> "$REPORT"
+done
+awk -F, '{ printf "%-11s %-12s %-8s %-11s %-10s %-9s %-11s %-15s\n", $1, $2, $3, $4, $5, $6, $7, $8 }' "$REPORT"
+echo "report in $REPORT, logs and result rows in $OUT"
@@ -0,0 +1,44 @@
+#!/usr/bin/env bash
+# Checks --phy=abstract against the full PHY and measures its speedup.
+#
+# usage: tools/multi-hop-lora-phy-validation.sh <sim binary> <runs> [extra sim args]
+#   e.g. tools/multi-hop-lora-phy-validation.sh ./build/scratch/ns3-dev-multi-hop-lora-sim-optimized 10
+#        SCENARIOS=unobstructed tools/multi-hop-lora-phy-validation.sh ./multi-hop-lora-sim 10 --topology=grid --numNodes=400 --numSources=40
+#
+# Runs every scenario in SCENARIOS (default "obstructed unobstructed") with both PHY modes over the
+# same RngRun indices and prints the mean PDR, forwards, p50 latency and wall time of each mode.
+# Exits 1 if the mean PDR of a scenario differs by more than TOLERANCE (default 0.05).
+set -euo pipefail
+
+SIM=$1
+RUNS=$2
+shift 2
+SCENARIOS=${SCENARIOS:-"obstructed unobstructed"}
+TOLERANCE=${TOLERANCE:-0.05}
+
+OUT=$(mktemp -d)
+status=0
+printf "%-14s %-10s %-8s %-8s %-10s %-10s %-12s %-8s\n" scenario phy pdr dpdr forwarded p50_s wall_s speedup
+for scenario in $SCENARIOS; do
+    for phy in full abstract; do
+        csv="$OUT/${scenario}-${phy}.csv"
+        for run in $(seq 1 "$RUNS"); do
+            "$SIM" --scenario="$scenario" --phy="$phy" --RngRun="$run" --results="$csv" "$@" > "$OUT/${scenario}-${phy}-${run}.log" 2>&1
+        done
+    done
+    # columns are looked up by name, the results file grows new ones at the end
+    awk -F, -v scenario="$scenario" -v tolerance="$TOLERANCE" '
+        FNR == 1 { for (i = 1; i <= NF; i++) col[$i] = i; file++; next }
+        { n[file]++; pdr[file] += $col["pdr"]; fwd[file] += $col["forwarded"]; p50[file] += $col["latencyP50"]; wall[file] += $col["wallSeconds"] }
+        END { split("full abstract", name, " ")
+              for (f = 1; f <= 2; f++) { pdr[f] /= n[f]; fwd[f] /= n[f]; p50[f] /= n[f]; wall[f] /= n[f] }
+              printf "%-14s %-10s %-8.3f %-8s %-10.1f %-10.3f %-12.3f %-8s\n", scenario, name[1], pdr[1], "", fwd[1], p50[1], wall[1], ""
+              printf "%-14s %-10s %-8.3f %-+8.3f %-10.1f %-10.3f %-12.3f %-8.1f\n", scenario, name[2], pdr[2], pdr[2] - pdr[1], fwd[2], p50[2], wall[2],
+                     (wall[2] > 0 ? wall[1] / wall[2] : 0)
+              exit (pdr[2] - pdr[1] > tolerance || pdr[1] - pdr[2] > tolerance) }' "$OUT/${scenario}-full.csv" "$OUT/${scenario}-abstract.csv" || status=1
+done
+if [ "$status" -ne 0 ]; then
+    echo "PDR of the abstract PHY is off by more than $TOLERANCE"
+fi
+echo "logs and result rows in $OUT"
+exit "$status"
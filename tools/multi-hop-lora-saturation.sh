@@ -0,0 +1,39 @@
+#!/usr/bin/env bash
+# Saturation throughput and latency knee of a topology under growing offered load.
+#
+# usage: tools/multi-hop-lora-saturation.sh <sim binary> "<packet intervals>" <simulation time> [extra sim args]
+#   e.g. tools/multi-hop-lora-saturation.sh ./build/scratch/ns3-dev-multi-hop-lora-sim-optimized "600 300 120 60 30 15" 3700 \
+#            --topology=grid --numSources=20 --traffic=poisson
+#
+# Give the intervals from the lightest load to the heaviest. Offered load and throughput are in
+# packets per second over the time the sources run. The saturation throughput is the highest
+# throughput seen, the knee is the lightest load whose p99 latency is more than KNEE (default 2)
+# times the one of the lightest load.
+set -euo pipefail
+
+SIM=$1
+INTERVALS=$2
+SIM_TIME=$3
+shift 3
+KNEE=${KNEE:-2}
+
+OUT=$(mktemp -d)
+printf "%-10s %-12s %-12s %-8s %-10s %-10s\n" interval offered_pps throughput pdr p50_s p99_s
+for interval in $INTERVALS; do
+    csv="$OUT/i${interval}.csv"
+    "$SIM" --packetInterval="$interval" --simulationTime="$SIM_TIME" --results="$csv" "$@" > "${csv%.csv}.log" 2>&1
+    # columns are looked up by name, the results file grows new ones at the end
+    awk -F, -v interval="$interval" -v active="$SIM_TIME" 'NR == 1 { for (i = 1; i <= NF; i++) col[$i] = i; next }
+        END { active -= 2; # the apps run from 1 s to simulationTime - 1 s
+              printf "%-10s %-12.4f %-12.4f %-8.3f %-10.3f %-10.3f\n", interval, $col["sent"] / active,
+                     $col["delivered"] / active, $col["pdr"], $col["latencyP50"], $col["latencyP99"] }' "$csv"
+done | tee "$OUT/summary.txt"
+
+# the summary holds data rows only, the table header went to the terminal
+awk -v knee="$KNEE" '{ if ($3 > best) { best = $3; bestInterval = $1 }
+      if (base == "") base = $6
+      if (kneeInterval == "" && $6 > knee * base) { kneeInterval = $1; kneeOffered = $2 } }
+    END { printf "saturation throughput %.4f pkt/s at interval %s\n", best, bestInterval
+          if (kneeInterval == "") print "no latency knee in the swept range"
+          else printf "latency knee at interval %s (offered %.4f pkt/s)\n", kneeInterval, kneeOffered }' "$OUT/summary.txt"
+echo "logs and result rows in $OUT"
@@ -0,0 +1,428 @@
+// Parallel parameter sweep driver for multi-hop-lora-sim.
+//
+// Runs every (scenario, numPackets, packetInterval, run) combination, with the
+// same --args, as an independent process, keeping up to --jobs of them busy at once. Each job
+// gets --RngRun=<run>, so a given replication index sees the same random
+// streams in every configuration. Completed jobs are appended to the state
+// file as they finish, and rerunning the same command skips them. Once all
+// jobs are done the state file is merged into one table with the mean and
+// 95% confidence interval of every metric.
+//
+// Build (plain C++17, no ns-3 needed):
+//   g++ -std=c++17 -O2 -o multi-hop-lora-sweep tools/multi-hop-lora-sweep.cc
+// Example:
+//   ./multi-hop-lora-sweep --sim=./ns3-dev-multi-hop-lora-sim-optimized
+//       --scenarios=obstructed,unobstructed --numPackets=92,184 --runs=30
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct Job
+{
+    std::string scenario;
+    uint32_t numPackets;
+    double interval;
+    std::string args; //extra args as stored in the state file
+    uint32_t run;
+
+    std::string Key(void) const
+    {
+        std::ostringstream os;
+        os << scenario << "," << numPackets << "," << interval << "," << args << "," << run;
+        return os.str();
+    }
+    std::string FileBase(const std::string &dir) const
+    {
+        std::ostringstream os;
+        os << dir << "/job-" << scenario << "-" << numPackets << "-" << interval << "-" << run;
+        return os.str();
+    }
+};
+
+std::vector<std::string>
+Split(const std::string &text, char sep)
+{
+    std::vector<std::string> out;
+    std::string item;
+    std::istringstream in(text);
+    while (std::getline(in, item, sep))
+    {
+        if (!item.empty())
+        {
+            out.push_back(item);
+        }
+    }
+    return out;
+}
+
+std::string
+Format(double value)
+{
+    std::ostringstream os;
+    os << value;
+    return os.str();
+}
+
+//two-sided 95% Student t quantiles for 1..30 degrees of freedom
+double
+TQuantile(uint32_t df)
+{
+    static const double table[] = {12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+                                   2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+                                   2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+    if (df == 0)
+    {
+        return 0.0;
+    }
+    return df <= 30 ? table[df - 1] : 1.96;
+}
+
+pid_t
+Launch(const std::string &sim, const std::vector<std::string> &args, const std::string &logFile)
+{
+    pid_t pid = fork();
+    if (pid != 0)
+    {
+        return pid;
+    }
+
+    int fd = open(logFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd >= 0)
+    {
+        dup2(fd, STDOUT_FILENO);
+        dup2(fd, STDERR_FILENO);
+        close(fd);
+    }
+    std::vector<char *> argv;
+    argv.push_back(const_cast<char *>(sim.c_str()));
+    for (const std::string &a : args)
+    {
+        argv.push_back(const_cast<char *>(a.c_str()));
+    }
+    argv.push_back(nullptr);
+    execv(sim.c_str(), argv.data());
+    std::perror("execv");
+    _exit(127);
+}
+
+//returns the metric columns (everything after "run") of the sim's results file
+bool
+ReadResult(const std::string &file, std::string &header, std::string &row)
+{
+    std::ifstream in(file);
+    std::string line;
+    std::vector<std::string> lines;
+    while (std::getline(in, line))
+    {
+        if (!line.empty())
+        {
+            lines.push_back(line);
+        }
+    }
+    if (lines.size() < 2)
+    {
+        return false;
+    }
+    auto metrics = [](const std::string &csv) {
+        std::vector<std::string> fields = Split(csv, ',');
+        std::string out;
+        for (size_t i = 5; i < fields.size(); ++i)
+        {
+            out += (i > 5 ? "," : "") + fields[i];
+        }
+        return out;
+    };
+    header = metrics(lines.front());
+    row = metrics(lines.back());
+    return !row.empty();
+}
+
+//extra args as one CSV field: space separated, commas swapped for semicolons, "-" when there are none
+std::string
+ArgsField(const std::vector<std::string> &args)
+{
+    std::string field;
+    for (const std::string &a : args)
+    {
+        field += (field.empty() ? "" : " ") + a;
+    }
+    for (char &c : field)
+    {
+        c = c == ',' ? ';' : c;
+    }
+    return field.empty() ? "-" : field;
+}
+
+} //namespace
+
+int main(int argc, char *argv[])
+{
+    std::string sim;
+    std::vector<std::string> scenarios = {"obstructed"};
+    std::vector<std::string> numPackets = {"184"};
+    std::vector<std::string> intervals = {"0"};
+    uint32_t runs = 10;
+    uint32_t firstRun = 1;
+    uint32_t seed = 1;
+    uint32_t jobs = std::max(1u, std::thread::hardware_concurrency());
+    std::string stateFile = "sweep-state.csv";
+    std::string outFile = "sweep-summary.csv";
+    std::string workDir = "sweep-jobs";
+    std::vector<std::string> extraArgs;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        size_t eq = arg.find('=');
+        std::string name = arg.substr(0, eq);
+        std::string value = eq == std::string::npos ? "" : arg.substr(eq + 1);
+        if (name == "--sim")
+        {
+            sim = value;
+        }
+        else if (name == "--scenarios")
+        {
+            scenarios = Split(value, ',');
+        }
+        else if (name == "--numPackets")
+        {
+            numPackets = Split(value, ',');
+        }
+        else if (name == "--intervals")
+        {
+            intervals = Split(value, ',');
+        }
+        else if (name == "--runs")
+        {
+            runs = std::stoul(value);
+        }
+        else if (name == "--firstRun")
+        {
+            firstRun = std::stoul(value);
+        }
+        else if (name == "--seed")
+        {
+            seed = std::stoul(value);
+        }
+        else if (name == "--jobs")
+        {
+            jobs = std::max(1ul, std::stoul(value));
+        }
+        else if (name == "--state")
+        {
+            stateFile = value;
+        }
+        else if (name == "--out")
+        {
+            outFile = value;
+        }
+        else if (name == "--workdir")
+        {
+            workDir = value;
+        }
+        else if (name == "--args")
+        {
+            extraArgs = Split(value, ' ');
+        }
+        else
+        {
+            std::cerr << "usage: " << argv[0] << " --sim=PATH [--scenarios=a,b] [--numPackets=n1,n2] [--intervals=s1,s2]"
+                      << " [--runs=N] [--firstRun=N] [--seed=N] [--jobs=N] [--state=FILE] [--out=FILE]"
+                      << " [--workdir=DIR] [--args=\"--topology=grid ...\"]" << std::endl;
+            return 1;
+        }
+    }
+    if (sim.empty())
+    {
+        std::cerr << "--sim is required" << std::endl;
+        return 1;
+    }
+    mkdir(workDir.c_str(), 0755);
+    std::string argsField = ArgsField(extraArgs);
+
+    //previously completed jobs, the first line is the header
+    //the extra args are part of the key, so a state file only resumes runs with the same --args
+    std::set<std::string> done;
+    std::string metricHeader;
+    {
+        std::ifstream in(stateFile);
+        std::string line;
+        bool first = true;
+        while (std::getline(in, line))
+        {
+            std::vector<std::string> f = Split(line, ',');
+            if (first)
+            {
+                if (f.size() < 5 || f[3] != "args")
+                {
+                    std::cerr << stateFile << " has no args column, start a new state file" << std::endl;
+                    return 1;
+                }
+                for (size_t i = 5; i < f.size(); ++i)
+                {
+                    metricHeader += (i > 5 ? "," : "") + f[i];
+                }
+                first = false;
+                continue;
+            }
+            if (f.size() >= 5)
+            {
+                done.insert(f[0] + "," + f[1] + "," + f[2] + "," + f[3] + "," + f[4]);
+            }
+        }
+    }
+
+    std::vector<Job> pending;
+    for (const std::string &scenario : scenarios)
+    {
+        for (const std::string &n : numPackets)
+        {
+            for (const std::string &interval : intervals)
+            {
+                for (uint32_t run = firstRun; run < firstRun + runs; ++run)
+                {
+                    Job job{scenario, uint32_t(std::stoul(n)), std::stod(interval), argsField, run};
+                    if (!done.count(job.Key()))
+                    {
+                        pending.push_back(job);
+                    }
+                }
+            }
+        }
+    }
+    std::cout << done.size() << " jobs already done, " << pending.size() << " to run on " << jobs << " workers" << std::endl;
+
+    std::ofstream state(stateFile, std::ios::app);
+    std::map<pid_t, Job> running;
+    uint32_t next = 0;
+    uint32_t finished = 0;
+    uint32_t failed = 0;
+    while (next < pending.size() || !running.empty())
+    {
+        while (next < pending.size() && running.size() < jobs)
+        {
+            const Job &job = pending[next];
+            std::string base = job.FileBase(workDir);
+            std::remove((base + ".csv").c_str());
+            std::vector<std::string> args = {"--scenario=" + job.scenario,
+                                             "--numPackets=" + std::to_string(job.numPackets),
+                                             "--packetInterval=" + Format(job.interval),
+                                             "--RngSeed=" + std::to_string(seed),
+                                             "--RngRun=" + std::to_string(job.run),
+                                             "--results=" + base + ".csv"};
+            args.insert(args.end(), extraArgs.begin(), extraArgs.end());
+            pid_t pid = Launch(sim, args, base + ".log");
+            if (pid < 0)
+            {
+                std::perror("fork");
+                return 1;
+            }
+            running[pid] = job;
+            next++;
+        }
+
+        int status = 0;
+        pid_t pid = waitpid(-1, &status, 0);
+        auto it = running.find(pid);
+        if (it == running.end())
+        {
+            continue;
+        }
+        Job job = it->second;
+        running.erase(it);
+
+        std::string base = job.FileBase(workDir);
+        std::string header, row;
+        if (WIFEXITED(status) && WEXITSTATUS(status) == 0 && ReadResult(base + ".csv", header, row))
+        {
+            if (metricHeader.empty())
+            {
+                metricHeader = header;
+                state << "scenario,numPackets,interval,args,run," << metricHeader << std::endl;
+            }
+            state << job.Key() << "," << row << std::endl; //flushed per job so an interrupted sweep can resume
+            finished++;
+        }
+        else
+        {
+            std::cerr << "job " << job.Key() << " failed, see " << base << ".log" << std::endl;
+            failed++;
+        }
+        std::cout << "\r" << finished << "/" << pending.size() << " done, " << failed << " failed" << std::flush;
+    }
+    std::cout << std::endl;
+    state.close();
+
+    //merge: per configuration, mean and 95% CI half-width of every metric
+    std::map<std::string, std::vector<std::vector<double>>> samples;
+    std::vector<std::string> metrics = Split(metricHeader, ',');
+    {
+        std::ifstream in(stateFile);
+        std::string line;
+        std::getline(in, line);
+        while (std::getline(in, line))
+        {
+            std::vector<std::string> f = Split(line, ',');
+            if (f.size() != 5 + metrics.size())
+            {
+                continue;
+            }
+            std::vector<double> values;
+            for (size_t i = 5; i < f.size(); ++i)
+            {
+                values.push_back(std::atof(f[i].c_str()));
+            }
+            samples[f[0] + "," + f[1] + "," + f[2] + "," + f[3]].push_back(values);
+        }
+    }
+
+    std::ofstream out(outFile);
+    out << "scenario,numPackets,interval,args,replications";
+    for (const std::string &m : metrics)
+    {
+        out << "," << m << "_mean," << m << "_ci95";
+    }
+    out << std::endl;
+    for (const auto &entry : samples)
+    {
+        const std::vector<std::vector<double>> &rows = entry.second;
+        out << entry.first << "," << rows.size();
+        for (size_t m = 0; m < metrics.size(); ++m)
+        {
+            double sum = 0;
+            for (const auto &r : rows)
+            {
+                sum += r[m];
+            }
+            double mean = sum / rows.size();
+            double sq = 0;
+            for (const auto &r : rows)
+            {
+                sq += (r[m] - mean) * (r[m] - mean);
+            }
+            double ci = rows.size() > 1 ? TQuantile(rows.size() - 1) * std::sqrt(sq / (rows.size() - 1) / rows.size()) : 0.0;
+            out << "," << mean << "," << ci;
+        }
+        out << std::endl;
+    }
+    std::cout << "Merged " << samples.size() << " configurations into " << outFile << std::endl;
+    return failed > 0 ? 2 : 0;
+}
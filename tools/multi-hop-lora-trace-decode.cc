@@ -0,0 +1,146 @@
+// Decoder for the binary event trace written by multi-hop-lora-sim --trace.
+//
+// Reads one or more trace files (e.g. the per-rank files of a distributed
+// run) and writes one CSV line per record, in file order, to stdout or --out.
+// With --summary it prints only the number of records of each type.
+//
+// Build (plain C++17, no ns-3 needed):
+//   g++ -std=c++17 -O2 -o multi-hop-lora-trace-decode tools/multi-hop-lora-trace-decode.cc
+// Example:
+//   ./multi-hop-lora-trace-decode --out=events.csv trace.bin
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+//must match MultiHopLoraTraceRecord in multi-hop-lora-trace.h
+struct Record
+{
+    int64_t timeNs;
+    uint32_t node;
+    uint32_t lfid;
+    uint8_t type;
+    uint8_t lh;
+    uint8_t lgw;
+    uint8_t reserved;
+    uint32_t aux;
+};
+static_assert(sizeof(Record) == 24, "Record layout does not match the trace format");
+
+const uint32_t MAGIC = 0x544c484d; //"MHLT"
+const uint32_t VERSION = 1;
+
+const char *TYPE_NAMES[] = {"unknown", "tx", "rx", "dup-buffered", "forward", "drop-maxhop", "drop-spatial", "drop-filter", "gateway-deliver", "aggregate", "drop-queue", "suppressed", "beacon", "lgw-change"};
+const uint32_t NUM_TYPES = sizeof(TYPE_NAMES) / sizeof(TYPE_NAMES[0]);
+
+const char *
+TypeName(uint8_t type)
+{
+    return type < NUM_TYPES ? TYPE_NAMES[type] : TYPE_NAMES[0];
+}
+
+} //namespace
+
+int main(int argc, char *argv[])
+{
+    std::string outFile;
+    bool summary = false;
+    std::vector<std::string> inputs;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg.compare(0, 6, "--out=") == 0)
+        {
+            outFile = arg.substr(6);
+        }
+        else if (arg == "--summary")
+        {
+            summary = true;
+        }
+        else if (arg.compare(0, 2, "--") == 0)
+        {
+            std::cerr << "usage: " << argv[0] << " [--out=FILE] [--summary] TRACE..." << std::endl;
+            return 1;
+        }
+        else
+        {
+            inputs.push_back(arg);
+        }
+    }
+    if (inputs.empty())
+    {
+        std::cerr << "no trace file given" << std::endl;
+        return 1;
+    }
+
+    std::ofstream file;
+    if (!outFile.empty())
+    {
+        file.open(outFile);
+    }
+    std::ostream &out = outFile.empty() ? std::cout : file;
+    if (!summary)
+    {
+        out << "time_ns,node,type,lfid,source,seq,lh,lgw,aux\n";
+    }
+
+    std::vector<uint64_t> counts(NUM_TYPES, 0);
+    std::vector<Record> block(65536);
+    for (const std::string &input : inputs)
+    {
+        std::FILE *in = std::fopen(input.c_str(), "rb");
+        if (!in)
+        {
+            std::perror(input.c_str());
+            return 1;
+        }
+        uint32_t header[3];
+        if (std::fread(header, sizeof(header), 1, in) != 1 || header[0] != MAGIC)
+        {
+            std::cerr << input << ": not a multi-hop-lora trace" << std::endl;
+            return 1;
+        }
+        if (header[1] != VERSION || header[2] != sizeof(Record))
+        {
+            std::cerr << input << ": unsupported trace version " << header[1] << " (record size " << header[2] << ")" << std::endl;
+            return 1;
+        }
+
+        size_t n;
+        while ((n = std::fread(block.data(), sizeof(Record), block.size(), in)) > 0)
+        {
+            for (size_t i = 0; i < n; ++i)
+            {
+                const Record &r = block[i];
+                counts[r.type < NUM_TYPES ? r.type : 0]++;
+                if (summary)
+                {
+                    continue;
+                }
+                //LFID = (source << 16) | sequence, see MultiHopLoraHeader::MakeLfid
+                out << r.timeNs << ',' << r.node << ',' << TypeName(r.type) << ',' << r.lfid << ',' << (r.lfid >> 16) << ','
+                    << (r.lfid & 0xffff) << ',' << int(r.lh) << ',' << int(r.lgw) << ',' << r.aux << '\n';
+            }
+        }
+        std::fclose(in);
+    }
+
+    if (summary)
+    {
+        for (uint32_t t = 1; t < NUM_TYPES; ++t)
+        {
+            std::cout << TypeName(t) << "," << counts[t] << std::endl;
+        }
+        if (counts[0] > 0)
+        {
+            std::cout << "unknown," << counts[0] << std::endl;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,215 @@
+// Stand-in network server for multi-hop-lora-sim --forwarder.
+//
+// Listens for Semtech UDP packet-forwarder datagrams, acknowledges every
+// PUSH_DATA with a PUSH_ACK and reports the ingest rate once per --interval
+// seconds: datagrams, rxpk objects and the delay from the rxpk "time" stamp to
+// its arrival (both ends read the same host clock). It stops after --idle
+// seconds without traffic once the first datagram arrived, or on --duration.
+//
+// Build (plain C++17, no ns-3 needed):
+//   g++ -std=c++17 -O2 -o multi-hop-lora-udp-receiver tools/multi-hop-lora-udp-receiver.cc
+// Example:
+//   ./multi-hop-lora-udp-receiver --port=1700 &
+//   ./multi-hop-lora-sim --topology=grid --numNodes=400 --numSources=50 --forwarder=127.0.0.1:1700 --realtime=1
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <set>
+#include <string>
+
+namespace {
+
+const uint8_t PROTOCOL_VERSION = 2;
+const uint8_t PUSH_DATA = 0x00;
+const uint8_t PUSH_ACK = 0x01;
+
+struct Counters
+{
+    uint64_t datagrams = 0;
+    uint64_t rxpk = 0;
+    uint64_t bytes = 0;
+    uint64_t malformed = 0;
+    uint64_t delays = 0;
+    double delaySum = 0; //seconds
+    double delayMax = 0;
+};
+
+//seconds since the epoch of an rxpk "time" field, negative if there is none
+double ParseTime(const std::string &json, std::size_t from)
+{
+    std::size_t key = json.find("\"time\":\"", from);
+    if (key == std::string::npos)
+    {
+        return -1;
+    }
+    std::tm utc;
+    std::memset(&utc, 0, sizeof(utc));
+    unsigned long micros = 0;
+    if (std::sscanf(json.c_str() + key + 8, "%4d-%2d-%2dT%2d:%2d:%2d.%6luZ", &utc.tm_year, &utc.tm_mon, &utc.tm_mday,
+                    &utc.tm_hour, &utc.tm_min, &utc.tm_sec, &micros) < 6)
+    {
+        return -1;
+    }
+    utc.tm_year -= 1900;
+    utc.tm_mon -= 1;
+    return double(timegm(&utc)) + micros / 1e6;
+}
+
+double WallNow(void)
+{
+    return std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+void Report(const char *label, double seconds, const Counters &c)
+{
+    std::printf("%-8s %10.1f %12.1f %12.1f %10.3f %10.3f %10llu\n", label, seconds, c.datagrams / seconds, c.rxpk / seconds,
+                c.delays > 0 ? c.delaySum / c.delays * 1000.0 : 0.0, c.delayMax * 1000.0, (unsigned long long)c.malformed);
+    std::fflush(stdout);
+}
+
+} //namespace
+
+int main(int argc, char *argv[])
+{
+    uint16_t port = 1700;
+    double interval = 1.0;
+    double idle = 10.0;
+    double duration = 0.0;
+    bool ack = true;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg.compare(0, 7, "--port=") == 0)
+        {
+            port = uint16_t(std::stoul(arg.substr(7)));
+        }
+        else if (arg.compare(0, 11, "--interval=") == 0)
+        {
+            interval = std::stod(arg.substr(11));
+        }
+        else if (arg.compare(0, 7, "--idle=") == 0)
+        {
+            idle = std::stod(arg.substr(7));
+        }
+        else if (arg.compare(0, 11, "--duration=") == 0)
+        {
+            duration = std::stod(arg.substr(11));
+        }
+        else if (arg == "--no-ack")
+        {
+            ack = false;
+        }
+        else
+        {
+            std::cerr << "usage: " << argv[0] << " [--port=1700] [--interval=1] [--idle=10] [--duration=0] [--no-ack]" << std::endl;
+            return 1;
+        }
+    }
+
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in local;
+    std::memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_port = htons(port);
+    local.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (fd < 0 || bind(fd, reinterpret_cast<sockaddr *>(&local), sizeof(local)) != 0)
+    {
+        std::perror("bind");
+        return 1;
+    }
+    //a large buffer keeps bursts of a fast sim from being dropped by the kernel
+    int buffer = 8 << 20;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &buffer, sizeof(buffer));
+    timeval timeout{0, 100000};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    std::printf("%-8s %10s %12s %12s %10s %10s %10s\n", "", "seconds", "datagrams/s", "rxpk/s", "delay_ms", "max_ms", "malformed");
+    Counters total, window;
+    std::set<std::string> gateways;
+    double start = -1, last = -1, windowStart = -1;
+    char buf[65536];
+    while (true)
+    {
+        double now = WallNow();
+        if (start >= 0 && ((idle > 0 && now - last > idle) || (duration > 0 && now - start > duration)))
+        {
+            break;
+        }
+        if (windowStart >= 0 && now - windowStart >= interval)
+        {
+            Report("window", now - windowStart, window);
+            window = Counters();
+            windowStart = now;
+        }
+
+        sockaddr_in remote;
+        socklen_t remoteSize = sizeof(remote);
+        ssize_t size = recvfrom(fd, buf, sizeof(buf), 0, reinterpret_cast<sockaddr *>(&remote), &remoteSize);
+        if (size < 0)
+        {
+            continue;
+        }
+        now = WallNow();
+        if (start < 0)
+        {
+            start = windowStart = now;
+        }
+        last = now;
+        for (Counters *c : {&total, &window})
+        {
+            c->datagrams++;
+            c->bytes += size;
+        }
+        if (size < 12 || uint8_t(buf[0]) != PROTOCOL_VERSION || uint8_t(buf[3]) != PUSH_DATA)
+        {
+            total.malformed++;
+            window.malformed++;
+            continue;
+        }
+        if (ack)
+        {
+            uint8_t reply[4] = {PROTOCOL_VERSION, uint8_t(buf[1]), uint8_t(buf[2]), PUSH_ACK};
+            sendto(fd, reply, sizeof(reply), 0, reinterpret_cast<sockaddr *>(&remote), remoteSize);
+        }
+        gateways.insert(std::string(buf + 4, 8));
+
+        std::string json(buf + 12, size - 12);
+        for (std::size_t at = json.find("\"tmst\""); at != std::string::npos; at = json.find("\"tmst\"", at + 1))
+        {
+            total.rxpk++;
+            window.rxpk++;
+        }
+        double stamp = ParseTime(json, 0);
+        if (stamp >= 0)
+        {
+            double delay = now - stamp;
+            for (Counters *c : {&total, &window})
+            {
+                c->delays++;
+                c->delaySum += delay;
+                c->delayMax = std::max(c->delayMax, delay);
+            }
+        }
+    }
+
+    if (start < 0)
+    {
+        std::printf("no datagrams received\n");
+        return 0;
+    }
+    Report("total", std::max(last - start, 1e-6), total);
+    std::printf("%llu datagrams, %llu rxpk, %llu bytes from %zu gateways\n", (unsigned long long)total.datagrams,
+                (unsigned long long)total.rxpk, (unsigned long long)total.bytes, gateways.size());
+    close(fd);
+    return 0;
+}